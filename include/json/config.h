@@ -127,6 +127,13 @@ extern JSON_API int msvc_pre1900_c99_snprintf(char* outBuf, size_t size,
 #define JSON_USE_INT64_DOUBLE_CONVERSION 1
 #endif
 
+// std::string_view accessors are only offered to C++17 (and later) clients.
+#if !defined(JSONCPP_HAS_STRING_VIEW)
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#define JSONCPP_HAS_STRING_VIEW 1
+#endif
+#endif // if !defined(JSONCPP_HAS_STRING_VIEW)
+
 #if !defined(JSON_IS_AMALGAMATION)
 
 #include "allocator.h"
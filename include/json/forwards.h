@@ -13,8 +13,14 @@
 namespace Json {
 
 // writer.h
+class OutputBuffer;
+class StringOutputBuffer;
+#if !defined(_WIN32)
+class FdOutputBuffer;
+#endif
 class StreamWriter;
 class StreamWriterBuilder;
+class Emitter;
 class Writer;
 class FastWriter;
 class StyledWriter;
@@ -24,6 +30,7 @@ class StyledStreamWriter;
 class Reader;
 class CharReader;
 class CharReaderBuilder;
+class Document;
 
 // json_features.h
 class Features;
@@ -31,8 +38,12 @@ class Features;
 // value.h
 typedef unsigned int ArrayIndex;
 class StaticString;
+class BorrowedString;
 class Path;
 class PathArgument;
+class Pointer;
+class PointerSet;
+class Query;
 class Value;
 class ValueIteratorBase;
 class ValueIterator;
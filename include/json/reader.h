@@ -189,44 +189,15 @@ private:
 
   typedef std::deque<ErrorInfo> Errors;
 
-  bool readToken(Token& token);
-  void skipSpaces();
-  bool match(const Char* pattern, int patternLength);
-  bool readComment();
-  bool readCStyleComment();
-  bool readCppStyleComment();
-  bool readString();
-  void readNumber();
-  bool readValue();
-  bool readObject(Token& token);
-  bool readArray(Token& token);
-  bool decodeNumber(Token& token);
-  bool decodeNumber(Token& token, Value& decoded);
-  bool decodeString(Token& token);
-  bool decodeString(Token& token, String& decoded);
-  bool decodeDouble(Token& token);
-  bool decodeDouble(Token& token, Value& decoded);
-  bool decodeUnicodeCodePoint(Token& token, Location& current, Location end,
-                              unsigned int& unicode);
-  bool decodeUnicodeEscapeSequence(Token& token, Location& current,
-                                   Location end, unsigned int& unicode);
   bool addError(const String& message, Token& token, Location extra = nullptr);
-  bool recoverFromError(TokenType skipUntilToken);
-  bool addErrorAndRecover(const String& message, Token& token,
-                          TokenType skipUntilToken);
-  void skipUntilSpace();
-  Value& currentValue();
-  Char getNextChar();
   void getLocationLineAndColumn(Location location, int& line,
                                 int& column) const;
   String getLocationLineAndColumn(Location location) const;
-  void addComment(Location begin, Location end, CommentPlacement placement);
-  void skipCommentTokens(Token& token);
-
-  static bool containsNewLine(Location begin, Location end);
-  static String normalizeEOL(Location begin, Location end);
 
   typedef std::stack<Value*> Nodes;
+  // parse() runs the CharReader engine; nodes_, current_, lastValueEnd_,
+  // lastValue_, commentsBefore_ and collectComments_ are no longer used, and
+  // are kept only so that the class layout does not change.
   Nodes nodes_;
   Errors errors_;
   String document_;
@@ -244,6 +215,17 @@ private:
  */
 class JSON_API CharReader {
 public:
+  /** \brief An error tagged with where in the JSON text it was encountered.
+   *
+   * The offsets give the [start, limit) range of bytes within the text. Note
+   * that this is bytes, not codepoints.
+   */
+  struct StructuredError {
+    ptrdiff_t offset_start;
+    ptrdiff_t offset_limit;
+    String message;
+  };
+
   virtual ~CharReader() = default;
   /** \brief Read a Value from a <a HREF="http://www.json.org">JSON</a>
    * document. The document must be a UTF-8 encoded string containing the
@@ -264,6 +246,26 @@ public:
   virtual bool parse(char const* beginDoc, char const* endDoc, Value* root,
                      String* errs) = 0;
 
+  /** \brief Read a Value from a mutable JSON document, in place.
+   *
+   * Like parse(), but string escapes are decoded inside [beginDoc, endDoc),
+   * and the string values and object member names of \c root reference
+   * those decoded (and null-terminated) bytes instead of owning copies.
+   * The buffer must therefore outlive \c root, and its content is
+   * unspecified afterwards. Copies of \c root own their strings.
+   * \sa Document
+   *
+   * The default implementation simply calls parse().
+   */
+  virtual bool parseInSitu(char* beginDoc, char* endDoc, Value* root,
+                           String* errs);
+
+  /** \brief Returns the errors of the last parse().
+   *
+   * The default implementation returns none.
+   */
+  virtual std::vector<StructuredError> getStructuredErrors() const;
+
   class JSON_API Factory {
   public:
     virtual ~Factory() = default;
@@ -322,6 +324,36 @@ public:
    * - `"allowSpecialFloats": false or true`
    *   - If true, special float values (NaNs and infinities) are allowed and
    *     their values are lossfree restorable.
+   * - `"borrowStrings": false or true`
+   *   - If true, string values and object member names without escape
+   *     sequences reference the document text instead of owning copies (see
+   *     BorrowedString). The text must then outlive the root Value, so
+   *     parseFromStream() ignores this setting, as well as lazyNumbers and
+   *     lazyUnescape. Copies of the root Value own their strings. As the
+   *     text is left as it is, these strings are not null-terminated, and
+   *     asCString() throws on them: read them with getString() or
+   *     getStringView(). (parseInSitu() null-terminates the strings.)
+   * - `"lazyNumbers": false or true`
+   *   - If true, numbers other than integers keep their literal from the
+   *     document text and are only converted when accessed; writers emit that
+   *     literal as is (see Value::getNumberText()). The conversion is not
+   *     cached, so that the Value stays safe to read from several threads:
+   *     each accessor call converts again, and a number read often is best
+   *     read once. As with borrowStrings, the text must outlive the root
+   *     Value.
+   * - `"lazyUnescape": false or true`
+   *   - If true, string values with escape sequences keep them as in the
+   *     document text, and are only decoded (once) when accessed; writers
+   *     emit them as is when they are escaped as the writer would (see
+   *     Value::getEscapedString()). As with borrowStrings, the text must
+   *     outlive the root Value. Each such string is kept with a small
+   *     allocated header, where the first access stores its decoded copy
+   *     for the next ones; concurrent const access remains safe.
+   * - `"validateUTF8": false or true`
+   *   - If true, `parse()` returns false when a string value or object member
+   *     name holds ill-formed UTF-8, or an escaped surrogate that does not
+   *     form a pair. The StructuredError of a raw sequence spans its
+   *     offending bytes.
    *
    * You can examine 'settings_` yourself to see the defaults. You can also
    * write and read them just like any JSON Value.
@@ -359,11 +391,73 @@ public:
 
 /** Consume entire stream and use its begin/end.
  * Someday we might have a real StreamReader, but for now this
- * is convenient.
+ * is convenient. As the text is gone on return, the "borrowStrings",
+ * "lazyNumbers" and "lazyUnescape" settings of a CharReaderBuilder are
+ * ignored.
  */
 bool JSON_API parseFromStream(CharReader::Factory const&, IStream&, Value* root,
                               String* errs);
 
+/** \brief A Value parsed in situ, together with the text it references.
+ *
+ * The Document takes ownership of the JSON text handed to parse(), so that
+ * root() can borrow its strings from it (see CharReader::parseInSitu()).
+ * Values copied out of root() own their strings and may outlive the
+ * Document; Values moved out of it may not.
+ *
+ * Usage:
+ *   \code
+ *   Json::CharReaderBuilder builder;
+ *   Json::Document doc;
+ *   Json::String errs;
+ *   if (doc.parse(builder, std::move(text), &errs))
+ *     use(doc.root());
+ *   \endcode
+ */
+class JSON_API Document {
+public:
+  Document();
+  Document(Document&& other);
+  Document& operator=(Document&& other);
+
+  /** Take ownership of \c text and parse it in place into root().
+   * \return \c true if the document was successfully parsed.
+   */
+  bool parse(CharReader::Factory const& factory, String text, String* errs);
+
+  /** Take ownership of \c text and parse it into root(), leaving the text
+   * as it is, so that write() can copy the values not modified since straight
+   * from it (see Value::isPristine()). Strings are copied out of the text, or
+   * borrowed from it with the "borrowStrings" setting. Values are only marked
+   * pristine if \c factory is a CharReaderBuilder.
+   * \return \c true if the document was successfully parsed.
+   */
+  bool parseKeepingSource(CharReader::Factory const& factory, String text,
+                          String* errs);
+
+  /** Write root() as builder.newStreamWriter() would. With an empty
+   * "indentation", if the text was parsed by parseKeepingSource(), the
+   * pristine values are copied from it instead, so that re-emitting an edited
+   * document costs about as much as the edit: their whitespace is kept, and
+   * "emitUTF8", "precision" or "dropNullPlaceholders" do not apply to them.
+   * Values moved or swapped into root() are written in full, and so are the
+   * values under them, even if they came from another Document or from
+   * elsewhere in this one; so are values any other reader parsed into it.
+   * \return zero on success
+   */
+  int write(StreamWriterBuilder const& builder, OutputBuffer* out) const;
+
+  Value& root() { return root_; }
+  Value const& root() const { return root_; }
+
+private:
+  // Held by pointer, so that moving the Document does not move the text.
+  std::unique_ptr<String> text_;
+  // Whether text_ still holds the text as parsed (it is not, in situ).
+  bool sourceKept_{false};
+  Value root_;
+};
+
 /** \brief Read from 'sin' into 'root'.
  *
  * Always keep comments from the input JSON.
@@ -27,6 +27,10 @@
 #include <string>
 #include <vector>
 
+#ifdef JSONCPP_HAS_STRING_VIEW
+#include <string_view>
+#endif
+
 #ifndef JSON_USE_CPPTL_SMALLMAP
 #include <map>
 #else
@@ -117,7 +121,8 @@ enum CommentPlacement {
  */
 enum PrecisionType {
   significantDigits = 0, ///< we set max number of significant digits in string
-  decimalPlaces          ///< we set max number of digits after "." in string
+  decimalPlaces,         ///< we set max number of digits after "." in string
+  shortest ///< the fewest significant digits that read back as the same value
 };
 
 //# ifdef JSON_USE_CPPTL
@@ -151,6 +156,35 @@ private:
   const char* c_str_;
 };
 
+/** \brief Lightweight wrapper to tag a borrowed string slice.
+ *
+ * Like StaticString, but length-delimited, so it may hold embedded zeroes and
+ * need not be null-terminated. Value constructor and objectValue member
+ * access do not duplicate the referenced bytes, which must therefore remain
+ * alive as long as the Value (or object) referencing them. Copies of such a
+ * Value own their strings.
+ *
+ * Example of usage:
+ * \code
+ * char const* text = ...;
+ * Json::Value object;
+ * object[BorrowedString(text, text + 4)] = BorrowedString(text + 5, text + 9);
+ * \endcode
+ */
+class JSON_API BorrowedString {
+public:
+  BorrowedString(const char* begin, const char* end)
+      : begin_(begin), end_(end) {}
+
+  const char* data() const { return begin_; }
+  const char* end() const { return end_; }
+  size_t length() const { return static_cast<size_t>(end_ - begin_); }
+
+private:
+  const char* begin_;
+  const char* end_;
+};
+
 /** \brief Represents a <a HREF="http://www.json.org">JSON</a> value.
  *
  * This class is a discriminated union wrapper that can represents a:
@@ -187,6 +221,9 @@ private:
  */
 class JSON_API Value {
   friend class ValueIteratorBase;
+  template <bool Comments, bool Extensions> friend class OurReader;
+  template <bool EmitUTF8, bool Comments> friend struct CompactStreamWriter;
+  friend class Document;
 
 public:
   typedef std::vector<String> Members;
@@ -339,6 +376,38 @@ public:
    *   \endcode
    */
   Value(const StaticString& value);
+  /**
+   * \brief Constructs a value from a borrowed string slice.
+   *
+   * Like Value(const StaticString&), the bytes are not duplicated, but they
+   * need not be null-terminated, so asCString() is not available for such
+   * values (but for strings a CharReader parsed in situ); use getString().
+   */
+  Value(const BorrowedString& value);
+  /**
+   * \brief Constructs a number or a string from its JSON literal, kept
+   * verbatim.
+   *
+   * The literal is only converted when the value is accessed, and writers
+   * emit it as is where possible (see getNumberText() and
+   * getEscapedString()). Like a BorrowedString, it is not duplicated, so it
+   * must remain alive as long as this Value; copies own their literal.
+   *
+   * \pre \c type is what the literal converts to: #intValue or #uintValue
+   * for an integer that fits, #realValue for other numbers, #stringValue for
+   * a double-quoted string with valid escape sequences.
+   */
+  Value(ValueType type, const BorrowedString& literal);
+  /**
+   * \brief Constructs a raw fragment: JSON text that writers output as is.
+   *
+   * The text is copied but neither parsed nor checked, so it must be a
+   * complete, valid JSON value; it is not re-indented either. Otherwise the
+   * fragment behaves as a #stringValue holding that text (e.g. asString()
+   * returns it, and it compares equal to a string with the same text).
+   */
+  static Value raw(const char* begin, const char* end);
+  static Value raw(const String& json);
   Value(const String& value);
 #ifdef JSON_USE_CPPTL
   Value(const CppTL::ConstString& value);
@@ -374,16 +443,46 @@ public:
   bool operator!=(const Value& other) const;
   int compare(const Value& other) const;
 
-  const char* asCString() const; ///< Embedded zeroes could cause you trouble!
+  /// Embedded zeroes could cause you trouble!
+  /// \pre The string is not borrowed (see BorrowedString), unless it was
+  /// parsed in situ, so that it is null-terminated.
+  const char* asCString() const;
 #if JSONCPP_USING_SECURE_MEMORY
   unsigned getCStringLength() const; // Allows you to understand the length of
                                      // the CString
 #endif
   String asString() const; ///< Embedded zeroes are possible.
   /** Get raw char* of string-value.
+   *  A string still escaped (see getEscapedString()) is decoded on the first
+   *  access to it, once, even by concurrent const accessors.
    *  \return false if !string. (Seg-fault if str or end are NULL.)
    */
   bool getString(char const** begin, char const** end) const;
+  /** Get the JSON literal of a number, if it was kept verbatim.
+   *  \return false unless constructed from a literal (e.g. by a CharReader
+   *  with "lazyNumbers"). (Seg-fault if begin or end are NULL.)
+   */
+  bool getNumberText(char const** begin, char const** end) const;
+  /** Get the still-escaped content (between quotes) of a string constructed
+   *  from its JSON literal (e.g. by a CharReader with "lazyUnescape").
+   *  It stays available once the string has been decoded by accessing it.
+   *  \return false if there is none. (Seg-fault if begin or end are NULL.)
+   */
+  bool getEscapedString(char const** begin, char const** end) const;
+  /** Get the JSON text of a fragment constructed by raw().
+   *  \return false for any other value. (Seg-fault if begin or end are NULL.)
+   */
+  bool getRawText(char const** begin, char const** end) const;
+#ifdef JSONCPP_HAS_STRING_VIEW
+  /// Get the string-value without copying it; empty if !string.
+  std::string_view getStringView() const {
+    char const* begin;
+    char const* end;
+    if (!getString(&begin, &end))
+      return std::string_view();
+    return std::string_view(begin, static_cast<size_t>(end - begin));
+  }
+#endif
 #ifdef JSON_USE_CPPTL
   CppTL::ConstString asConstString() const;
 #endif
@@ -541,6 +640,10 @@ public:
    *   \endcode
    */
   Value& operator[](const StaticString& key);
+  /// Access an object value by name, create a null member if it does not
+  /// exist. As with StaticString, a new member name is not duplicated; copies
+  /// of this object own their member names.
+  Value& operator[](const BorrowedString& key);
 #ifdef JSON_USE_CPPTL
   /// Access an object value by name, create a null member if it does not exist.
   Value& operator[](const CppTL::ConstString& key);
@@ -657,12 +760,40 @@ public:
   ptrdiff_t getOffsetStart() const;
   ptrdiff_t getOffsetLimit() const;
 
+  /** Whether the [start, limit) range of the text this value was parsed from
+   * still spells it out exactly. Document::parseKeepingSource() sets this on
+   * the values whose text it did not have to normalize (no comments, special
+   * floats, single quotes, numeric or duplicate keys); copies do not inherit
+   * it, and every non-const member function but setComment() clears it.
+   * Moving or swapping a value clears it on that value only, in constant
+   * time: the values under it keep it, but Document::write() no longer
+   * trusts them, since they may come from another text.
+   */
+  bool isPristine() const { return bits_.pristine_; }
+
 private:
   void setType(ValueType v) {
     bits_.value_type_ = static_cast<unsigned char>(v);
   }
   bool isAllocated() const { return bits_.allocated_; }
   void setIsAllocated(bool v) { bits_.allocated_ = v; }
+  bool isBorrowed() const { return bits_.borrowed_; }
+  void setIsBorrowed(bool v) { bits_.borrowed_ = v; }
+  bool isNullTerminated() const { return bits_.nullTerminated_; }
+  void setIsNullTerminated(bool v) { bits_.nullTerminated_ = v; }
+  bool hasNumberText() const { return bits_.numberText_; }
+  void setHasNumberText(bool v) { bits_.numberText_ = v; }
+  bool isEscaped() const { return bits_.escaped_; }
+  void setIsEscaped(bool v) { bits_.escaped_ = v; }
+  bool isRaw() const { return bits_.raw_; }
+  void setIsRaw(bool v) { bits_.raw_ = v; }
+  void setIsPristine(bool v) { bits_.pristine_ = v; }
+  bool isMoved() const { return bits_.moved_; }
+  void setIsMoved(bool v) { bits_.moved_ = v; }
+  void swapKeepingPristine(Value& other);
+  void decodeStringPayload(unsigned* length, char const** value) const;
+  void decodeString(unsigned* length, char const** value) const;
+  Value decodedNumber() const;
 
   void initBasic(ValueType type, bool allocated = false);
   void dupPayload(const Value& other);
@@ -671,6 +802,7 @@ private:
 
   Value& resolveReference(const char* key);
   Value& resolveReference(const char* key, const char* end);
+  Value& resolveBorrowedReference(const char* key, const char* end);
 
   // struct MemberNamesTransform
   //{
@@ -693,8 +825,27 @@ private:
   struct {
     // Really a ValueType, but types should agree for bitfield packing.
     unsigned int value_type_ : 8;
-    // Unless allocated_, string_ must be null-terminated.
+    // Unless allocated_ or borrowed_, string_ must be null-terminated.
     unsigned int allocated_ : 1;
+    // If borrowed_, string_ is not owned and length_ bytes long.
+    unsigned int borrowed_ : 1;
+    // If borrowed_ and nullTerminated_, string_[length_] is 0 too.
+    unsigned int nullTerminated_ : 1;
+    // If numberText_, this number is held as its literal in string_ instead,
+    // owned as per allocated_ and borrowed_.
+    unsigned int numberText_ : 1;
+    // If escaped_, string_ points to the EscapedString holding the escaped
+    // content of a JSON string, and its content decoded on first access.
+    unsigned int escaped_ : 1;
+    // If raw_, this string is JSON text to be written as is.
+    unsigned int raw_ : 1;
+    // If pristine_, see isPristine().
+    unsigned int pristine_ : 1;
+    // If moved_, this payload was moved or swapped in since it was read, so
+    // the values under it may have been parsed from another text.
+    unsigned int moved_ : 1;
+    // Fits in what would otherwise be padding before comments_.
+    unsigned int length_;
   } bits_;
 
   class Comments {
@@ -776,6 +927,146 @@ private:
   Args args_;
 };
 
+/** \brief A JSON Pointer (RFC 6901), such as "/a/0/b~1c".
+ *
+ * The text is parsed once, when the Pointer is constructed, into its
+ * unescaped reference tokens, with the array index of those that are one, so
+ * that each step of resolve() is a single lookup that neither allocates nor
+ * copies.
+ *
+ * \code
+ * static const Json::Pointer price("/order/items/0/price");
+ * if (Json::Value const* value = price.resolve(root))
+ *   total += value->asDouble();
+ * \endcode
+ */
+class JSON_API Pointer {
+public:
+  /// The pointer "", which refers to the whole document.
+  Pointer();
+  /// \throw RuntimeError if \a text is neither empty nor starts with '/', or
+  /// has a '~' that is not followed by '0' or '1'.
+  explicit Pointer(const String& text);
+
+  /// Returns the pointer text, escaped.
+  String toString() const;
+  /// Returns the number of reference tokens.
+  size_t size() const { return tokens_.size(); }
+
+  /// Returns the value the pointer refers to, or nullptr if there is none.
+  Value const* resolve(Value const& root) const;
+  /// Resolves each of \a pointers into the same position of \a results.
+  static void resolveAll(std::vector<Pointer> const& pointers,
+                         Value const& root,
+                         std::vector<Value const*>* results);
+
+  /// Creates the values the pointer goes through, as needed, and returns a
+  /// reference to the one it refers to. A null value becomes an array when
+  /// the next token is an index or "-", which appends, and an object
+  /// otherwise.
+  /// \throw LogicError if a token cannot index an existing value.
+  Value& make(Value& root) const;
+  /// Moves \a value to where the pointer refers, creating the path as by
+  /// make(), and returns a reference to it there.
+  Value& make(Value& root, Value value) const;
+
+private:
+  friend class PointerSet;
+  friend class PatchApplier;
+
+  struct Token {
+    String name_;
+    ArrayIndex index_;
+    bool isIndex_;
+  };
+
+  static Value const* resolveToken(Value const& node, Token const& token);
+
+  std::vector<Token> tokens_;
+};
+
+/** \brief A set of JSON Pointers resolved together, in one traversal.
+ *
+ * The pointers are merged into a prefix trie as they are added, so that the
+ * tokens they share are looked up only once per resolve().
+ *
+ * \code
+ * Json::PointerSet fields;
+ * size_t const id = fields.add(Json::Pointer("/event/id"));
+ * size_t const user = fields.add(Json::Pointer("/event/user/name"));
+ * std::vector<Json::Value const*> values;
+ * fields.resolve(root, &values); // values[id], values[user]
+ * \endcode
+ */
+class JSON_API PointerSet {
+public:
+  PointerSet();
+
+  /// Adds \a pointer and returns its position in the results of resolve().
+  size_t add(Pointer const& pointer);
+  /// Returns the number of pointers added.
+  size_t size() const { return size_; }
+
+  /// Resolves every pointer, as Pointer::resolve() does, into the position of
+  /// \a results that add() returned for it.
+  void resolve(Value const& root, std::vector<Value const*>* results) const;
+
+private:
+  struct Node {
+    Pointer::Token token_;
+    std::vector<size_t> children_;
+    std::vector<size_t> pointers_;
+  };
+
+  void resolveNode(size_t node, Value const& value,
+                   std::vector<Value const*>* results) const;
+
+  std::vector<Node> nodes_;
+  size_t size_{0};
+};
+
+/** \brief A JSONPath query (RFC 9535), compiled once and run on any Value.
+ *
+ * Supported: the root and current node identifiers ($ and @), child and
+ * descendant (..) segments, and name, wildcard, index, slice and filter
+ * selectors. Filters may test existence and compare with ==, !=, <, <=, >
+ * and >=, combined with !, && and || and parentheses. Function extensions
+ * are not supported.
+ *
+ * Selected values are returned in document order (objects in member order),
+ * as pointers into the queried Value; nothing is copied.
+ *
+ * \code
+ * static const Json::Query cheap("$.store.book[?@.price < 10].title");
+ * std::vector<Json::Value const*> titles;
+ * cheap.select(root, &titles);
+ * \endcode
+ */
+class JSON_API Query {
+public:
+  /// \throw RuntimeError if \a expression is not a supported JSONPath query.
+  explicit Query(const String& expression);
+
+  /// Sets \a results to the values the query selects in \a root.
+  void select(Value const& root, std::vector<Value const*>* results) const;
+
+private:
+  class Plan;
+  std::shared_ptr<Plan const> plan_;
+};
+
+/** \brief Applies a JSON Patch (RFC 6902) to \a target, in place.
+ *
+ * The operations are applied in order. "move" and "remove" move values
+ * rather than copy them, so that only "copy" and the values given in
+ * \a patch are copied. If an operation fails, the ones before it are undone,
+ * leaving \a target as it was.
+ *
+ * \throw RuntimeError if \a patch is not a valid patch, or if an operation
+ * cannot be applied, including a "test" that does not match.
+ */
+void JSON_API applyPatch(Value& target, Value const& patch);
+
 /** \brief base class for Value iterators.
  *
  */
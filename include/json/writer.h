@@ -9,6 +9,9 @@
 #if !defined(JSON_IS_AMALGAMATION)
 #include "value.h"
 #endif // if !defined(JSON_IS_AMALGAMATION)
+#include <cstdint>
+#include <cstring>
+#include <memory>
 #include <ostream>
 #include <string>
 #include <vector>
@@ -26,6 +29,130 @@ namespace Json {
 
 class Value;
 
+/** \brief Contiguous bytes that a StreamWriter appends its output to.
+ *
+ * Appending is inline, and only calls the virtual makeRoom() once the
+ * capacity runs out, so unlike an OStream there is no virtual call or sentry
+ * per token.
+ *
+ * Constructed over a caller-supplied buffer, the capacity is fixed: output
+ * that does not fit is dropped, and overflowed() becomes true. Derived
+ * classes grow the buffer (see StringOutputBuffer) or flush it by overriding
+ * makeRoom().
+ */
+class JSON_API OutputBuffer {
+public:
+  OutputBuffer(char* buffer, size_t capacity);
+  OutputBuffer(OutputBuffer const&) = delete;
+  OutputBuffer& operator=(OutputBuffer const&) = delete;
+  virtual ~OutputBuffer();
+
+  void append(char const* data, size_t length) {
+    if (length <= static_cast<size_t>(end_ - current_)) {
+      if (length != 0)
+        std::memcpy(current_, data, length);
+      current_ += length;
+    } else {
+      appendSlow(data, length);
+    }
+  }
+  void append(String const& str) { append(str.data(), str.size()); }
+  void append(char const* str) { append(str, std::strlen(str)); }
+  void append(char c) {
+    if (current_ != end_)
+      *current_++ = c;
+    else
+      appendSlow(&c, 1);
+  }
+
+  /// The bytes written so far (since the last flush, if makeRoom() flushes).
+  char const* data() const { return begin_; }
+  size_t size() const { return static_cast<size_t>(current_ - begin_); }
+  /// Whether output was dropped for lack of capacity.
+  bool overflowed() const { return overflowed_; }
+
+protected:
+  OutputBuffer();
+  /// Use [begin, end) as the buffer, of which [begin, current) is written.
+  void setBuffer(char* begin, char* current, char* end);
+  /** Called when \c length more bytes do not fit in the remaining capacity,
+   * which appending has filled. Make room for some of them, by growing or
+   * flushing the buffer then calling setBuffer(), or return false to drop
+   * them. The default returns false.
+   */
+  virtual bool makeRoom(size_t length);
+
+private:
+  void appendSlow(char const* data, size_t length);
+
+  char* begin_{nullptr};
+  char* current_{nullptr};
+  char* end_{nullptr};
+  bool overflowed_{false};
+};
+
+/** \brief An OutputBuffer that grows as needed, within a String.
+ *
+ * Usage:
+ *  \code
+ *  Json::StringOutputBuffer out;
+ *  writer->write(value, &out);
+ *  Json::String document = out.release(); // no copy
+ *  \endcode
+ */
+class JSON_API StringOutputBuffer : public OutputBuffer {
+public:
+  explicit StringOutputBuffer(size_t capacity = 0);
+  ~StringOutputBuffer() override;
+
+  /// Move out what was written, leaving the buffer empty.
+  String release();
+
+protected:
+  bool makeRoom(size_t length) override;
+
+private:
+  String storage_;
+};
+
+#if !defined(_WIN32)
+/** \brief An OutputBuffer that writes to a POSIX file descriptor.
+ *
+ * Output accumulates in a chain of fixed-size blocks, which are handed to
+ * the kernel together with writev() once all of them are full. Memory thus
+ * stays below blockSize * blockCount whatever the size of the document, and
+ * the output is never copied into one contiguous buffer.
+ *
+ * The file descriptor is not closed. If writev() fails, the rest of the
+ * output is dropped, overflowed() becomes true and error() returns errno.
+ */
+class JSON_API FdOutputBuffer : public OutputBuffer {
+public:
+  explicit FdOutputBuffer(int fd, size_t blockSize = 64 * 1024,
+                          size_t blockCount = 16);
+  /// Flushes what is left.
+  ~FdOutputBuffer() override;
+
+  /// Write the blocks filled so far.
+  /// \return false if writing failed, now or before.
+  bool flush();
+  /// The errno of the failed write, or 0.
+  int error() const { return error_; }
+
+protected:
+  bool makeRoom(size_t length) override;
+
+private:
+  int fd_;
+  int error_;
+  size_t blockSize_;
+  size_t blockCount_;
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  std::vector<size_t> filled_; ///< Bytes written to each block before the
+                               ///< current one.
+};
+#endif // if !defined(_WIN32)
+
 /**
  *
  * Usage:
@@ -53,6 +180,15 @@ public:
    */
   virtual int write(Value const& root, OStream* sout) = 0;
 
+  /** Write Value into the buffer, as write(root, sout) would into a stream.
+   *   Do not take ownership of out.
+   *   The default implementation goes through an OStringStream; the writers
+   *   built by StreamWriterBuilder append directly, without iostreams.
+   *   \pre out != NULL
+   *   \return zero on success
+   */
+  virtual int write(Value const& root, OutputBuffer* out);
+
   /** \brief A simple abstract factory.
    */
   class JSON_API Factory {
@@ -65,12 +201,30 @@ public:
   }; // Factory
 };   // StreamWriter
 
-/** \brief Write into stringstream, then return string, for convenience.
- * A StreamWriter will be created from the factory, used, and then deleted.
+/** \brief Write into a StringOutputBuffer, then return string, for
+ * convenience. A StreamWriter will be created from the factory, used, and
+ * then deleted.
  */
 String JSON_API writeString(StreamWriter::Factory const& factory,
                             Value const& root);
 
+/** \brief Return the exact number of bytes that a StreamWriter from the
+ * factory writes for root, without keeping the output: it is counted through
+ * a small scratch buffer, so nothing the size of the document is allocated.
+ */
+size_t JSON_API serializedSize(Value const& root,
+                               StreamWriter::Factory const& factory);
+
+/** \brief Write root into [buffer, buffer + capacity), as a StreamWriter from
+ * the factory would, without allocating any room for it.
+ *
+ * Like snprintf(), return the serializedSize() of root whatever the capacity:
+ * only when it does not exceed capacity is the output complete. No null
+ * terminator is written.
+ */
+size_t JSON_API writeTo(Value const& root, StreamWriter::Factory const& factory,
+                        char* buffer, size_t capacity);
+
 /** \brief Build a StreamWriter implementation.
 
 * Usage:
@@ -108,8 +262,24 @@ public:
    *  infinity as "-Infinity".
    *  - "precision": int
    *  - Number of precision digits for formatting of real values.
-   *  - "precisionType": "significant"(default) or "decimal"
-   *  - Type of precision for formatting of real values.
+   *  - "precisionType": "significant"(default), "decimal" or "shortest"
+   *  - Type of precision for formatting of real values. "shortest" ignores
+   *    "precision", and writes the fewest significant digits that read back
+   *    as the same double (e.g. 0.1 rather than 0.10000000000000001).
+   *  - "threads": int
+   *  - Number of threads that write the children of an array or object with
+   *    at least "parallelThreshold" of them; 0 for one per hardware thread.
+   *    The output is the same whatever the number. Each StreamWriter starts
+   *    its threads once, on first need. Children are written in short runs,
+   *    of which at most two per thread wait to be appended, so memory does
+   *    not grow with the size of the container.
+   *  - "parallelThreshold": int
+   *  - "canonical": false or true
+   *  - If true, write the RFC 8785 canonical form, whatever the other
+   *    settings: no whitespace or comments, members sorted by the UTF-16
+   *    code units of their names, only the escapes JSON requires, and numbers
+   *    as ECMAScript writes them. NaN and infinities throw. Emitter ignores
+   *    this setting, as it cannot sort members.
 
    *  You can examine 'settings_` yourself
    *  to see the defaults. You can also write and read them just like any
@@ -140,6 +310,122 @@ public:
    * \snippet src/lib_json/json_writer.cpp StreamWriterBuilderDefaults
    */
   static void setDefaults(Json::Value* settings);
+  /** The defaults, with "canonical" set, to write the RFC 8785 canonical form
+   * of values, e.g. to compare or hash them.
+   * \pre 'settings' != NULL (but Json::null is fine)
+   * \remark Defaults:
+   * \snippet src/lib_json/json_writer.cpp StreamWriterBuilderCanonicalMode
+   */
+  static void canonicalMode(Json::Value* settings);
+};
+
+/** \brief Return the 64-bit FNV-1a hash of the RFC 8785 canonical form of
+ * root, hashed as it is written, without building it.
+ *
+ * To use another hash, write with a StreamWriter from a builder in
+ * StreamWriterBuilder::canonicalMode() into an OutputBuffer whose makeRoom()
+ * feeds the hasher.
+ */
+std::uint64_t JSON_API canonicalHash(Value const& root);
+
+/** \brief Writes a JSON document event by event, without building a Value.
+ *
+ * Arrays and objects are opened and closed explicitly, and each member of an
+ * object is introduced by key(). The output follows the settings of a
+ * StreamWriterBuilder ("commentStyle" aside, since there are no comments):
+ * with an empty "indentation" it is what the builder's StreamWriter writes
+ * for the equivalent Value. When indented, every non-empty array spans
+ * several lines, as an emitter cannot look ahead to fit it on one.
+ *
+ * Misuse, such as a value without a key inside an object or an end*() that
+ * does not match its begin*(), is caught by assertions in debug builds.
+ *
+ * Usage:
+ * \code
+ *   Json::StreamWriterBuilder builder;
+ *   Json::Emitter emitter(builder, &std::cout);
+ *   emitter.beginObject();
+ *   emitter.key("rows");
+ *   emitter.beginArray();
+ *   while (cursor.next())
+ *     emitter.value(cursor.id());
+ *   emitter.endArray();
+ *   emitter.endObject();
+ *   emitter.finish();
+ * \endcode
+ */
+class JSON_API Emitter {
+public:
+  /** Do not take ownership of out, but maintain a reference until finish().
+   * \throw std::exception if the builder's settings are invalid
+   */
+  Emitter(StreamWriterBuilder const& builder, OutputBuffer* out);
+  /** Do not take ownership of sout. The output is buffered, and reaches the
+   * stream at the latest in finish().
+   * \throw std::exception if the builder's settings are invalid
+   */
+  Emitter(StreamWriterBuilder const& builder, OStream* sout);
+  Emitter(Emitter const&) = delete;
+  Emitter& operator=(Emitter const&) = delete;
+  ~Emitter();
+
+  void beginObject();
+  void endObject();
+  void beginArray();
+  void endArray();
+  /// Start the next member of the current object.
+  void key(const char* begin, const char* end);
+  void key(const char* name);
+  void key(const String& name);
+
+  void null();
+  void value(bool b);
+  void value(Int i);
+  void value(UInt u);
+#if defined(JSON_HAS_INT64)
+  void value(Int64 i);
+  void value(UInt64 u);
+#endif // if defined(JSON_HAS_INT64)
+  void value(double d);
+  void value(const char* begin, const char* end);
+  void value(const char* str);
+  void value(const String& str);
+  /// Write JSON text as is, like a Value::raw() fragment.
+  void raw(const char* begin, const char* end);
+  void raw(const String& json);
+
+  /** Flush the output to the stream, if any. The document must be complete:
+   * its root value written and every array and object closed.
+   */
+  void finish();
+
+private:
+  struct Scope {
+    bool object : 1;
+    bool open : 1;   ///< Whether the bracket was written.
+    bool member : 1; ///< Whether the value of a key.
+  };
+
+  void beginValue();
+  void endValue();
+  void beginContainer(bool object);
+  void endContainer(bool object);
+  void separate();
+  void newLine();
+
+  std::unique_ptr<OutputBuffer> streamOut_;
+  OutputBuffer* out_;
+  std::vector<Scope> scopes_;
+  String indentation_;
+  String indentString_;
+  String colonSymbol_;
+  String nullSymbol_;
+  unsigned int precision_;
+  PrecisionType precisionType_;
+  bool useSpecialFloats_ : 1;
+  bool emitUTF8_ : 1;
+  bool afterKey_ : 1;
+  bool done_ : 1;
 };
 
 /** \brief Abstract class for writers.
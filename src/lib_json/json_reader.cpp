@@ -11,6 +11,7 @@
 #include <json/value.h>
 #endif // if !defined(JSON_IS_AMALGAMATION)
 #include <cassert>
+#include <cmath>
 #include <cstring>
 #include <iostream>
 #include <istream>
@@ -76,653 +77,32 @@ Features Features::strictMode() {
 // Implementation of class Reader
 // ////////////////////////////////
 
-bool Reader::containsNewLine(Reader::Location begin, Reader::Location end) {
-  for (; begin < end; ++begin)
-    if (*begin == '\n' || *begin == '\r')
-      return true;
-  return false;
-}
-
-// Class Reader
-// //////////////////////////////////////////////////////////////////
-
-Reader::Reader() : features_(Features::all()) {}
-
-Reader::Reader(const Features& features) : features_(features) {}
-
-bool Reader::parse(const std::string& document, Value& root,
-                   bool collectComments) {
-  document_.assign(document.begin(), document.end());
-  const char* begin = document_.c_str();
-  const char* end = begin + document_.length();
-  return parse(begin, end, root, collectComments);
-}
-
-bool Reader::parse(std::istream& is, Value& root, bool collectComments) {
-  // std::istream_iterator<char> begin(is);
-  // std::istream_iterator<char> end;
-  // Those would allow streamed input from a file, if parse() were a
-  // template function.
-
-  // Since String is reference-counted, this at least does not
-  // create an extra copy.
-  String doc;
-  std::getline(is, doc, static_cast<char> EOF);
-  return parse(doc.data(), doc.data() + doc.size(), root, collectComments);
-}
-
-bool Reader::parse(const char* beginDoc, const char* endDoc, Value& root,
-                   bool collectComments) {
-  if (!features_.allowComments_) {
-    collectComments = false;
-  }
-
-  begin_ = beginDoc;
-  end_ = endDoc;
-  collectComments_ = collectComments;
-  current_ = begin_;
-  lastValueEnd_ = nullptr;
-  lastValue_ = nullptr;
-  commentsBefore_.clear();
-  errors_.clear();
-  while (!nodes_.empty())
-    nodes_.pop();
-  nodes_.push(&root);
-
-  bool successful = readValue();
-  Token token;
-  skipCommentTokens(token);
-  if (collectComments_ && !commentsBefore_.empty())
-    root.setComment(commentsBefore_, commentAfter);
-  if (features_.strictRoot_) {
-    if (!root.isArray() && !root.isObject()) {
-      // Set error location to start of doc, ideally should be first token found
-      // in doc
-      token.type_ = tokenError;
-      token.start_ = beginDoc;
-      token.end_ = endDoc;
-      addError(
-          "A valid JSON document must be either an array or an object value.",
-          token);
-      return false;
-    }
-  }
-  return successful;
-}
-
-bool Reader::readValue() {
-  // readValue() may call itself only if it calls readObject() or ReadArray().
-  // These methods execute nodes_.push() just before and nodes_.pop)() just
-  // after calling readValue(). parse() executes one nodes_.push(), so > instead
-  // of >=.
-  if (nodes_.size() > stackLimit_g)
-    throwRuntimeError("Exceeded stackLimit in readValue().");
-
-  Token token;
-  skipCommentTokens(token);
-  bool successful = true;
-
-  if (collectComments_ && !commentsBefore_.empty()) {
-    currentValue().setComment(commentsBefore_, commentBefore);
-    commentsBefore_.clear();
-  }
-
-  switch (token.type_) {
-  case tokenObjectBegin:
-    successful = readObject(token);
-    currentValue().setOffsetLimit(current_ - begin_);
-    break;
-  case tokenArrayBegin:
-    successful = readArray(token);
-    currentValue().setOffsetLimit(current_ - begin_);
-    break;
-  case tokenNumber:
-    successful = decodeNumber(token);
-    break;
-  case tokenString:
-    successful = decodeString(token);
-    break;
-  case tokenTrue: {
-    Value v(true);
-    currentValue().swapPayload(v);
-    currentValue().setOffsetStart(token.start_ - begin_);
-    currentValue().setOffsetLimit(token.end_ - begin_);
-  } break;
-  case tokenFalse: {
-    Value v(false);
-    currentValue().swapPayload(v);
-    currentValue().setOffsetStart(token.start_ - begin_);
-    currentValue().setOffsetLimit(token.end_ - begin_);
-  } break;
-  case tokenNull: {
-    Value v;
-    currentValue().swapPayload(v);
-    currentValue().setOffsetStart(token.start_ - begin_);
-    currentValue().setOffsetLimit(token.end_ - begin_);
-  } break;
-  case tokenArraySeparator:
-  case tokenObjectEnd:
-  case tokenArrayEnd:
-    if (features_.allowDroppedNullPlaceholders_) {
-      // "Un-read" the current token and mark the current value as a null
-      // token.
-      current_--;
-      Value v;
-      currentValue().swapPayload(v);
-      currentValue().setOffsetStart(current_ - begin_ - 1);
-      currentValue().setOffsetLimit(current_ - begin_);
-      break;
-    } // Else, fall through...
-  default:
-    currentValue().setOffsetStart(token.start_ - begin_);
-    currentValue().setOffsetLimit(token.end_ - begin_);
-    return addError("Syntax error: value, object or array expected.", token);
-  }
-
-  if (collectComments_) {
-    lastValueEnd_ = current_;
-    lastValue_ = &currentValue();
-  }
-
-  return successful;
-}
-
-void Reader::skipCommentTokens(Token& token) {
-  if (features_.allowComments_) {
-    do {
-      readToken(token);
-    } while (token.type_ == tokenComment);
-  } else {
-    readToken(token);
-  }
-}
-
-bool Reader::readToken(Token& token) {
-  skipSpaces();
-  token.start_ = current_;
-  Char c = getNextChar();
-  bool ok = true;
-  switch (c) {
-  case '{':
-    token.type_ = tokenObjectBegin;
-    break;
-  case '}':
-    token.type_ = tokenObjectEnd;
-    break;
-  case '[':
-    token.type_ = tokenArrayBegin;
-    break;
-  case ']':
-    token.type_ = tokenArrayEnd;
-    break;
-  case '"':
-    token.type_ = tokenString;
-    ok = readString();
-    break;
-  case '/':
-    token.type_ = tokenComment;
-    ok = readComment();
-    break;
-  case '0':
-  case '1':
-  case '2':
-  case '3':
-  case '4':
-  case '5':
-  case '6':
-  case '7':
-  case '8':
-  case '9':
-  case '-':
-    token.type_ = tokenNumber;
-    readNumber();
-    break;
-  case 't':
-    token.type_ = tokenTrue;
-    ok = match("rue", 3);
-    break;
-  case 'f':
-    token.type_ = tokenFalse;
-    ok = match("alse", 4);
-    break;
-  case 'n':
-    token.type_ = tokenNull;
-    ok = match("ull", 3);
-    break;
-  case ',':
-    token.type_ = tokenArraySeparator;
-    break;
-  case ':':
-    token.type_ = tokenMemberSeparator;
-    break;
-  case 0:
-    token.type_ = tokenEndOfStream;
-    break;
-  default:
-    ok = false;
-    break;
-  }
-  if (!ok)
-    token.type_ = tokenError;
-  token.end_ = current_;
-  return ok;
-}
-
-void Reader::skipSpaces() {
-  while (current_ != end_) {
-    Char c = *current_;
-    if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
-      ++current_;
-    else
-      break;
-  }
-}
-
-bool Reader::match(const Char* pattern, int patternLength) {
-  if (end_ - current_ < patternLength)
-    return false;
-  int index = patternLength;
-  while (index--)
-    if (current_[index] != pattern[index])
-      return false;
-  current_ += patternLength;
-  return true;
-}
-
-bool Reader::readComment() {
-  Location commentBegin = current_ - 1;
-  Char c = getNextChar();
-  bool successful = false;
-  if (c == '*')
-    successful = readCStyleComment();
-  else if (c == '/')
-    successful = readCppStyleComment();
-  if (!successful)
-    return false;
-
-  if (collectComments_) {
-    CommentPlacement placement = commentBefore;
-    if (lastValueEnd_ && !containsNewLine(lastValueEnd_, commentBegin)) {
-      if (c != '*' || !containsNewLine(commentBegin, current_))
-        placement = commentAfterOnSameLine;
-    }
-
-    addComment(commentBegin, current_, placement);
-  }
-  return true;
-}
-
-String Reader::normalizeEOL(Reader::Location begin, Reader::Location end) {
-  String normalized;
-  normalized.reserve(static_cast<size_t>(end - begin));
-  Reader::Location current = begin;
-  while (current != end) {
-    char c = *current++;
-    if (c == '\r') {
-      if (current != end && *current == '\n')
-        // convert dos EOL
-        ++current;
-      // convert Mac EOL
-      normalized += '\n';
-    } else {
-      normalized += c;
-    }
-  }
-  return normalized;
-}
-
-void Reader::addComment(Location begin, Location end,
-                        CommentPlacement placement) {
-  assert(collectComments_);
-  const String& normalized = normalizeEOL(begin, end);
-  if (placement == commentAfterOnSameLine) {
-    assert(lastValue_ != nullptr);
-    lastValue_->setComment(normalized, placement);
-  } else {
-    commentsBefore_ += normalized;
-  }
-}
-
-bool Reader::readCStyleComment() {
-  while ((current_ + 1) < end_) {
-    Char c = getNextChar();
-    if (c == '*' && *current_ == '/')
-      break;
-  }
-  return getNextChar() == '/';
-}
-
-bool Reader::readCppStyleComment() {
-  while (current_ != end_) {
-    Char c = getNextChar();
-    if (c == '\n')
-      break;
-    if (c == '\r') {
-      // Consume DOS EOL. It will be normalized in addComment.
-      if (current_ != end_ && *current_ == '\n')
-        getNextChar();
-      // Break on Moc OS 9 EOL.
-      break;
-    }
-  }
-  return true;
-}
-
-void Reader::readNumber() {
-  Location p = current_;
-  char c = '0'; // stopgap for already consumed character
-  // integral part
-  while (c >= '0' && c <= '9')
-    c = (current_ = p) < end_ ? *p++ : '\0';
-  // fractional part
-  if (c == '.') {
-    c = (current_ = p) < end_ ? *p++ : '\0';
-    while (c >= '0' && c <= '9')
-      c = (current_ = p) < end_ ? *p++ : '\0';
-  }
-  // exponential part
-  if (c == 'e' || c == 'E') {
-    c = (current_ = p) < end_ ? *p++ : '\0';
-    if (c == '+' || c == '-')
-      c = (current_ = p) < end_ ? *p++ : '\0';
-    while (c >= '0' && c <= '9')
-      c = (current_ = p) < end_ ? *p++ : '\0';
-  }
-}
-
-bool Reader::readString() {
-  Char c = '\0';
-  while (current_ != end_) {
-    c = getNextChar();
-    if (c == '\\')
-      getNextChar();
-    else if (c == '"')
-      break;
-  }
-  return c == '"';
-}
-
-bool Reader::readObject(Token& token) {
-  Token tokenName;
-  String name;
-  Value init(objectValue);
-  currentValue().swapPayload(init);
-  currentValue().setOffsetStart(token.start_ - begin_);
-  while (readToken(tokenName)) {
-    bool initialTokenOk = true;
-    while (tokenName.type_ == tokenComment && initialTokenOk)
-      initialTokenOk = readToken(tokenName);
-    if (!initialTokenOk)
-      break;
-    if (tokenName.type_ == tokenObjectEnd && name.empty()) // empty object
-      return true;
-    name.clear();
-    if (tokenName.type_ == tokenString) {
-      if (!decodeString(tokenName, name))
-        return recoverFromError(tokenObjectEnd);
-    } else if (tokenName.type_ == tokenNumber && features_.allowNumericKeys_) {
-      Value numberName;
-      if (!decodeNumber(tokenName, numberName))
-        return recoverFromError(tokenObjectEnd);
-      name = String(numberName.asCString());
-    } else {
-      break;
-    }
-
-    Token colon;
-    if (!readToken(colon) || colon.type_ != tokenMemberSeparator) {
-      return addErrorAndRecover("Missing ':' after object member name", colon,
-                                tokenObjectEnd);
-    }
-    Value& value = currentValue()[name];
-    nodes_.push(&value);
-    bool ok = readValue();
-    nodes_.pop();
-    if (!ok) // error already set
-      return recoverFromError(tokenObjectEnd);
-
-    Token comma;
-    if (!readToken(comma) ||
-        (comma.type_ != tokenObjectEnd && comma.type_ != tokenArraySeparator &&
-         comma.type_ != tokenComment)) {
-      return addErrorAndRecover("Missing ',' or '}' in object declaration",
-                                comma, tokenObjectEnd);
-    }
-    bool finalizeTokenOk = true;
-    while (comma.type_ == tokenComment && finalizeTokenOk)
-      finalizeTokenOk = readToken(comma);
-    if (comma.type_ == tokenObjectEnd)
-      return true;
-  }
-  return addErrorAndRecover("Missing '}' or object member name", tokenName,
-                            tokenObjectEnd);
-}
-
-bool Reader::readArray(Token& token) {
-  Value init(arrayValue);
-  currentValue().swapPayload(init);
-  currentValue().setOffsetStart(token.start_ - begin_);
-  skipSpaces();
-  if (current_ != end_ && *current_ == ']') // empty array
-  {
-    Token endArray;
-    readToken(endArray);
-    return true;
-  }
-  int index = 0;
-  for (;;) {
-    Value& value = currentValue()[index++];
-    nodes_.push(&value);
-    bool ok = readValue();
-    nodes_.pop();
-    if (!ok) // error already set
-      return recoverFromError(tokenArrayEnd);
-
-    Token currentToken;
-    // Accept Comment after last item in the array.
-    ok = readToken(currentToken);
-    while (currentToken.type_ == tokenComment && ok) {
-      ok = readToken(currentToken);
-    }
-    bool badTokenType = (currentToken.type_ != tokenArraySeparator &&
-                         currentToken.type_ != tokenArrayEnd);
-    if (!ok || badTokenType) {
-      return addErrorAndRecover("Missing ',' or ']' in array declaration",
-                                currentToken, tokenArrayEnd);
-    }
-    if (currentToken.type_ == tokenArrayEnd)
-      break;
-  }
-  return true;
-}
-
-bool Reader::decodeNumber(Token& token) {
-  Value decoded;
-  if (!decodeNumber(token, decoded))
-    return false;
-  currentValue().swapPayload(decoded);
-  currentValue().setOffsetStart(token.start_ - begin_);
-  currentValue().setOffsetLimit(token.end_ - begin_);
-  return true;
-}
-
-bool Reader::decodeNumber(Token& token, Value& decoded) {
-  // Attempts to parse the number as an integer. If the number is
-  // larger than the maximum supported value of an integer then
-  // we decode the number as a double.
-  Location current = token.start_;
-  bool isNegative = *current == '-';
-  if (isNegative)
-    ++current;
-  // TODO: Help the compiler do the div and mod at compile time or get rid of
-  // them.
-  Value::LargestUInt maxIntegerValue =
-      isNegative ? Value::LargestUInt(Value::maxLargestInt) + 1
-                 : Value::maxLargestUInt;
-  Value::LargestUInt threshold = maxIntegerValue / 10;
-  Value::LargestUInt value = 0;
-  while (current < token.end_) {
-    Char c = *current++;
-    if (c < '0' || c > '9')
-      return decodeDouble(token, decoded);
-    auto digit(static_cast<Value::UInt>(c - '0'));
-    if (value >= threshold) {
-      // We've hit or exceeded the max value divided by 10 (rounded down). If
-      // a) we've only just touched the limit, b) this is the last digit, and
-      // c) it's small enough to fit in that rounding delta, we're okay.
-      // Otherwise treat this number as a double to avoid overflow.
-      if (value > threshold || current != token.end_ ||
-          digit > maxIntegerValue % 10) {
-        return decodeDouble(token, decoded);
-      }
-    }
-    value = value * 10 + digit;
-  }
-  if (isNegative && value == maxIntegerValue)
-    decoded = Value::minLargestInt;
-  else if (isNegative)
-    decoded = -Value::LargestInt(value);
-  else if (value <= Value::LargestUInt(Value::maxInt))
-    decoded = Value::LargestInt(value);
-  else
-    decoded = value;
-  return true;
-}
-
-bool Reader::decodeDouble(Token& token) {
-  Value decoded;
-  if (!decodeDouble(token, decoded))
-    return false;
-  currentValue().swapPayload(decoded);
-  currentValue().setOffsetStart(token.start_ - begin_);
-  currentValue().setOffsetLimit(token.end_ - begin_);
-  return true;
-}
-
-bool Reader::decodeDouble(Token& token, Value& decoded) {
-  double value = 0;
-  String buffer(token.start_, token.end_);
-  IStringStream is(buffer);
-  if (!(is >> value))
-    return addError(
-        "'" + String(token.start_, token.end_) + "' is not a number.", token);
-  decoded = value;
-  return true;
-}
-
-bool Reader::decodeString(Token& token) {
-  String decoded_string;
-  if (!decodeString(token, decoded_string))
-    return false;
-  Value decoded(decoded_string);
-  currentValue().swapPayload(decoded);
-  currentValue().setOffsetStart(token.start_ - begin_);
-  currentValue().setOffsetLimit(token.end_ - begin_);
-  return true;
-}
-
-bool Reader::decodeString(Token& token, String& decoded) {
-  decoded.reserve(static_cast<size_t>(token.end_ - token.start_ - 2));
-  Location current = token.start_ + 1; // skip '"'
-  Location end = token.end_ - 1;       // do not include '"'
-  while (current != end) {
-    Char c = *current++;
-    if (c == '"')
-      break;
-    else if (c == '\\') {
-      if (current == end)
-        return addError("Empty escape sequence in string", token, current);
-      Char escape = *current++;
-      switch (escape) {
-      case '"':
-        decoded += '"';
-        break;
-      case '/':
-        decoded += '/';
-        break;
-      case '\\':
-        decoded += '\\';
-        break;
-      case 'b':
-        decoded += '\b';
-        break;
-      case 'f':
-        decoded += '\f';
-        break;
-      case 'n':
-        decoded += '\n';
-        break;
-      case 'r':
-        decoded += '\r';
-        break;
-      case 't':
-        decoded += '\t';
-        break;
-      case 'u': {
-        unsigned int unicode;
-        if (!decodeUnicodeCodePoint(token, current, end, unicode))
-          return false;
-        decoded += codePointToUTF8(unicode);
-      } break;
-      default:
-        return addError("Bad escape sequence in string", token, current);
-      }
-    } else {
-      decoded += c;
-    }
-  }
-  return true;
-}
+// Class Reader
+// //////////////////////////////////////////////////////////////////
 
-bool Reader::decodeUnicodeCodePoint(Token& token, Location& current,
-                                    Location end, unsigned int& unicode) {
+Reader::Reader() : features_(Features::all()) {}
 
-  if (!decodeUnicodeEscapeSequence(token, current, end, unicode))
-    return false;
-  if (unicode >= 0xD800 && unicode <= 0xDBFF) {
-    // surrogate pairs
-    if (end - current < 6)
-      return addError(
-          "additional six characters expected to parse unicode surrogate pair.",
-          token, current);
-    if (*(current++) == '\\' && *(current++) == 'u') {
-      unsigned int surrogatePair;
-      if (decodeUnicodeEscapeSequence(token, current, end, surrogatePair)) {
-        unicode = 0x10000 + ((unicode & 0x3FF) << 10) + (surrogatePair & 0x3FF);
-      } else
-        return false;
-    } else
-      return addError("expecting another \\u token to begin the second half of "
-                      "a unicode surrogate pair",
-                      token, current);
-  }
-  return true;
+Reader::Reader(const Features& features) : features_(features) {}
+
+bool Reader::parse(const std::string& document, Value& root,
+                   bool collectComments) {
+  document_.assign(document.begin(), document.end());
+  const char* begin = document_.c_str();
+  const char* end = begin + document_.length();
+  return parse(begin, end, root, collectComments);
 }
 
-bool Reader::decodeUnicodeEscapeSequence(Token& token, Location& current,
-                                         Location end,
-                                         unsigned int& ret_unicode) {
-  if (end - current < 4)
-    return addError(
-        "Bad unicode escape sequence in string: four digits expected.", token,
-        current);
-  int unicode = 0;
-  for (int index = 0; index < 4; ++index) {
-    Char c = *current++;
-    unicode *= 16;
-    if (c >= '0' && c <= '9')
-      unicode += c - '0';
-    else if (c >= 'a' && c <= 'f')
-      unicode += c - 'a' + 10;
-    else if (c >= 'A' && c <= 'F')
-      unicode += c - 'A' + 10;
-    else
-      return addError(
-          "Bad unicode escape sequence in string: hexadecimal digit expected.",
-          token, current);
-  }
-  ret_unicode = static_cast<unsigned int>(unicode);
-  return true;
+bool Reader::parse(std::istream& is, Value& root, bool collectComments) {
+  // std::istream_iterator<char> begin(is);
+  // std::istream_iterator<char> end;
+  // Those would allow streamed input from a file, if parse() were a
+  // template function.
+
+  // Since String is reference-counted, this at least does not
+  // create an extra copy.
+  String doc;
+  std::getline(is, doc, static_cast<char> EOF);
+  return parse(doc.data(), doc.data() + doc.size(), root, collectComments);
 }
 
 bool Reader::addError(const String& message, Token& token, Location extra) {
@@ -734,33 +114,6 @@ bool Reader::addError(const String& message, Token& token, Location extra) {
   return false;
 }
 
-bool Reader::recoverFromError(TokenType skipUntilToken) {
-  size_t const errorCount = errors_.size();
-  Token skip;
-  for (;;) {
-    if (!readToken(skip))
-      errors_.resize(errorCount); // discard errors caused by recovery
-    if (skip.type_ == skipUntilToken || skip.type_ == tokenEndOfStream)
-      break;
-  }
-  errors_.resize(errorCount);
-  return false;
-}
-
-bool Reader::addErrorAndRecover(const String& message, Token& token,
-                                TokenType skipUntilToken) {
-  addError(message, token);
-  return recoverFromError(skipUntilToken);
-}
-
-Value& Reader::currentValue() { return *(nodes_.top()); }
-
-Reader::Char Reader::getNextChar() {
-  if (current_ == end_)
-    return 0;
-  return *current_++;
-}
-
 void Reader::getLocationLineAndColumn(Location location, int& line,
                                       int& column) const {
   Location current = begin_;
@@ -870,6 +223,16 @@ public:
   bool failIfExtra_;
   bool rejectDupKeys_;
   bool allowSpecialFloats_;
+  bool borrowStrings_;
+  bool lazyNumbers_;
+  bool lazyUnescape_;
+  bool validateUTF8_;
+  // Read numbers as the deprecated Reader did: no leading '+', no value out of
+  // double range, and a '-' before anything but digits is a number.
+  bool legacyNumbers_;
+  // Mark the values read as pristine where they are, and as not moved, for
+  // Document::parseKeepingSource() only: no other reader's text is kept.
+  bool markPristine_;
   size_t stackLimit_;
 }; // OurFeatures
 
@@ -879,7 +242,13 @@ OurFeatures OurFeatures::all() { return {}; }
 // ////////////////////////////////
 
 // Originally copied from the Reader class (now deprecated), used internally
-// for implementing JSON reading.
+// for implementing JSON reading; Reader now parses with it too.
+//
+// Comments and Extensions say whether the features allowing comments, and
+// those allowing other syntax outside RFC 8259 (single quotes, special floats,
+// numeric keys and dropped null placeholders), may be on: when false, these
+// are not tested at all, so strict parsing does not pay for them.
+template <bool Comments, bool Extensions>
 class OurReader {
 public:
   using Char = char;
@@ -893,9 +262,17 @@ public:
   explicit OurReader(OurFeatures const& features);
   bool parse(const char* beginDoc, const char* endDoc, Value& root,
              bool collectComments = true);
+  bool parseInSitu(char* beginDoc, char* endDoc, Value& root,
+                   bool collectComments = true);
   String getFormattedErrorMessages() const;
   std::vector<StructuredError> getStructuredErrors() const;
 
+  /// Calls f(start, limit, message, extra) for each error, in order.
+  template <typename F> void forEachError(F f) const {
+    for (auto const& error : errors_)
+      f(error.token_.start_, error.token_.end_, error.message_, error.extra_);
+  }
+
 private:
   OurReader(OurReader const&);      // no impl
   void operator=(OurReader const&); // no impl
@@ -936,6 +313,8 @@ private:
 
   using Errors = std::deque<ErrorInfo>;
 
+  bool readDocument(Location beginDoc, Location endDoc, Value& root,
+                    bool collectComments);
   bool readToken(Token& token);
   void skipSpaces();
   bool match(const Char* pattern, int patternLength);
@@ -950,8 +329,14 @@ private:
   bool readArray(Token& token);
   bool decodeNumber(Token& token);
   bool decodeNumber(Token& token, Value& decoded);
+  bool decodeNumberText(Token& token, Value& decoded);
   bool decodeString(Token& token);
   bool decodeString(Token& token, String& decoded);
+  bool decodeStringInSitu(Token& token, char const*& decodedEnd);
+  bool canBorrowString(Token const& token) const;
+  bool checkEscapes(Token& token);
+  bool validateUTF8(Token& token);
+  bool unescapeString(Token& token, char* decoded, char*& decodedEnd);
   bool decodeDouble(Token& token);
   bool decodeDouble(Token& token, Value& decoded);
   bool decodeUnicodeCodePoint(Token& token, Location& current, Location end,
@@ -974,6 +359,20 @@ private:
   static String normalizeEOL(Location begin, Location end);
   static bool containsNewLine(Location begin, Location end);
 
+  bool allowComments() const { return Comments && features_.allowComments_; }
+  bool allowDroppedNullPlaceholders() const {
+    return Extensions && features_.allowDroppedNullPlaceholders_;
+  }
+  bool allowNumericKeys() const {
+    return Extensions && features_.allowNumericKeys_;
+  }
+  bool allowSingleQuotes() const {
+    return Extensions && features_.allowSingleQuotes_;
+  }
+  bool allowSpecialFloats() const {
+    return Extensions && features_.allowSpecialFloats_;
+  }
+
   using Nodes = std::stack<Value*>;
 
   Nodes nodes_{};
@@ -989,23 +388,49 @@ private:
 
   OurFeatures const features_;
   bool collectComments_ = false;
+  // Whether [begin_, end_) is writable and strings are decoded in place.
+  bool inSitu_ = false;
+  // Count of the tokens read so far whose value would not be written back as
+  // they read, which keep the values around them from being pristine.
+  size_t nonVerbatimTokens_ = 0;
 }; // OurReader
 
 // complete copy of Read impl, for OurReader
 
-bool OurReader::containsNewLine(OurReader::Location begin,
-                                OurReader::Location end) {
+template <bool Comments, bool Extensions>
+bool OurReader<Comments, Extensions>::containsNewLine(Location begin,
+                                                      Location end) {
   for (; begin < end; ++begin)
     if (*begin == '\n' || *begin == '\r')
       return true;
   return false;
 }
 
-OurReader::OurReader(OurFeatures const& features) : features_(features) {}
+template <bool Comments, bool Extensions>
+OurReader<Comments, Extensions>::OurReader(OurFeatures const& features)
+    : features_(features) {}
+
+template <bool Comments, bool Extensions>
+bool OurReader<Comments, Extensions>::parse(const char* beginDoc,
+                                            const char* endDoc, Value& root,
+                                            bool collectComments) {
+  inSitu_ = false;
+  return readDocument(beginDoc, endDoc, root, collectComments);
+}
+
+template <bool Comments, bool Extensions>
+bool OurReader<Comments, Extensions>::parseInSitu(char* beginDoc, char* endDoc,
+                                                  Value& root,
+                                                  bool collectComments) {
+  inSitu_ = true;
+  return readDocument(beginDoc, endDoc, root, collectComments);
+}
 
-bool OurReader::parse(const char* beginDoc, const char* endDoc, Value& root,
-                      bool collectComments) {
-  if (!features_.allowComments_) {
+template <bool Comments, bool Extensions>
+bool OurReader<Comments, Extensions>::readDocument(Location beginDoc,
+                                                   Location endDoc, Value& root,
+                                                   bool collectComments) {
+  if (!allowComments()) {
     collectComments = false;
   }
 
@@ -1047,10 +472,12 @@ bool OurReader::parse(const char* beginDoc, const char* endDoc, Value& root,
   return successful;
 }
 
-bool OurReader::readValue() {
+template <bool Comments, bool Extensions>
+bool OurReader<Comments, Extensions>::readValue() {
   //  To preserve the old behaviour we cast size_t to int.
   if (nodes_.size() > features_.stackLimit_)
     throwRuntimeError("Exceeded stackLimit in readValue().");
+  size_t const nonVerbatimTokens = nonVerbatimTokens_;
   Token token;
   skipCommentTokens(token);
   bool successful = true;
@@ -1114,7 +541,7 @@ bool OurReader::readValue() {
   case tokenArraySeparator:
   case tokenObjectEnd:
   case tokenArrayEnd:
-    if (features_.allowDroppedNullPlaceholders_) {
+    if (allowDroppedNullPlaceholders()) {
       // "Un-read" the current token and mark the current value as a null
       // token.
       current_--;
@@ -1122,6 +549,7 @@ bool OurReader::readValue() {
       currentValue().swapPayload(v);
       currentValue().setOffsetStart(current_ - begin_ - 1);
       currentValue().setOffsetLimit(current_ - begin_);
+      ++nonVerbatimTokens_;
       break;
     } // else, fall through ...
   default:
@@ -1130,6 +558,12 @@ bool OurReader::readValue() {
     return addError("Syntax error: value, object or array expected.", token);
   }
 
+  if (features_.markPristine_) {
+    currentValue().setIsMoved(false);
+    if (successful && nonVerbatimTokens_ == nonVerbatimTokens)
+      currentValue().setIsPristine(true);
+  }
+
   if (collectComments_) {
     lastValueEnd_ = current_;
     lastValueHasAComment_ = false;
@@ -1139,8 +573,9 @@ bool OurReader::readValue() {
   return successful;
 }
 
-void OurReader::skipCommentTokens(Token& token) {
-  if (features_.allowComments_) {
+template <bool Comments, bool Extensions>
+void OurReader<Comments, Extensions>::skipCommentTokens(Token& token) {
+  if (allowComments()) {
     do {
       readToken(token);
     } while (token.type_ == tokenComment);
@@ -1149,7 +584,8 @@ void OurReader::skipCommentTokens(Token& token) {
   }
 }
 
-bool OurReader::readToken(Token& token) {
+template <bool Comments, bool Extensions>
+bool OurReader<Comments, Extensions>::readToken(Token& token) {
   skipSpaces();
   token.start_ = current_;
   Char c = getNextChar();
@@ -1172,11 +608,13 @@ bool OurReader::readToken(Token& token) {
     ok = readString();
     break;
   case '\'':
-    if (features_.allowSingleQuotes_) {
+    if (allowSingleQuotes()) {
       token.type_ = tokenString;
       ok = readStringSingleQuote();
-      break;
-    } // else fall through
+    } else {
+      ok = false;
+    }
+    break;
   case '/':
     token.type_ = tokenComment;
     ok = readComment();
@@ -1195,19 +633,21 @@ bool OurReader::readToken(Token& token) {
     readNumber(false);
     break;
   case '-':
-    if (readNumber(true)) {
+    if (readNumber(!features_.legacyNumbers_)) {
       token.type_ = tokenNumber;
     } else {
       token.type_ = tokenNegInf;
-      ok = features_.allowSpecialFloats_ && match("nfinity", 7);
+      ok = allowSpecialFloats() && match("nfinity", 7);
     }
     break;
   case '+':
-    if (readNumber(true)) {
+    if (features_.legacyNumbers_) {
+      ok = false;
+    } else if (readNumber(true)) {
       token.type_ = tokenNumber;
     } else {
       token.type_ = tokenPosInf;
-      ok = features_.allowSpecialFloats_ && match("nfinity", 7);
+      ok = allowSpecialFloats() && match("nfinity", 7);
     }
     break;
   case 't':
@@ -1223,7 +663,7 @@ bool OurReader::readToken(Token& token) {
     ok = match("ull", 3);
     break;
   case 'N':
-    if (features_.allowSpecialFloats_) {
+    if (allowSpecialFloats()) {
       token.type_ = tokenNaN;
       ok = match("aN", 2);
     } else {
@@ -1231,7 +671,7 @@ bool OurReader::readToken(Token& token) {
     }
     break;
   case 'I':
-    if (features_.allowSpecialFloats_) {
+    if (allowSpecialFloats()) {
       token.type_ = tokenPosInf;
       ok = match("nfinity", 7);
     } else {
@@ -1253,11 +693,16 @@ bool OurReader::readToken(Token& token) {
   }
   if (!ok)
     token.type_ = tokenError;
+  else if (c == '+' || c == '\'' || token.type_ == tokenComment ||
+           token.type_ == tokenNaN || token.type_ == tokenPosInf ||
+           token.type_ == tokenNegInf)
+    ++nonVerbatimTokens_;
   token.end_ = current_;
   return ok;
 }
 
-void OurReader::skipSpaces() {
+template <bool Comments, bool Extensions>
+void OurReader<Comments, Extensions>::skipSpaces() {
   while (current_ != end_) {
     Char c = *current_;
     if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
@@ -1267,7 +712,9 @@ void OurReader::skipSpaces() {
   }
 }
 
-bool OurReader::match(const Char* pattern, int patternLength) {
+template <bool Comments, bool Extensions>
+bool OurReader<Comments, Extensions>::match(const Char* pattern,
+                                            int patternLength) {
   if (end_ - current_ < patternLength)
     return false;
   int index = patternLength;
@@ -1278,7 +725,8 @@ bool OurReader::match(const Char* pattern, int patternLength) {
   return true;
 }
 
-bool OurReader::readComment() {
+template <bool Comments, bool Extensions>
+bool OurReader<Comments, Extensions>::readComment() {
   const Location commentBegin = current_ - 1;
   const Char c = getNextChar();
   bool successful = false;
@@ -1312,11 +760,12 @@ bool OurReader::readComment() {
   return true;
 }
 
-String OurReader::normalizeEOL(OurReader::Location begin,
-                               OurReader::Location end) {
+template <bool Comments, bool Extensions>
+String OurReader<Comments, Extensions>::normalizeEOL(Location begin,
+                                                     Location end) {
   String normalized;
   normalized.reserve(static_cast<size_t>(end - begin));
-  OurReader::Location current = begin;
+  Location current = begin;
   while (current != end) {
     char c = *current++;
     if (c == '\r') {
@@ -1332,8 +781,9 @@ String OurReader::normalizeEOL(OurReader::Location begin,
   return normalized;
 }
 
-void OurReader::addComment(Location begin, Location end,
-                           CommentPlacement placement) {
+template <bool Comments, bool Extensions>
+void OurReader<Comments, Extensions>::addComment(Location begin, Location end,
+                                                 CommentPlacement placement) {
   assert(collectComments_);
   const String& normalized = normalizeEOL(begin, end);
   if (placement == commentAfterOnSameLine) {
@@ -1344,7 +794,9 @@ void OurReader::addComment(Location begin, Location end,
   }
 }
 
-bool OurReader::readCStyleComment(bool* containsNewLineResult) {
+template <bool Comments, bool Extensions>
+bool OurReader<Comments, Extensions>::readCStyleComment(
+    bool* containsNewLineResult) {
   *containsNewLineResult = false;
 
   while ((current_ + 1) < end_) {
@@ -1359,7 +811,8 @@ bool OurReader::readCStyleComment(bool* containsNewLineResult) {
   return getNextChar() == '/';
 }
 
-bool OurReader::readCppStyleComment() {
+template <bool Comments, bool Extensions>
+bool OurReader<Comments, Extensions>::readCppStyleComment() {
   while (current_ != end_) {
     Char c = getNextChar();
     if (c == '\n')
@@ -1375,7 +828,8 @@ bool OurReader::readCppStyleComment() {
   return true;
 }
 
-bool OurReader::readNumber(bool checkInf) {
+template <bool Comments, bool Extensions>
+bool OurReader<Comments, Extensions>::readNumber(bool checkInf) {
   Location p = current_;
   if (checkInf && p != end_ && *p == 'I') {
     current_ = ++p;
@@ -1401,7 +855,8 @@ bool OurReader::readNumber(bool checkInf) {
   }
   return true;
 }
-bool OurReader::readString() {
+template <bool Comments, bool Extensions>
+bool OurReader<Comments, Extensions>::readString() {
   Char c = 0;
   while (current_ != end_) {
     c = getNextChar();
@@ -1413,7 +868,8 @@ bool OurReader::readString() {
   return c == '"';
 }
 
-bool OurReader::readStringSingleQuote() {
+template <bool Comments, bool Extensions>
+bool OurReader<Comments, Extensions>::readStringSingleQuote() {
   Char c = 0;
   while (current_ != end_) {
     c = getNextChar();
@@ -1425,9 +881,13 @@ bool OurReader::readStringSingleQuote() {
   return c == '\'';
 }
 
-bool OurReader::readObject(Token& token) {
+template <bool Comments, bool Extensions>
+bool OurReader<Comments, Extensions>::readObject(Token& token) {
   Token tokenName;
   String name;
+  // The member name, either within name or, in situ, within the document.
+  char const* nameBegin = nullptr;
+  char const* nameEnd = nullptr;
   Value init(objectValue);
   currentValue().swapPayload(init);
   currentValue().setOffsetStart(token.start_ - begin_);
@@ -1437,24 +897,43 @@ bool OurReader::readObject(Token& token) {
       initialTokenOk = readToken(tokenName);
     if (!initialTokenOk)
       break;
-    if (tokenName.type_ == tokenObjectEnd && name.empty()) // empty object
+    if (tokenName.type_ == tokenObjectEnd &&
+        nameBegin == nameEnd) // empty object
       return true;
     name.clear();
-    if (tokenName.type_ == tokenString) {
+    bool borrowName = false;
+    if (tokenName.type_ == tokenString && features_.validateUTF8_ &&
+        !validateUTF8(tokenName))
+      return recoverFromError(tokenObjectEnd);
+    if (tokenName.type_ == tokenString && inSitu_) {
+      nameBegin = tokenName.start_ + 1;
+      if (!decodeStringInSitu(tokenName, nameEnd))
+        return recoverFromError(tokenObjectEnd);
+      borrowName = true;
+    } else if (tokenName.type_ == tokenString && canBorrowString(tokenName)) {
+      nameBegin = tokenName.start_ + 1;
+      nameEnd = tokenName.end_ - 1;
+      borrowName = true;
+    } else if (tokenName.type_ == tokenString) {
       if (!decodeString(tokenName, name))
         return recoverFromError(tokenObjectEnd);
-    } else if (tokenName.type_ == tokenNumber && features_.allowNumericKeys_) {
+    } else if (tokenName.type_ == tokenNumber && allowNumericKeys()) {
       Value numberName;
       if (!decodeNumber(tokenName, numberName))
         return recoverFromError(tokenObjectEnd);
       name = numberName.asString();
+      ++nonVerbatimTokens_;
     } else {
       break;
     }
-    if (name.length() >= (1U << 30))
+    if (!borrowName) {
+      nameBegin = name.data();
+      nameEnd = nameBegin + name.length();
+    }
+    if (static_cast<size_t>(nameEnd - nameBegin) >= (1U << 30))
       throwRuntimeError("keylength >= 2^30");
-    if (features_.rejectDupKeys_ && currentValue().isMember(name)) {
-      String msg = "Duplicate key: '" + name + "'";
+    if (features_.rejectDupKeys_ && currentValue().find(nameBegin, nameEnd)) {
+      String msg = "Duplicate key: '" + String(nameBegin, nameEnd) + "'";
       return addErrorAndRecover(msg, tokenName, tokenObjectEnd);
     }
 
@@ -1463,7 +942,12 @@ bool OurReader::readObject(Token& token) {
       return addErrorAndRecover("Missing ':' after object member name", colon,
                                 tokenObjectEnd);
     }
-    Value& value = currentValue()[name];
+    ArrayIndex const members = currentValue().size();
+    Value& value = borrowName
+                       ? currentValue()[BorrowedString(nameBegin, nameEnd)]
+                       : *currentValue().demand(nameBegin, nameEnd);
+    if (currentValue().size() == members) // duplicate key
+      ++nonVerbatimTokens_;
     nodes_.push(&value);
     bool ok = readValue();
     nodes_.pop();
@@ -1487,7 +971,8 @@ bool OurReader::readObject(Token& token) {
                             tokenObjectEnd);
 }
 
-bool OurReader::readArray(Token& token) {
+template <bool Comments, bool Extensions>
+bool OurReader<Comments, Extensions>::readArray(Token& token) {
   Value init(arrayValue);
   currentValue().swapPayload(init);
   currentValue().setOffsetStart(token.start_ - begin_);
@@ -1525,9 +1010,11 @@ bool OurReader::readArray(Token& token) {
   return true;
 }
 
-bool OurReader::decodeNumber(Token& token) {
+template <bool Comments, bool Extensions>
+bool OurReader<Comments, Extensions>::decodeNumber(Token& token) {
   Value decoded;
-  if (!decodeNumber(token, decoded))
+  if (features_.lazyNumbers_ ? !decodeNumberText(token, decoded)
+                             : !decodeNumber(token, decoded))
     return false;
   currentValue().swapPayload(decoded);
   currentValue().setOffsetStart(token.start_ - begin_);
@@ -1535,45 +1022,16 @@ bool OurReader::decodeNumber(Token& token) {
   return true;
 }
 
-bool OurReader::decodeNumber(Token& token, Value& decoded) {
+template <bool Comments, bool Extensions>
+bool OurReader<Comments, Extensions>::decodeNumber(Token& token,
+                                                   Value& decoded) {
   // Attempts to parse the number as an integer. If the number is
   // larger than the maximum supported value of an integer then
   // we decode the number as a double.
-  Location current = token.start_;
-  bool isNegative = *current == '-';
-  if (isNegative)
-    ++current;
-
-  static constexpr auto positive_threshold = Value::maxLargestUInt / 10;
-  static constexpr auto positive_last_digit = Value::maxLargestUInt % 10;
-  static constexpr auto negative_threshold =
-      Value::LargestUInt(Value::minLargestInt) / 10;
-  static constexpr auto negative_last_digit =
-      Value::LargestUInt(Value::minLargestInt) % 10;
-
-  const auto threshold = isNegative ? negative_threshold : positive_threshold;
-  const auto last_digit =
-      isNegative ? negative_last_digit : positive_last_digit;
-
-  Value::LargestUInt value = 0;
-  while (current < token.end_) {
-    Char c = *current++;
-    if (c < '0' || c > '9')
-      return decodeDouble(token, decoded);
-
-    const auto digit(static_cast<Value::UInt>(c - '0'));
-    if (value >= threshold) {
-      // We've hit or exceeded the max value divided by 10 (rounded down). If
-      // a) we've only just touched the limit, meaing value == threshold,
-      // b) this is the last digit, or
-      // c) it's small enough to fit in that rounding delta, we're okay.
-      // Otherwise treat this number as a double to avoid overflow.
-      if (value > threshold || current != token.end_ || digit > last_digit) {
-        return decodeDouble(token, decoded);
-      }
-    }
-    value = value * 10 + digit;
-  }
+  bool isNegative;
+  Value::LargestUInt value;
+  if (!decodeIntegerLiteral(token.start_, token.end_, isNegative, value))
+    return decodeDouble(token, decoded);
 
   if (isNegative)
     decoded = -Value::LargestInt(value);
@@ -1585,7 +1043,70 @@ bool OurReader::decodeNumber(Token& token, Value& decoded) {
   return true;
 }
 
-bool OurReader::decodeDouble(Token& token) {
+// Whether [begin, end) follows the strict JSON number grammar, which
+// readNumber() is more lenient about.
+static bool isStrictNumber(char const* begin, char const* end,
+                           bool* isIntegral) {
+  char const* p = begin;
+  if (p != end && *p == '-')
+    ++p;
+  if (p == end || *p < '0' || *p > '9')
+    return false;
+  if (*p++ == '0' && p != end && *p >= '0' && *p <= '9')
+    return false; // leading zero
+  while (p != end && *p >= '0' && *p <= '9')
+    ++p;
+  *isIntegral = p == end;
+  if (p != end && *p == '.') {
+    if (++p == end || *p < '0' || *p > '9')
+      return false;
+    while (p != end && *p >= '0' && *p <= '9')
+      ++p;
+  }
+  if (p != end && (*p == 'e' || *p == 'E')) {
+    if (++p != end && (*p == '+' || *p == '-'))
+      ++p;
+    if (p == end || *p < '0' || *p > '9')
+      return false;
+    while (p != end && *p >= '0' && *p <= '9')
+      ++p;
+  }
+  return p == end;
+}
+
+// Keep the number as its literal, only checking what it would convert to.
+// Literals that are not strict JSON are converted as usual, so that writers
+// never re-emit them. So are integers but "-0": they are written back as they
+// were, and the range check has already decoded them, whereas the literal
+// would be decoded again on every access.
+template <bool Comments, bool Extensions>
+bool OurReader<Comments, Extensions>::decodeNumberText(Token& token,
+                                                       Value& decoded) {
+  bool isIntegral;
+  if (!isStrictNumber(token.start_, token.end_, &isIntegral))
+    return decodeNumber(token, decoded);
+  ValueType type = realValue;
+  bool isNegative;
+  Value::LargestUInt magnitude;
+  if (isIntegral &&
+      decodeIntegerLiteral(token.start_, token.end_, isNegative, magnitude)) {
+    if (!isNegative || magnitude != 0) {
+      if (isNegative)
+        decoded = -Value::LargestInt(magnitude);
+      else if (magnitude <= Value::LargestUInt(Value::maxLargestInt))
+        decoded = Value::LargestInt(magnitude);
+      else
+        decoded = magnitude;
+      return true;
+    }
+    type = intValue;
+  }
+  decoded = Value(type, BorrowedString(token.start_, token.end_));
+  return true;
+}
+
+template <bool Comments, bool Extensions>
+bool OurReader<Comments, Extensions>::decodeDouble(Token& token) {
   Value decoded;
   if (!decodeDouble(token, decoded))
     return false;
@@ -1595,58 +1116,205 @@ bool OurReader::decodeDouble(Token& token) {
   return true;
 }
 
-bool OurReader::decodeDouble(Token& token, Value& decoded) {
-  double value = 0;
-  const int bufferSize = 32;
-  int count;
+template <bool Comments, bool Extensions>
+bool OurReader<Comments, Extensions>::decodeDouble(Token& token,
+                                                   Value& decoded) {
   ptrdiff_t const length = token.end_ - token.start_;
 
   // Sanity check to avoid buffer overflow exploits.
   if (length < 0) {
     return addError("Unable to parse token length", token);
   }
-  auto const ulength = static_cast<size_t>(length);
-
-  // Avoid using a string constant for the format control string given to
-  // sscanf, as this can cause hard to debug crashes on OS X. See here for more
-  // info:
-  //
-  //     http://developer.apple.com/library/mac/#DOCUMENTATION/DeveloperTools/gcc-4.0.1/gcc/Incompatibilities.html
-  char format[] = "%lf";
-
-  if (length <= bufferSize) {
-    Char buffer[bufferSize + 1];
-    memcpy(buffer, token.start_, ulength);
-    buffer[length] = 0;
-    fixNumericLocaleInput(buffer, buffer + length);
-    count = sscanf(buffer, format, &value);
-  } else {
-    String buffer(token.start_, token.end_);
-    count = sscanf(buffer.c_str(), format, &value);
-  }
 
-  if (count != 1)
+  // sscanf() stops before an exponent without digits, as in "1e+", instead of
+  // failing on it.
+  char const last = length ? token.end_[-1] : 'e';
+  bool const partialExponent =
+      last == 'e' || last == 'E' || last == '+' || last == '-';
+  double value = 0;
+  if (partialExponent || !decodeRealLiteral(token.start_, token.end_, value) ||
+      (features_.legacyNumbers_ && std::isinf(value)))
     return addError(
         "'" + String(token.start_, token.end_) + "' is not a number.", token);
   decoded = value;
   return true;
 }
 
-bool OurReader::decodeString(Token& token) {
-  String decoded_string;
-  if (!decodeString(token, decoded_string))
+template <bool Comments, bool Extensions>
+bool OurReader<Comments, Extensions>::decodeString(Token& token) {
+  if (features_.validateUTF8_ && !validateUTF8(token))
     return false;
-  Value decoded(decoded_string);
+  Value decoded;
+  if (inSitu_) {
+    char const* decodedEnd;
+    if (!decodeStringInSitu(token, decodedEnd))
+      return false;
+    decoded = Value(BorrowedString(token.start_ + 1, decodedEnd));
+    decoded.setIsNullTerminated(true);
+  } else if (canBorrowString(token)) {
+    decoded = Value(BorrowedString(token.start_ + 1, token.end_ - 1));
+  } else if (features_.lazyUnescape_ && *token.start_ == '"') {
+    if (!checkEscapes(token))
+      return false;
+    decoded = Value(stringValue, BorrowedString(token.start_, token.end_));
+  } else {
+    String decoded_string;
+    if (!decodeString(token, decoded_string))
+      return false;
+    decoded = Value(decoded_string);
+  }
   currentValue().swapPayload(decoded);
   currentValue().setOffsetStart(token.start_ - begin_);
   currentValue().setOffsetLimit(token.end_ - begin_);
   return true;
 }
 
-bool OurReader::decodeString(Token& token, String& decoded) {
-  decoded.reserve(static_cast<size_t>(token.end_ - token.start_ - 2));
+template <bool Comments, bool Extensions>
+bool OurReader<Comments, Extensions>::decodeString(Token& token,
+                                                   String& decoded) {
+  size_t const offset = decoded.size();
+  decoded.resize(offset + static_cast<size_t>(token.end_ - token.start_ - 2));
+  char* decodedEnd = nullptr;
+  if (!unescapeString(token, &decoded[offset], decodedEnd))
+    return false;
+  decoded.resize(static_cast<size_t>(decodedEnd - decoded.data()));
+  return true;
+}
+
+// Decode the string token over its own bytes, which are writable in situ,
+// and null-terminate the result. The decoded string starts at
+// token.start_ + 1.
+template <bool Comments, bool Extensions>
+bool OurReader<Comments, Extensions>::decodeStringInSitu(
+    Token& token, char const*& decodedEnd) {
+  char* decoded = const_cast<char*>(token.start_ + 1);
+  char* end = nullptr;
+  if (!unescapeString(token, decoded, end))
+    return false;
+  // At worst, this overwrites the closing quote.
+  *end = 0;
+  decodedEnd = end;
+  return true;
+}
+
+// Whether the string token may be referenced as is: borrowStrings is set and
+// it is a double-quoted string without escape sequences.
+template <bool Comments, bool Extensions>
+bool OurReader<Comments, Extensions>::canBorrowString(
+    Token const& token) const {
+  if (!features_.borrowStrings_ || *token.start_ != '"')
+    return false;
+  size_t const length = static_cast<size_t>(token.end_ - token.start_ - 2);
+  return memchr(token.start_ + 1, '\\', length) == nullptr;
+}
+
+// Find the first ill-formed UTF-8 sequence in [current, end), setting
+// invalidEnd past its maximal subpart (the bytes that could start a valid
+// sequence), or return nullptr. ASCII is skipped a word at a time.
+static char const* findInvalidUTF8(char const* current, char const* end,
+                                   char const*& invalidEnd) {
+  using Byte = unsigned char;
+  LargestUInt const highBits = ~LargestUInt(0) / 0xFF * 0x80;
+  for (;;) {
+    while (end - current >= static_cast<ptrdiff_t>(sizeof(LargestUInt))) {
+      LargestUInt word;
+      memcpy(&word, current, sizeof(word));
+      if (word & highBits)
+        break;
+      current += sizeof(word);
+    }
+    while (current != end && static_cast<Byte>(*current) < 0x80)
+      ++current;
+    if (current == end)
+      return nullptr;
+    char const* const start = current;
+    Byte const lead = static_cast<Byte>(*current++);
+    // Number of continuation bytes, and the range of the first one, which
+    // excludes overlong forms, surrogates and codepoints above U+10FFFF.
+    int continuations;
+    Byte low = 0x80;
+    Byte high = 0xBF;
+    if (lead >= 0xC2 && lead <= 0xDF) {
+      continuations = 1;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+      continuations = 2;
+      if (lead == 0xE0)
+        low = 0xA0;
+      else if (lead == 0xED)
+        high = 0x9F;
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+      continuations = 3;
+      if (lead == 0xF0)
+        low = 0x90;
+      else if (lead == 0xF4)
+        high = 0x8F;
+    } else {
+      invalidEnd = current;
+      return start;
+    }
+    for (; continuations != 0; --continuations) {
+      if (current == end || static_cast<Byte>(*current) < low ||
+          static_cast<Byte>(*current) > high) {
+        invalidEnd = current;
+        return start;
+      }
+      ++current;
+      low = 0x80;
+      high = 0xBF;
+    }
+  }
+}
+
+// Check that the content of the string token is well-formed UTF-8, reporting
+// the first ill-formed sequence as the error token.
+template <bool Comments, bool Extensions>
+bool OurReader<Comments, Extensions>::validateUTF8(Token& token) {
+  Location invalidEnd;
+  Location const invalid =
+      findInvalidUTF8(token.start_ + 1, token.end_ - 1, invalidEnd);
+  if (invalid == nullptr)
+    return true;
+  Token invalidToken;
+  invalidToken.type_ = tokenError;
+  invalidToken.start_ = invalid;
+  invalidToken.end_ = invalidEnd;
+  return addError("Invalid UTF-8 sequence in string", invalidToken, invalid);
+}
+
+// Validate the escape sequences of the string token as unescapeString() would,
+// without decoding them.
+template <bool Comments, bool Extensions>
+bool OurReader<Comments, Extensions>::checkEscapes(Token& token) {
+  Location current = token.start_ + 1; // skip '"'
+  Location end = token.end_ - 1;       // do not include '"'
+  for (;;) {
+    current = static_cast<Location>(
+        memchr(current, '\\', static_cast<size_t>(end - current)));
+    if (current == nullptr)
+      return true;
+    if (++current == end)
+      return addError("Empty escape sequence in string", token, current);
+    Char escape = *current++;
+    if (escape == 'u') {
+      unsigned int unicode;
+      if (!decodeUnicodeCodePoint(token, current, end, unicode))
+        return false;
+    } else if (!memchr("\"/\\bfnrt", escape, 8)) {
+      return addError("Bad escape sequence in string", token, current);
+    }
+  }
+}
+
+// Write the unescaped content of the string token to 'decoded', which must
+// have room for the token's length less its quotes. 'decoded' may alias the
+// token itself, as no escape sequence decodes to more bytes than it spans.
+template <bool Comments, bool Extensions>
+bool OurReader<Comments, Extensions>::unescapeString(Token& token,
+                                                     char* decoded,
+                                                     char*& decodedEnd) {
   Location current = token.start_ + 1; // skip '"'
   Location end = token.end_ - 1;       // do not include '"'
+  char* out = decoded;
   while (current != end) {
     Char c = *current++;
     if (c == '"')
@@ -1657,47 +1325,51 @@ bool OurReader::decodeString(Token& token, String& decoded) {
       Char escape = *current++;
       switch (escape) {
       case '"':
-        decoded += '"';
+        *out++ = '"';
         break;
       case '/':
-        decoded += '/';
+        *out++ = '/';
         break;
       case '\\':
-        decoded += '\\';
+        *out++ = '\\';
         break;
       case 'b':
-        decoded += '\b';
+        *out++ = '\b';
         break;
       case 'f':
-        decoded += '\f';
+        *out++ = '\f';
         break;
       case 'n':
-        decoded += '\n';
+        *out++ = '\n';
         break;
       case 'r':
-        decoded += '\r';
+        *out++ = '\r';
         break;
       case 't':
-        decoded += '\t';
+        *out++ = '\t';
         break;
       case 'u': {
         unsigned int unicode;
         if (!decodeUnicodeCodePoint(token, current, end, unicode))
           return false;
-        decoded += codePointToUTF8(unicode);
+        String const utf8 = codePointToUTF8(unicode);
+        memcpy(out, utf8.data(), utf8.size());
+        out += utf8.size();
       } break;
       default:
         return addError("Bad escape sequence in string", token, current);
       }
     } else {
-      decoded += c;
+      *out++ = c;
     }
   }
+  decodedEnd = out;
   return true;
 }
 
-bool OurReader::decodeUnicodeCodePoint(Token& token, Location& current,
-                                       Location end, unsigned int& unicode) {
+template <bool Comments, bool Extensions>
+bool OurReader<Comments, Extensions>::decodeUnicodeCodePoint(
+    Token& token, Location& current, Location end, unsigned int& unicode) {
 
   if (!decodeUnicodeEscapeSequence(token, current, end, unicode))
     return false;
@@ -1710,6 +1382,10 @@ bool OurReader::decodeUnicodeCodePoint(Token& token, Location& current,
     if (*(current++) == '\\' && *(current++) == 'u') {
       unsigned int surrogatePair;
       if (decodeUnicodeEscapeSequence(token, current, end, surrogatePair)) {
+        if (features_.validateUTF8_ &&
+            (surrogatePair < 0xDC00 || surrogatePair > 0xDFFF))
+          return addError("Invalid low surrogate in unicode surrogate pair",
+                          token, current);
         unicode = 0x10000 + ((unicode & 0x3FF) << 10) + (surrogatePair & 0x3FF);
       } else
         return false;
@@ -1717,13 +1393,17 @@ bool OurReader::decodeUnicodeCodePoint(Token& token, Location& current,
       return addError("expecting another \\u token to begin the second half of "
                       "a unicode surrogate pair",
                       token, current);
+  } else if (features_.validateUTF8_ && unicode >= 0xDC00 &&
+             unicode <= 0xDFFF) {
+    // It would decode to ill-formed UTF-8.
+    return addError("Unpaired low surrogate in string", token, current);
   }
   return true;
 }
 
-bool OurReader::decodeUnicodeEscapeSequence(Token& token, Location& current,
-                                            Location end,
-                                            unsigned int& ret_unicode) {
+template <bool Comments, bool Extensions>
+bool OurReader<Comments, Extensions>::decodeUnicodeEscapeSequence(
+    Token& token, Location& current, Location end, unsigned int& ret_unicode) {
   if (end - current < 4)
     return addError(
         "Bad unicode escape sequence in string: four digits expected.", token,
@@ -1747,7 +1427,9 @@ bool OurReader::decodeUnicodeEscapeSequence(Token& token, Location& current,
   return true;
 }
 
-bool OurReader::addError(const String& message, Token& token, Location extra) {
+template <bool Comments, bool Extensions>
+bool OurReader<Comments, Extensions>::addError(const String& message,
+                                               Token& token, Location extra) {
   ErrorInfo info;
   info.token_ = token;
   info.message_ = message;
@@ -1756,7 +1438,9 @@ bool OurReader::addError(const String& message, Token& token, Location extra) {
   return false;
 }
 
-bool OurReader::recoverFromError(TokenType skipUntilToken) {
+template <bool Comments, bool Extensions>
+bool OurReader<Comments, Extensions>::recoverFromError(
+    TokenType skipUntilToken) {
   size_t errorCount = errors_.size();
   Token skip;
   for (;;) {
@@ -1769,22 +1453,29 @@ bool OurReader::recoverFromError(TokenType skipUntilToken) {
   return false;
 }
 
-bool OurReader::addErrorAndRecover(const String& message, Token& token,
-                                   TokenType skipUntilToken) {
+template <bool Comments, bool Extensions>
+bool OurReader<Comments, Extensions>::addErrorAndRecover(
+    const String& message, Token& token, TokenType skipUntilToken) {
   addError(message, token);
   return recoverFromError(skipUntilToken);
 }
 
-Value& OurReader::currentValue() { return *(nodes_.top()); }
+template <bool Comments, bool Extensions>
+Value& OurReader<Comments, Extensions>::currentValue() {
+  return *(nodes_.top());
+}
 
-OurReader::Char OurReader::getNextChar() {
+template <bool Comments, bool Extensions>
+typename OurReader<Comments, Extensions>::Char
+OurReader<Comments, Extensions>::getNextChar() {
   if (current_ == end_)
     return 0;
   return *current_++;
 }
 
-void OurReader::getLocationLineAndColumn(Location location, int& line,
-                                         int& column) const {
+template <bool Comments, bool Extensions>
+void OurReader<Comments, Extensions>::getLocationLineAndColumn(
+    Location location, int& line, int& column) const {
   Location current = begin_;
   Location lastLineStart = current;
   line = 0;
@@ -1805,7 +1496,9 @@ void OurReader::getLocationLineAndColumn(Location location, int& line,
   ++line;
 }
 
-String OurReader::getLocationLineAndColumn(Location location) const {
+template <bool Comments, bool Extensions>
+String OurReader<Comments, Extensions>::getLocationLineAndColumn(
+    Location location) const {
   int line, column;
   getLocationLineAndColumn(location, line, column);
   char buffer[18 + 16 + 16 + 1];
@@ -1813,7 +1506,8 @@ String OurReader::getLocationLineAndColumn(Location location) const {
   return buffer;
 }
 
-String OurReader::getFormattedErrorMessages() const {
+template <bool Comments, bool Extensions>
+String OurReader<Comments, Extensions>::getFormattedErrorMessages() const {
   String formattedMessage;
   for (const auto& error : errors_) {
     formattedMessage +=
@@ -1826,10 +1520,12 @@ String OurReader::getFormattedErrorMessages() const {
   return formattedMessage;
 }
 
-std::vector<OurReader::StructuredError> OurReader::getStructuredErrors() const {
-  std::vector<OurReader::StructuredError> allErrors;
+template <bool Comments, bool Extensions>
+std::vector<typename OurReader<Comments, Extensions>::StructuredError>
+OurReader<Comments, Extensions>::getStructuredErrors() const {
+  std::vector<StructuredError> allErrors;
   for (const auto& error : errors_) {
-    OurReader::StructuredError structured;
+    StructuredError structured;
     structured.offset_start = error.token_.start_ - begin_;
     structured.offset_limit = error.token_.end_ - begin_;
     structured.message = error.message_;
@@ -1838,9 +1534,10 @@ std::vector<OurReader::StructuredError> OurReader::getStructuredErrors() const {
   return allErrors;
 }
 
+template <bool Comments, bool Extensions>
 class OurCharReader : public CharReader {
   bool const collectComments_;
-  OurReader reader_;
+  OurReader<Comments, Extensions> reader_;
 
 public:
   OurCharReader(bool collectComments, OurFeatures const& features)
@@ -1853,27 +1550,130 @@ public:
     }
     return ok;
   }
+  bool parseInSitu(char* beginDoc, char* endDoc, Value* root,
+                   String* errs) override {
+    bool ok = reader_.parseInSitu(beginDoc, endDoc, *root, collectComments_);
+    if (errs) {
+      *errs = reader_.getFormattedErrorMessages();
+    }
+    return ok;
+  }
+  std::vector<StructuredError> getStructuredErrors() const override {
+    std::vector<StructuredError> errors;
+    for (auto const& error : reader_.getStructuredErrors())
+      errors.push_back({error.offset_start, error.offset_limit, error.message});
+    return errors;
+  }
 };
 
-CharReaderBuilder::CharReaderBuilder() { setDefaults(&settings_); }
-CharReaderBuilder::~CharReaderBuilder() = default;
-CharReader* CharReaderBuilder::newCharReader() const {
-  bool collectComments = settings_["collectComments"].asBool();
+// Calls visitor.run<Comments, Extensions>() for the OurReader specialization
+// that can parse with the given features.
+template <typename Visitor>
+static auto withOurReaderFor(OurFeatures const& features, Visitor visitor)
+    -> decltype(visitor.template run<false, false>()) {
+  bool const extensions =
+      features.allowDroppedNullPlaceholders_ || features.allowNumericKeys_ ||
+      features.allowSingleQuotes_ || features.allowSpecialFloats_;
+  if (features.allowComments_)
+    return extensions ? visitor.template run<true, true>()
+                      : visitor.template run<true, false>();
+  return extensions ? visitor.template run<false, true>()
+                    : visitor.template run<false, false>();
+}
+
+// Parses with the OurReader specialization it is run with, passing each error
+// to onError.
+template <typename OnError> struct ParseWithOurReader {
+  OurFeatures const& features;
+  char const* beginDoc;
+  char const* endDoc;
+  Value& root;
+  bool collectComments;
+  OnError onError;
+  template <bool Comments, bool Extensions> bool run() const {
+    OurReader<Comments, Extensions> reader(features);
+    bool ok = reader.parse(beginDoc, endDoc, root, collectComments);
+    reader.forEachError(onError);
+    return ok;
+  }
+};
+
+bool Reader::parse(const char* beginDoc, const char* endDoc, Value& root,
+                   bool collectComments) {
+  OurFeatures features = OurFeatures::all();
+  features.allowComments_ = features_.allowComments_;
+  features.strictRoot_ = features_.strictRoot_;
+  features.allowDroppedNullPlaceholders_ =
+      features_.allowDroppedNullPlaceholders_;
+  features.allowNumericKeys_ = features_.allowNumericKeys_;
+  features.legacyNumbers_ = true;
+  features.stackLimit_ = stackLimit_g;
+
+  auto onError = [this](Location start, Location end, String const& message,
+                         Location extra) {
+    Token token;
+    token.type_ = tokenError;
+    token.start_ = start;
+    token.end_ = end;
+    addError(message, token, extra);
+  };
+  begin_ = beginDoc;
+  end_ = endDoc;
+  errors_.clear();
+  ParseWithOurReader<decltype(onError)> const parseDocument{
+      features, beginDoc, endDoc, root, collectComments, onError};
+  return withOurReaderFor(features, parseDocument);
+}
+
+bool CharReader::parseInSitu(char* beginDoc, char* endDoc, Value* root,
+                             String* errs) {
+  return parse(beginDoc, endDoc, root, errs);
+}
+
+std::vector<CharReader::StructuredError>
+CharReader::getStructuredErrors() const {
+  return {};
+}
+
+// Creates the OurCharReader specialization it is run with.
+struct NewOurCharReader {
+  bool collectComments;
+  OurFeatures const& features;
+  template <bool Comments, bool Extensions> CharReader* run() const {
+    return new OurCharReader<Comments, Extensions>(collectComments, features);
+  }
+};
+
+// The features the settings of a CharReaderBuilder select.
+static OurFeatures ourFeaturesOf(Value const& settings) {
   OurFeatures features = OurFeatures::all();
-  features.allowComments_ = settings_["allowComments"].asBool();
-  features.strictRoot_ = settings_["strictRoot"].asBool();
+  features.allowComments_ = settings["allowComments"].asBool();
+  features.strictRoot_ = settings["strictRoot"].asBool();
   features.allowDroppedNullPlaceholders_ =
-      settings_["allowDroppedNullPlaceholders"].asBool();
-  features.allowNumericKeys_ = settings_["allowNumericKeys"].asBool();
-  features.allowSingleQuotes_ = settings_["allowSingleQuotes"].asBool();
+      settings["allowDroppedNullPlaceholders"].asBool();
+  features.allowNumericKeys_ = settings["allowNumericKeys"].asBool();
+  features.allowSingleQuotes_ = settings["allowSingleQuotes"].asBool();
 
   // Stack limit is always a size_t, so we get this as an unsigned int
   // regardless of it we have 64-bit integer support enabled.
-  features.stackLimit_ = static_cast<size_t>(settings_["stackLimit"].asUInt());
-  features.failIfExtra_ = settings_["failIfExtra"].asBool();
-  features.rejectDupKeys_ = settings_["rejectDupKeys"].asBool();
-  features.allowSpecialFloats_ = settings_["allowSpecialFloats"].asBool();
-  return new OurCharReader(collectComments, features);
+  features.stackLimit_ = static_cast<size_t>(settings["stackLimit"].asUInt());
+  features.failIfExtra_ = settings["failIfExtra"].asBool();
+  features.rejectDupKeys_ = settings["rejectDupKeys"].asBool();
+  features.allowSpecialFloats_ = settings["allowSpecialFloats"].asBool();
+  features.borrowStrings_ = settings["borrowStrings"].asBool();
+  features.lazyNumbers_ = settings["lazyNumbers"].asBool();
+  features.lazyUnescape_ = settings["lazyUnescape"].asBool();
+  features.validateUTF8_ = settings["validateUTF8"].asBool();
+  return features;
+}
+
+CharReaderBuilder::CharReaderBuilder() { setDefaults(&settings_); }
+CharReaderBuilder::~CharReaderBuilder() = default;
+CharReader* CharReaderBuilder::newCharReader() const {
+  bool collectComments = settings_["collectComments"].asBool();
+  OurFeatures const features = ourFeaturesOf(settings_);
+  return withOurReaderFor(features,
+                          NewOurCharReader{collectComments, features});
 }
 static void getValidReaderKeys(std::set<String>* valid_keys) {
   valid_keys->clear();
@@ -1887,6 +1687,10 @@ static void getValidReaderKeys(std::set<String>* valid_keys) {
   valid_keys->insert("failIfExtra");
   valid_keys->insert("rejectDupKeys");
   valid_keys->insert("allowSpecialFloats");
+  valid_keys->insert("borrowStrings");
+  valid_keys->insert("lazyNumbers");
+  valid_keys->insert("lazyUnescape");
+  valid_keys->insert("validateUTF8");
 }
 bool CharReaderBuilder::validate(Json::Value* invalid) const {
   Json::Value my_invalid;
@@ -1935,6 +1739,10 @@ void CharReaderBuilder::setDefaults(Json::Value* settings) {
   (*settings)["failIfExtra"] = false;
   (*settings)["rejectDupKeys"] = false;
   (*settings)["allowSpecialFloats"] = false;
+  (*settings)["borrowStrings"] = false;
+  (*settings)["lazyNumbers"] = false;
+  (*settings)["lazyUnescape"] = false;
+  (*settings)["validateUTF8"] = false;
   //! [CharReaderBuilderDefaults]
 }
 
@@ -1949,10 +1757,77 @@ bool parseFromStream(CharReader::Factory const& fact, IStream& sin, Value* root,
   char const* begin = doc.data();
   char const* end = begin + doc.size();
   // Note that we do not actually need a null-terminator.
-  CharReaderPtr const reader(fact.newCharReader());
+  CharReaderPtr reader(fact.newCharReader());
+  // doc does not outlive this call, so nothing may be borrowed from it.
+  auto const* builder = dynamic_cast<CharReaderBuilder const*>(&fact);
+  if (builder) {
+    Value const& settings = builder->settings_;
+    if (settings["borrowStrings"].asBool() ||
+        settings["lazyNumbers"].asBool() || settings["lazyUnescape"].asBool()) {
+      CharReaderBuilder owning(*builder);
+      owning["borrowStrings"] = false;
+      owning["lazyNumbers"] = false;
+      owning["lazyUnescape"] = false;
+      reader.reset(owning.newCharReader());
+    }
+  }
   return reader->parse(begin, end, root, errs);
 }
 
+Document::Document() = default;
+
+// root_ moves along with text_, so its pristine values still match it.
+Document::Document(Document&& other)
+    : text_(std::move(other.text_)), sourceKept_(other.sourceKept_) {
+  other.sourceKept_ = false;
+  root_.swapKeepingPristine(other.root_);
+}
+
+Document& Document::operator=(Document&& other) {
+  // Release the values referencing the previous text before replacing it.
+  root_ = Value();
+  text_ = std::move(other.text_);
+  sourceKept_ = other.sourceKept_;
+  other.sourceKept_ = false;
+  root_.swapKeepingPristine(other.root_);
+  return *this;
+}
+
+bool Document::parse(CharReader::Factory const& factory, String text,
+                     String* errs) {
+  // Release the values referencing the previous text before replacing it.
+  root_ = Value();
+  text_.reset(new String(std::move(text)));
+  char* begin = &(*text_)[0];
+  char* end = begin + text_->size();
+  CharReaderPtr const reader(factory.newCharReader());
+  sourceKept_ = false;
+  return reader->parseInSitu(begin, end, &root_, errs);
+}
+
+bool Document::parseKeepingSource(CharReader::Factory const& factory,
+                                  String text, String* errs) {
+  root_ = Value();
+  text_.reset(new String(std::move(text)));
+  char const* begin = text_->data();
+  char const* end = begin + text_->size();
+  CharReaderPtr reader;
+  // Only a reader of our own marks values pristine, so that none parsed from
+  // another text can be.
+  auto const* builder = dynamic_cast<CharReaderBuilder const*>(&factory);
+  if (builder) {
+    OurFeatures features = ourFeaturesOf(builder->settings_);
+    features.markPristine_ = true;
+    bool const collectComments = builder->settings_["collectComments"].asBool();
+    reader.reset(withOurReaderFor(features,
+                                  NewOurCharReader{collectComments, features}));
+  } else {
+    reader.reset(factory.newCharReader());
+  }
+  sourceKept_ = true;
+  return reader->parse(begin, end, &root_, errs);
+}
+
 IStream& operator>>(IStream& sin, Value& root) {
   CharReaderBuilder b;
   String errs;
@@ -19,6 +19,9 @@
 #include <clocale>
 #endif
 
+#include <cstdio>
+#include <cstring>
+
 /* This header provides common string manipulation support, such as UTF-8,
  * portable conversion from/to string...
  *
@@ -73,6 +76,23 @@ enum {
 // Defines a char buffer for use with uintToString().
 typedef char UIntToStringBuffer[uintToStringBufferSize];
 
+/// Value of the hexadecimal digit c, which must be one.
+static inline unsigned int hexDigitValue(char c) {
+  if (c >= 'a')
+    return static_cast<unsigned int>(c - 'a' + 10);
+  if (c >= 'A')
+    return static_cast<unsigned int>(c - 'A' + 10);
+  return static_cast<unsigned int>(c - '0');
+}
+
+/// "00" to "99", for converting integers two digits at a time.
+static const char digitPairs[] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
 /** Converts an unsigned integer to string.
  * @param value Unsigned integer to convert to string
  * @param current Input/Output string buffer.
@@ -80,10 +100,33 @@ typedef char UIntToStringBuffer[uintToStringBufferSize];
  */
 static inline void uintToString(LargestUInt value, char*& current) {
   *--current = 0;
-  do {
-    *--current = static_cast<char>(value % 10U + static_cast<unsigned>('0'));
-    value /= 10;
-  } while (value != 0);
+  while (value >= 100) {
+    auto const pair = static_cast<unsigned>(value % 100U) * 2;
+    value /= 100;
+    current -= 2;
+    current[0] = digitPairs[pair];
+    current[1] = digitPairs[pair + 1];
+  }
+  if (value >= 10) {
+    auto const pair = static_cast<unsigned>(value) * 2;
+    current -= 2;
+    current[0] = digitPairs[pair];
+    current[1] = digitPairs[pair + 1];
+  } else {
+    *--current = static_cast<char>(value + static_cast<unsigned>('0'));
+  }
+}
+
+/** Converts a signed integer to string, like uintToString().
+ */
+static inline void intToString(LargestInt value, char*& current) {
+  if (value < 0) {
+    // Negate as unsigned, which also handles the minimum value.
+    uintToString(LargestUInt(0) - LargestUInt(value), current);
+    *--current = '-';
+  } else {
+    uintToString(LargestUInt(value), current);
+  }
 }
 
 /** Change ',' to '.' everywhere in buffer.
@@ -115,20 +158,142 @@ template <typename Iter> void fixNumericLocaleInput(Iter begin, Iter end) {
 /**
  * Return iterator that would be the new end of the range [begin,end), if we
  * were to delete zeros in the end of string, but not the last zero before '.'.
+ * Without a '.', as "%.0f" prints, the zeros are the integer's and are kept.
  */
 template <typename Iter> Iter fixZerosInTheEnd(Iter begin, Iter end) {
-  for (; begin != end; --end) {
+  Iter point = begin;
+  while (point != end && *point != '.')
+    ++point;
+  if (point == end)
+    return end;
+  for (; end - point > 2; --end) {
     if (*(end - 1) != '0') {
       return end;
     }
-    // Don't delete the last zero before the decimal point.
-    if (begin != (end - 1) && *(end - 2) == '.') {
-      return end;
-    }
   }
   return end;
 }
 
+/** Decodes the escape sequences of [begin, end), the content of a JSON string
+ * whose escapes are known to be valid.
+ * @param out Where to write the decoded string. It may be \c begin, as no
+ *        escape sequence decodes to more bytes than it spans.
+ * @return The end of the decoded string.
+ */
+static inline char* unescapeStringLiteral(char const* begin, char const* end,
+                                          char* out) {
+  while (begin != end) {
+    char c = *begin++;
+    if (c != '\\') {
+      *out++ = c;
+      continue;
+    }
+    switch (*begin++) {
+    case 'b':
+      *out++ = '\b';
+      break;
+    case 'f':
+      *out++ = '\f';
+      break;
+    case 'n':
+      *out++ = '\n';
+      break;
+    case 'r':
+      *out++ = '\r';
+      break;
+    case 't':
+      *out++ = '\t';
+      break;
+    case 'u': {
+      unsigned int unicode = 0;
+      for (int index = 0; index < 4; ++index)
+        unicode = unicode * 16 + hexDigitValue(*begin++);
+      if (unicode >= 0xD800 && unicode <= 0xDBFF) {
+        // surrogate pairs, skipping the backslash and 'u' of the second half
+        begin += 2;
+        unsigned int surrogatePair = 0;
+        for (int index = 0; index < 4; ++index)
+          surrogatePair = surrogatePair * 16 + hexDigitValue(*begin++);
+        unicode = 0x10000 + ((unicode & 0x3FF) << 10) + (surrogatePair & 0x3FF);
+      }
+      String const utf8 = codePointToUTF8(unicode);
+      memcpy(out, utf8.data(), utf8.size());
+      out += utf8.size();
+    } break;
+    default: // '"', '/' or '\\'
+      *out++ = begin[-1];
+      break;
+    }
+  }
+  return out;
+}
+
+/** Converts the integer literal [begin, end), an optional '-' then digits.
+ * @param isNegative Set if the literal starts with '-'.
+ * @param magnitude Absolute value of the literal.
+ * @return false if it is not such a literal, or if it does not fit in a
+ *         LargestInt (when negative) or in a LargestUInt.
+ */
+static inline bool decodeIntegerLiteral(char const* begin, char const* end,
+                                        bool& isNegative,
+                                        LargestUInt& magnitude) {
+  isNegative = begin != end && *begin == '-';
+  if (isNegative)
+    ++begin;
+  static constexpr LargestUInt positive_limit = LargestUInt(-1);
+  static constexpr LargestUInt negative_limit = LargestUInt(-1) / 2 + 1;
+  const LargestUInt limit = isNegative ? negative_limit : positive_limit;
+  const LargestUInt threshold = limit / 10;
+  const LargestUInt last_digit = limit % 10;
+
+  LargestUInt value = 0;
+  while (begin < end) {
+    char c = *begin++;
+    if (c < '0' || c > '9')
+      return false;
+    const auto digit = static_cast<LargestUInt>(c - '0');
+    if (value >= threshold) {
+      // We've hit or exceeded the limit divided by 10 (rounded down). If
+      // a) we've only just touched the limit, meaning value == threshold,
+      // b) this is the last digit, or
+      // c) it's small enough to fit in that rounding delta, we're okay.
+      if (value > threshold || begin != end || digit > last_digit)
+        return false;
+    }
+    value = value * 10 + digit;
+  }
+  magnitude = value;
+  return true;
+}
+
+/** Converts the floating-point literal [begin, end), whatever the locale.
+ * @return false if it is not a number.
+ */
+static inline bool decodeRealLiteral(char const* begin, char const* end,
+                                     double& value) {
+  // Avoid using a string constant for the format control string given to
+  // sscanf, as this can cause hard to debug crashes on OS X. See here for more
+  // info:
+  //
+  //     http://developer.apple.com/library/mac/#DOCUMENTATION/DeveloperTools/gcc-4.0.1/gcc/Incompatibilities.html
+  char format[] = "%lf";
+  const size_t bufferSize = 32;
+  const auto length = static_cast<size_t>(end - begin);
+  int count;
+  if (length <= bufferSize) {
+    char buffer[bufferSize + 1];
+    memcpy(buffer, begin, length);
+    buffer[length] = 0;
+    fixNumericLocaleInput(buffer, buffer + length);
+    count = sscanf(buffer, format, &value);
+  } else {
+    String buffer(begin, end);
+    fixNumericLocaleInput(buffer.begin(), buffer.end());
+    count = sscanf(buffer.c_str(), format, &value);
+  }
+  return count == 1;
+}
+
 } // namespace Json
 
 #endif // LIB_JSONCPP_JSON_TOOL_H_INCLUDED
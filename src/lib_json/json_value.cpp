@@ -7,10 +7,15 @@
 #include <json/assertions.h>
 #include <json/value.h>
 #include <json/writer.h>
+
+#include "json_tool.h"
 #endif // if !defined(JSON_IS_AMALGAMATION)
+#include <atomic>
 #include <cassert>
 #include <cmath>
 #include <cstring>
+#include <iterator>
+#include <new>
 #include <sstream>
 #include <utility>
 #ifdef JSON_USE_CPPTL
@@ -185,6 +190,49 @@ static inline void releasePrefixedStringValue(char* value) { free(value); }
 static inline void releaseStringValue(char* value, unsigned) { free(value); }
 #endif // JSONCPP_USING_SECURE_MEMORY
 
+/* The payload of a string kept escaped: its escaped content, either borrowed
+ * or owned right after this header, and, once an accessor has needed it, its
+ * decoded content, as duplicateAndPrefixStringValue() allocates it. Decoding
+ * it only modifies this header, and atomically, so a const Value holding it
+ * can still be read from several threads.
+ */
+struct EscapedString {
+  EscapedString(char const* escapedContent, unsigned escapedLength)
+      : content(escapedContent), length(escapedLength), decoded(nullptr) {}
+  char const* content;
+  unsigned length;
+  std::atomic<char*> decoded;
+};
+
+static inline char* newEscapedString(char const* content, unsigned length,
+                                     bool owned) {
+  size_t const size = sizeof(EscapedString) + (owned ? length : 0U);
+  void* header = malloc(size);
+  if (header == nullptr) {
+    throwRuntimeError("in Json::Value::newEscapedString(): "
+                      "Failed to allocate string value buffer");
+  }
+  char* const payload = static_cast<char*>(header);
+  if (owned) {
+    memcpy(payload + sizeof(EscapedString), content, length);
+    content = payload + sizeof(EscapedString);
+  }
+  new (header) EscapedString(content, length);
+  return payload;
+}
+static inline void releaseEscapedString(char* payload) {
+  auto* const escaped = reinterpret_cast<EscapedString*>(payload);
+  char* const decoded = escaped->decoded.load(std::memory_order_acquire);
+  if (decoded)
+    releasePrefixedStringValue(decoded);
+#if JSONCPP_USING_SECURE_MEMORY
+  if (escaped->content == payload + sizeof(EscapedString))
+    memset(payload + sizeof(EscapedString), 0, escaped->length);
+#endif
+  escaped->~EscapedString();
+  free(payload);
+}
+
 } // namespace Json
 
 // //////////////////////////////////////////////////////////////////
@@ -419,6 +467,46 @@ Value::Value(const StaticString& value) {
   value_.string_ = const_cast<char*>(value.c_str());
 }
 
+Value::Value(const BorrowedString& value) {
+  initBasic(stringValue);
+  setIsBorrowed(true);
+  value_.string_ = const_cast<char*>(value.data());
+  bits_.length_ = static_cast<unsigned>(value.length());
+}
+
+Value::Value(ValueType type, const BorrowedString& literal) {
+  JSON_ASSERT_MESSAGE(type == intValue || type == uintValue ||
+                          type == realValue || type == stringValue,
+                      "in Json::Value::Value(type, literal): requires a "
+                      "numeric or string type");
+  if (type == stringValue) {
+    JSON_ASSERT_MESSAGE(literal.length() >= 2,
+                        "in Json::Value::Value(type, literal): requires a "
+                        "quoted string");
+    // Keep the content only.
+    initBasic(type, true);
+    value_.string_ = newEscapedString(
+        literal.data() + 1, static_cast<unsigned>(literal.length() - 2), false);
+    setIsEscaped(true);
+  } else {
+    initBasic(type);
+    setIsBorrowed(true);
+    value_.string_ = const_cast<char*>(literal.data());
+    bits_.length_ = static_cast<unsigned>(literal.length());
+    setHasNumberText(true);
+  }
+}
+
+Value Value::raw(const char* begin, const char* end) {
+  Value fragment(begin, end);
+  fragment.setIsRaw(true);
+  return fragment;
+}
+
+Value Value::raw(const String& json) {
+  return raw(json.data(), json.data() + json.length());
+}
+
 #ifdef JSON_USE_CPPTL
 Value::Value(const CppTL::ConstString& value) {
   initBasic(stringValue, true);
@@ -460,6 +548,22 @@ Value& Value::operator=(Value&& other) {
 void Value::swapPayload(Value& other) {
   std::swap(bits_, other.bits_);
   std::swap(value_, other.value_);
+  // Neither payload matches the other's source offsets any more, and either
+  // subtree may now sit in a Document parsed from another text. Marking them
+  // moved tells Document::write() so without visiting the values under them.
+  setIsPristine(false);
+  setIsMoved(true);
+  other.setIsPristine(false);
+  other.setIsMoved(true);
+}
+
+// Only for a Document moving its root, which stays with its text.
+void Value::swapKeepingPristine(Value& other) {
+  std::swap(bits_, other.bits_);
+  std::swap(value_, other.value_);
+  std::swap(comments_, other.comments_);
+  std::swap(start_, other.start_);
+  std::swap(limit_, other.limit_);
 }
 
 void Value::copyPayload(const Value& other) {
@@ -495,6 +599,8 @@ bool Value::operator<(const Value& other) const {
   int typeDelta = type() - other.type();
   if (typeDelta)
     return typeDelta < 0;
+  if (hasNumberText() || other.hasNumberText())
+    return decodedNumber() < other.decodedNumber();
   switch (type()) {
   case nullValue:
     return false;
@@ -514,10 +620,8 @@ bool Value::operator<(const Value& other) const {
     unsigned other_len;
     char const* this_str;
     char const* other_str;
-    decodePrefixedString(this->isAllocated(), this->value_.string_, &this_len,
-                         &this_str);
-    decodePrefixedString(other.isAllocated(), other.value_.string_, &other_len,
-                         &other_str);
+    decodeString(&this_len, &this_str);
+    other.decodeString(&other_len, &other_str);
     unsigned min_len = std::min<unsigned>(this_len, other_len);
     JSON_ASSERT(this_str && other_str);
     int comp = memcmp(this_str, other_str, min_len);
@@ -549,6 +653,8 @@ bool Value::operator>(const Value& other) const { return other < *this; }
 bool Value::operator==(const Value& other) const {
   if (type() != other.type())
     return false;
+  if (hasNumberText() || other.hasNumberText())
+    return decodedNumber() == other.decodedNumber();
   switch (type()) {
   case nullValue:
     return true;
@@ -568,10 +674,8 @@ bool Value::operator==(const Value& other) const {
     unsigned other_len;
     char const* this_str;
     char const* other_str;
-    decodePrefixedString(this->isAllocated(), this->value_.string_, &this_len,
-                         &this_str);
-    decodePrefixedString(other.isAllocated(), other.value_.string_, &other_len,
-                         &other_str);
+    decodeString(&this_len, &this_str);
+    other.decodeString(&other_len, &other_str);
     if (this_len != other_len)
       return false;
     JSON_ASSERT(this_str && other_str);
@@ -595,10 +699,12 @@ const char* Value::asCString() const {
                       "in Json::Value::asCString(): requires stringValue");
   if (value_.string_ == nullptr)
     return nullptr;
+  JSON_ASSERT_MESSAGE(!isBorrowed() || isNullTerminated(),
+                      "in Json::Value::asCString(): requires a "
+                      "null-terminated string, not a borrowed one");
   unsigned this_len;
   char const* this_str;
-  decodePrefixedString(this->isAllocated(), this->value_.string_, &this_len,
-                       &this_str);
+  decodeString(&this_len, &this_str);
   return this_str;
 }
 
@@ -610,8 +716,7 @@ unsigned Value::getCStringLength() const {
     return 0;
   unsigned this_len;
   char const* this_str;
-  decodePrefixedString(this->isAllocated(), this->value_.string_, &this_len,
-                       &this_str);
+  decodeString(&this_len, &this_str);
   return this_len;
 }
 #endif
@@ -622,13 +727,41 @@ bool Value::getString(char const** begin, char const** end) const {
   if (value_.string_ == nullptr)
     return false;
   unsigned length;
-  decodePrefixedString(this->isAllocated(), this->value_.string_, &length,
-                       begin);
+  decodeString(&length, begin);
+  *end = *begin + length;
+  return true;
+}
+
+bool Value::getNumberText(char const** begin, char const** end) const {
+  if (!hasNumberText())
+    return false;
+  unsigned length;
+  decodeStringPayload(&length, begin);
+  *end = *begin + length;
+  return true;
+}
+
+bool Value::getRawText(char const** begin, char const** end) const {
+  if (!isRaw())
+    return false;
+  unsigned length;
+  decodeStringPayload(&length, begin);
+  *end = *begin + length;
+  return true;
+}
+
+bool Value::getEscapedString(char const** begin, char const** end) const {
+  if (!isEscaped())
+    return false;
+  unsigned length;
+  decodeStringPayload(&length, begin);
   *end = *begin + length;
   return true;
 }
 
 String Value::asString() const {
+  if (hasNumberText())
+    return decodedNumber().asString();
   switch (type()) {
   case nullValue:
     return "";
@@ -637,8 +770,7 @@ String Value::asString() const {
       return "";
     unsigned this_len;
     char const* this_str;
-    decodePrefixedString(this->isAllocated(), this->value_.string_, &this_len,
-                         &this_str);
+    decodeString(&this_len, &this_str);
     return String(this_str, this_len);
   }
   case booleanValue:
@@ -658,12 +790,14 @@ String Value::asString() const {
 CppTL::ConstString Value::asConstString() const {
   unsigned len;
   char const* str;
-  decodePrefixedString(isAllocated(), value_.string_, &len, &str);
+  decodeString(&len, &str);
   return CppTL::ConstString(str, len);
 }
 #endif
 
 Value::Int Value::asInt() const {
+  if (hasNumberText())
+    return decodedNumber().asInt();
   switch (type()) {
   case intValue:
     JSON_ASSERT_MESSAGE(isInt(), "LargestInt out of Int range");
@@ -686,6 +820,8 @@ Value::Int Value::asInt() const {
 }
 
 Value::UInt Value::asUInt() const {
+  if (hasNumberText())
+    return decodedNumber().asUInt();
   switch (type()) {
   case intValue:
     JSON_ASSERT_MESSAGE(isUInt(), "LargestInt out of UInt range");
@@ -710,6 +846,8 @@ Value::UInt Value::asUInt() const {
 #if defined(JSON_HAS_INT64)
 
 Value::Int64 Value::asInt64() const {
+  if (hasNumberText())
+    return decodedNumber().asInt64();
   switch (type()) {
   case intValue:
     return Int64(value_.int_);
@@ -731,6 +869,8 @@ Value::Int64 Value::asInt64() const {
 }
 
 Value::UInt64 Value::asUInt64() const {
+  if (hasNumberText())
+    return decodedNumber().asUInt64();
   switch (type()) {
   case intValue:
     JSON_ASSERT_MESSAGE(isUInt64(), "LargestInt out of UInt64 range");
@@ -769,6 +909,8 @@ LargestUInt Value::asLargestUInt() const {
 }
 
 double Value::asDouble() const {
+  if (hasNumberText())
+    return decodedNumber().asDouble();
   switch (type()) {
   case intValue:
     return static_cast<double>(value_.int_);
@@ -791,6 +933,8 @@ double Value::asDouble() const {
 }
 
 float Value::asFloat() const {
+  if (hasNumberText())
+    return decodedNumber().asFloat();
   switch (type()) {
   case intValue:
     return static_cast<float>(value_.int_);
@@ -814,6 +958,8 @@ float Value::asFloat() const {
 }
 
 bool Value::asBool() const {
+  if (hasNumberText())
+    return decodedNumber().asBool();
   switch (type()) {
   case booleanValue:
     return value_.bool_;
@@ -835,6 +981,8 @@ bool Value::asBool() const {
 }
 
 bool Value::isConvertibleTo(ValueType other) const {
+  if (hasNumberText())
+    return decodedNumber().isConvertibleTo(other);
   switch (other) {
   case nullValue:
     return (isNumeric() && asDouble() == 0.0) ||
@@ -901,6 +1049,7 @@ bool Value::empty() const {
 Value::operator bool() const { return !isNull(); }
 
 void Value::clear() {
+  setIsPristine(false);
   JSON_ASSERT_MESSAGE(type() == nullValue || type() == arrayValue ||
                           type() == objectValue,
                       "in Json::Value::clear(): requires complex value");
@@ -917,6 +1066,7 @@ void Value::clear() {
 }
 
 void Value::resize(ArrayIndex newSize) {
+  setIsPristine(false);
   JSON_ASSERT_MESSAGE(type() == nullValue || type() == arrayValue,
                       "in Json::Value::resize(): requires arrayValue");
   if (type() == nullValue)
@@ -935,6 +1085,7 @@ void Value::resize(ArrayIndex newSize) {
 }
 
 Value& Value::operator[](ArrayIndex index) {
+  setIsPristine(false);
   JSON_ASSERT_MESSAGE(
       type() == nullValue || type() == arrayValue,
       "in Json::Value::operator[](ArrayIndex): requires arrayValue");
@@ -980,6 +1131,14 @@ const Value& Value::operator[](int index) const {
 void Value::initBasic(ValueType type, bool allocated) {
   setType(type);
   setIsAllocated(allocated);
+  setIsBorrowed(false);
+  setIsNullTerminated(false);
+  setHasNumberText(false);
+  setIsEscaped(false);
+  setIsRaw(false);
+  setIsPristine(false);
+  setIsMoved(false);
+  bits_.length_ = 0;
   comments_ = Comments{};
   start_ = 0;
   limit_ = 0;
@@ -988,22 +1147,45 @@ void Value::initBasic(ValueType type, bool allocated) {
 void Value::dupPayload(const Value& other) {
   setType(other.type());
   setIsAllocated(false);
+  setIsBorrowed(false);
+  setIsNullTerminated(false);
+  setHasNumberText(false);
+  setIsEscaped(false);
+  setIsRaw(false);
+  setIsPristine(false);
+  setIsMoved(false);
+  bits_.length_ = 0;
   switch (type()) {
   case nullValue:
   case intValue:
   case uintValue:
   case realValue:
   case booleanValue:
-    value_ = other.value_;
+    if (other.hasNumberText()) {
+      // Like borrowed strings, literals are duplicated on copy.
+      unsigned len;
+      char const* str;
+      other.decodeStringPayload(&len, &str);
+      value_.string_ = duplicateAndPrefixStringValue(str, len);
+      setIsAllocated(true);
+      setHasNumberText(true);
+    } else {
+      value_ = other.value_;
+    }
     break;
   case stringValue:
-    if (other.value_.string_ && other.isAllocated()) {
+    // Borrowed strings are duplicated on copy, like CZString::duplicateOnCopy.
+    if (other.value_.string_ && (other.isAllocated() || other.isBorrowed())) {
       unsigned len;
       char const* str;
-      decodePrefixedString(other.isAllocated(), other.value_.string_, &len,
-                           &str);
-      value_.string_ = duplicateAndPrefixStringValue(str, len);
+      other.decodeStringPayload(&len, &str);
+      // The copy stays escaped, and decodes on its own.
+      value_.string_ = other.isEscaped()
+                           ? newEscapedString(str, len, true)
+                           : duplicateAndPrefixStringValue(str, len);
       setIsAllocated(true);
+      setIsEscaped(other.isEscaped());
+      setIsRaw(other.isRaw());
     } else {
       value_.string_ = other.value_.string_;
     }
@@ -1020,13 +1202,15 @@ void Value::dupPayload(const Value& other) {
 void Value::releasePayload() {
   switch (type()) {
   case nullValue:
-  case intValue:
-  case uintValue:
-  case realValue:
   case booleanValue:
     break;
+  case intValue:
+  case uintValue:
+  case realValue: // allocated_ iff holding an owned literal
   case stringValue:
-    if (isAllocated())
+    if (isEscaped())
+      releaseEscapedString(value_.string_);
+    else if (isAllocated())
       releasePrefixedStringValue(value_.string_);
     break;
   case arrayValue:
@@ -1038,6 +1222,88 @@ void Value::releasePayload() {
   }
 }
 
+void Value::decodeStringPayload(unsigned* length, char const** value) const {
+  if (isBorrowed()) {
+    *length = bits_.length_;
+    *value = value_.string_;
+  } else if (isEscaped()) {
+    auto const* escaped =
+        reinterpret_cast<EscapedString const*>(value_.string_);
+    *length = escaped->length;
+    *value = escaped->content;
+  } else {
+    decodePrefixedString(isAllocated(), value_.string_, length, value);
+  }
+}
+
+// The content of a string, decoded on first access if it is still escaped.
+void Value::decodeString(unsigned* length, char const** value) const {
+  if (!isEscaped()) {
+    decodeStringPayload(length, value);
+    return;
+  }
+  auto* escaped = reinterpret_cast<EscapedString*>(value_.string_);
+  char* decoded = escaped->decoded.load(std::memory_order_acquire);
+  if (!decoded) {
+    // Decoding never lengthens the string, so do it within a copy.
+    char* copy =
+        duplicateAndPrefixStringValue(escaped->content, escaped->length);
+    char* content = copy + sizeof(unsigned);
+    char* contentEnd =
+        unescapeStringLiteral(content, content + escaped->length, content);
+    *contentEnd = 0;
+    *reinterpret_cast<unsigned*>(copy) =
+        static_cast<unsigned>(contentEnd - content);
+    // Another thread may have got there first; then keep its copy.
+    if (escaped->decoded.compare_exchange_strong(decoded, copy,
+                                                 std::memory_order_acq_rel,
+                                                 std::memory_order_acquire))
+      decoded = copy;
+    else
+      releasePrefixedStringValue(copy);
+  }
+  decodePrefixedString(true, decoded, length, value);
+}
+
+// Convert the literal of a number into an ordinary number, without comments.
+Value Value::decodedNumber() const {
+  Value decoded;
+  if (!hasNumberText()) {
+    decoded.dupPayload(*this);
+    return decoded;
+  }
+  unsigned length;
+  char const* text;
+  decodeStringPayload(&length, &text);
+  bool isNegative = false;
+  LargestUInt magnitude = 0;
+  double real = 0;
+  switch (type()) {
+  case intValue:
+  case uintValue:
+    if (decodeIntegerLiteral(text, text + length, isNegative, magnitude)) {
+      if (isNegative)
+        decoded = -LargestInt(magnitude);
+      else if (type() == intValue)
+        decoded = LargestInt(magnitude);
+      else
+        decoded = magnitude;
+      return decoded;
+    }
+    break;
+  case realValue:
+    if (decodeRealLiteral(text, text + length, real)) {
+      decoded = real;
+      return decoded;
+    }
+    break;
+  default:
+    break;
+  }
+  JSON_FAIL_MESSAGE("in Json::Value::decodedNumber(): bad number literal '" +
+                    String(text, length) + "'");
+}
+
 void Value::dupMeta(const Value& other) {
   comments_ = other.comments_;
   start_ = other.start_;
@@ -1048,6 +1314,7 @@ void Value::dupMeta(const Value& other) {
 // @pre Type of '*this' is object or null.
 // @param key is null-terminated.
 Value& Value::resolveReference(const char* key) {
+  setIsPristine(false);
   JSON_ASSERT_MESSAGE(
       type() == nullValue || type() == objectValue,
       "in Json::Value::resolveReference(): requires objectValue");
@@ -1067,6 +1334,7 @@ Value& Value::resolveReference(const char* key) {
 
 // @param key is not null-terminated.
 Value& Value::resolveReference(char const* key, char const* end) {
+  setIsPristine(false);
   JSON_ASSERT_MESSAGE(
       type() == nullValue || type() == objectValue,
       "in Json::Value::resolveReference(key, end): requires objectValue");
@@ -1084,6 +1352,27 @@ Value& Value::resolveReference(char const* key, char const* end) {
   return value;
 }
 
+// Like resolveReference(key, end), but a newly inserted member name
+// references [key, end) instead of a copy. It is still duplicated whenever
+// the object is copied.
+Value& Value::resolveBorrowedReference(char const* key, char const* end) {
+  setIsPristine(false);
+  JSON_ASSERT_MESSAGE(
+      type() == nullValue || type() == objectValue,
+      "in Json::Value::resolveBorrowedReference(): requires objectValue");
+  if (type() == nullValue)
+    *this = Value(objectValue);
+  CZString actualKey(key, static_cast<unsigned>(end - key),
+                     CZString::duplicateOnCopy);
+  auto it = value_.map_->lower_bound(actualKey);
+  if (it != value_.map_->end() && (*it).first == actualKey)
+    return (*it).second;
+
+  // Move the key in, so that the map does not duplicate it.
+  it = value_.map_->emplace_hint(it, std::move(actualKey), nullSingleton());
+  return (*it).second;
+}
+
 Value Value::get(ArrayIndex index, const Value& defaultValue) const {
   const Value* value = &((*this)[index]);
   return value == &nullSingleton() ? defaultValue : *value;
@@ -1135,6 +1424,10 @@ Value& Value::operator[](const StaticString& key) {
   return resolveReference(key.c_str());
 }
 
+Value& Value::operator[](const BorrowedString& key) {
+  return resolveBorrowedReference(key.data(), key.end());
+}
+
 #ifdef JSON_USE_CPPTL
 Value& Value::operator[](const CppTL::ConstString& key) {
   return resolveReference(key.c_str(), key.end_c_str());
@@ -1150,6 +1443,7 @@ Value const& Value::operator[](CppTL::ConstString const& key) const {
 Value& Value::append(const Value& value) { return append(Value(value)); }
 
 Value& Value::append(Value&& value) {
+  setIsPristine(false);
   JSON_ASSERT_MESSAGE(type() == nullValue || type() == arrayValue,
                       "in Json::Value::append: requires arrayValue");
   if (type() == nullValue) {
@@ -1159,16 +1453,27 @@ Value& Value::append(Value&& value) {
 }
 
 bool Value::insert(ArrayIndex index, Value newValue) {
+  setIsPristine(false);
   JSON_ASSERT_MESSAGE(type() == nullValue || type() == arrayValue,
                       "in Json::Value::insert: requires arrayValue");
   ArrayIndex length = size();
   if (index > length) {
     return false;
   } else {
-    for (ArrayIndex i = length; i > index; i--) {
-      (*this)[i] = std::move((*this)[i - 1]);
+    if (type() == nullValue)
+      *this = Value(arrayValue);
+    // Shift the items from index right by walking the map down from a new
+    // last item, instead of looking each one up. Like operator[], this fills
+    // the gaps of a sparse array with nulls on the way.
+    auto it = value_.map_->emplace_hint(value_.map_->end(), length, Value());
+    for (ArrayIndex i = length; i > index; --i) {
+      auto prev = it;
+      if (it == value_.map_->begin() || (--prev)->first.index() != i - 1)
+        prev = value_.map_->emplace_hint(it, i - 1, Value());
+      it->second = std::move(prev->second);
+      it = prev;
     }
-    (*this)[index] = std::move(newValue);
+    it->second = std::move(newValue);
     return true;
   }
 }
@@ -1186,6 +1491,7 @@ Value Value::get(String const& key, Value const& defaultValue) const {
 }
 
 bool Value::removeMember(const char* begin, const char* end, Value* removed) {
+  setIsPristine(false);
   if (type() != objectValue) {
     return false;
   }
@@ -1206,6 +1512,7 @@ bool Value::removeMember(String const& key, Value* removed) {
   return removeMember(key.data(), key.data() + key.length(), removed);
 }
 void Value::removeMember(const char* key) {
+  setIsPristine(false);
   JSON_ASSERT_MESSAGE(type() == nullValue || type() == objectValue,
                       "in Json::Value::removeMember(): requires objectValue");
   if (type() == nullValue)
@@ -1217,6 +1524,7 @@ void Value::removeMember(const char* key) {
 void Value::removeMember(const String& key) { removeMember(key.c_str()); }
 
 bool Value::removeIndex(ArrayIndex index, Value* removed) {
+  setIsPristine(false);
   if (type() != arrayValue) {
     return false;
   }
@@ -1226,17 +1534,19 @@ bool Value::removeIndex(ArrayIndex index, Value* removed) {
     return false;
   }
   if (removed)
-    *removed = it->second;
-  ArrayIndex oldSize = size();
-  // shift left all items left, into the place of the "removed"
-  for (ArrayIndex i = index; i < (oldSize - 1); ++i) {
-    CZString keey(i);
-    (*value_.map_)[keey] = (*this)[i + 1];
-  }
-  // erase the last one ("leftover")
-  CZString keyLast(oldSize - 1);
-  auto itLast = value_.map_->find(keyLast);
-  value_.map_->erase(itLast);
+    *removed = std::move(it->second);
+  // Shift the following items left, moving rather than copying them, and
+  // erase the last one ("leftover"). Like operator[], this fills the gaps of
+  // a sparse array with nulls on the way, so that it loses one index only.
+  ArrayIndex const last = size() - 1;
+  for (ArrayIndex i = index; i < last; ++i) {
+    auto next = std::next(it);
+    if (next->first.index() != i + 1)
+      next = value_.map_->emplace_hint(next, i + 1, Value());
+    it->second = std::move(next->second);
+    it = next;
+  }
+  value_.map_->erase(it);
   return true;
 }
 
@@ -1315,6 +1625,8 @@ bool Value::isNull() const { return type() == nullValue; }
 bool Value::isBool() const { return type() == booleanValue; }
 
 bool Value::isInt() const {
+  if (hasNumberText())
+    return decodedNumber().isInt();
   switch (type()) {
   case intValue:
 #if defined(JSON_HAS_INT64)
@@ -1334,6 +1646,8 @@ bool Value::isInt() const {
 }
 
 bool Value::isUInt() const {
+  if (hasNumberText())
+    return decodedNumber().isUInt();
   switch (type()) {
   case intValue:
 #if defined(JSON_HAS_INT64)
@@ -1357,6 +1671,8 @@ bool Value::isUInt() const {
 }
 
 bool Value::isInt64() const {
+  if (hasNumberText())
+    return decodedNumber().isInt64();
 #if defined(JSON_HAS_INT64)
   switch (type()) {
   case intValue:
@@ -1377,6 +1693,8 @@ bool Value::isInt64() const {
 }
 
 bool Value::isUInt64() const {
+  if (hasNumberText())
+    return decodedNumber().isUInt64();
 #if defined(JSON_HAS_INT64)
   switch (type()) {
   case intValue:
@@ -1397,6 +1715,8 @@ bool Value::isUInt64() const {
 }
 
 bool Value::isIntegral() const {
+  if (hasNumberText())
+    return decodedNumber().isIntegral();
   switch (type()) {
   case intValue:
   case uintValue:
@@ -1485,9 +1805,15 @@ String Value::getComment(CommentPlacement placement) const {
   return comments_.get(placement);
 }
 
-void Value::setOffsetStart(ptrdiff_t start) { start_ = start; }
+void Value::setOffsetStart(ptrdiff_t start) {
+  setIsPristine(false);
+  start_ = start;
+}
 
-void Value::setOffsetLimit(ptrdiff_t limit) { limit_ = limit; }
+void Value::setOffsetLimit(ptrdiff_t limit) {
+  setIsPristine(false);
+  limit_ = limit;
+}
 
 ptrdiff_t Value::getOffsetStart() const { return start_; }
 
@@ -1530,6 +1856,7 @@ Value::const_iterator Value::end() const {
 }
 
 Value::iterator Value::begin() {
+  setIsPristine(false);
   switch (type()) {
   case arrayValue:
   case objectValue:
@@ -1543,6 +1870,7 @@ Value::iterator Value::begin() {
 }
 
 Value::iterator Value::end() {
+  setIsPristine(false);
   switch (type()) {
   case arrayValue:
   case objectValue:
@@ -1691,4 +2019,1174 @@ Value& Path::make(Value& root) const {
   return *node;
 }
 
+// class Pointer
+// //////////////////////////////////////////////////////////////////
+
+Pointer::Pointer() = default;
+
+Pointer::Pointer(const String& text) {
+  char const* current = text.data();
+  char const* const end = current + text.size();
+  if (current != end && *current != '/')
+    throwRuntimeError("JSON pointer must be empty or start with '/': " + text);
+  while (current != end) {
+    Token token{String(), 0, true};
+    for (++current; current != end && *current != '/'; ++current) {
+      char c = *current;
+      if (c == '~') {
+        if (++current == end || (*current != '0' && *current != '1'))
+          throwRuntimeError("Invalid escape in JSON pointer: " + text);
+        c = *current == '0' ? '~' : '/';
+      }
+      token.name_ += c;
+    }
+    // An array index is "0", or digits without a leading zero.
+    String const& name = token.name_;
+    token.isIndex_ = !name.empty() && (name[0] != '0' || name.size() == 1);
+    for (char c : name) {
+      ArrayIndex const digit = ArrayIndex(c - '0');
+      if (c < '0' || c > '9' || token.index_ > (Value::maxUInt - digit) / 10) {
+        token.isIndex_ = false;
+        break;
+      }
+      token.index_ = token.index_ * 10 + digit;
+    }
+    tokens_.push_back(std::move(token));
+  }
+}
+
+String Pointer::toString() const {
+  String text;
+  for (auto const& token : tokens_) {
+    text += '/';
+    for (char c : token.name_) {
+      if (c == '~')
+        text += "~0";
+      else if (c == '/')
+        text += "~1";
+      else
+        text += c;
+    }
+  }
+  return text;
+}
+
+Value const* Pointer::resolveToken(Value const& node, Token const& token) {
+  if (node.isObject())
+    return node.find(token.name_.data(),
+                     token.name_.data() + token.name_.size());
+  if (node.isArray() && token.isIndex_ && token.index_ < node.size())
+    return &node[token.index_];
+  return nullptr;
+}
+
+Value const* Pointer::resolve(Value const& root) const {
+  Value const* node = &root;
+  for (auto const& token : tokens_) {
+    node = resolveToken(*node, token);
+    if (!node)
+      return nullptr;
+  }
+  return node;
+}
+
+void Pointer::resolveAll(std::vector<Pointer> const& pointers,
+                         Value const& root,
+                         std::vector<Value const*>* results) {
+  results->resize(pointers.size());
+  for (size_t i = 0; i < pointers.size(); ++i)
+    (*results)[i] = pointers[i].resolve(root);
+}
+
+Value& Pointer::make(Value& root) const {
+  Value* node = &root;
+  for (auto const& token : tokens_) {
+    bool const append = token.name_ == "-";
+    if (node->isNull() && (token.isIndex_ || append))
+      *node = Value(arrayValue);
+    if (node->isArray()) {
+      JSON_ASSERT_MESSAGE(token.isIndex_ || append,
+                          "in Json::Pointer::make(): '" + token.name_ +
+                              "' is not an array index");
+      node = append ? &node->append(Value()) : &(*node)[token.index_];
+    } else {
+      JSON_ASSERT_MESSAGE(node->isNull() || node->isObject(),
+                          "in Json::Pointer::make(): requires objectValue or "
+                          "arrayValue");
+      node = &(*node)[token.name_];
+    }
+  }
+  return *node;
+}
+
+Value& Pointer::make(Value& root, Value value) const {
+  Value& node = make(root);
+  node = std::move(value);
+  return node;
+}
+
+// class PointerSet
+// //////////////////////////////////////////////////////////////////
+
+PointerSet::PointerSet() : nodes_(1) {}
+
+size_t PointerSet::add(Pointer const& pointer) {
+  size_t node = 0;
+  for (auto const& token : pointer.tokens_) {
+    size_t next = 0;
+    for (size_t child : nodes_[node].children_) {
+      if (nodes_[child].token_.name_ == token.name_) {
+        next = child;
+        break;
+      }
+    }
+    if (!next) {
+      next = nodes_.size();
+      nodes_[node].children_.push_back(next);
+      nodes_.push_back(Node{token, {}, {}});
+    }
+    node = next;
+  }
+  nodes_[node].pointers_.push_back(size_);
+  return size_++;
+}
+
+void PointerSet::resolve(Value const& root,
+                         std::vector<Value const*>* results) const {
+  results->assign(size_, nullptr);
+  resolveNode(0, root, results);
+}
+
+void PointerSet::resolveNode(size_t node, Value const& value,
+                             std::vector<Value const*>* results) const {
+  for (size_t pointer : nodes_[node].pointers_)
+    (*results)[pointer] = &value;
+  for (size_t child : nodes_[node].children_) {
+    if (Value const* found = Pointer::resolveToken(value, nodes_[child].token_))
+      resolveNode(child, *found, results);
+  }
+}
+
+// class Query
+// //////////////////////////////////////////////////////////////////
+
+// The compiled form of a query: the segments to run, and the filter
+// expressions their selectors refer to by position.
+class Query::Plan {
+public:
+  struct Selector {
+    enum Kind { name, wildcard, index, slice, filter };
+    Kind kind_;
+    String name_;
+    LargestInt start_; // the index, or the start of the slice
+    LargestInt end_;
+    LargestInt step_;
+    bool hasStart_;
+    bool hasEnd_;
+    size_t filter_;
+  };
+
+  struct Segment {
+    bool descendant_;
+    std::vector<Selector> selectors_;
+  };
+  typedef std::vector<Segment> Segments;
+
+  // A query in a filter, run on the current node (@) or on the root ($).
+  struct Subquery {
+    bool absolute_;
+    Segments segments_;
+  };
+
+  // A literal, or a query selecting at most one value.
+  struct Comparable {
+    bool isLiteral_;
+    Value literal_;
+    Subquery query_;
+  };
+
+  struct Expression {
+    enum Kind { disjunction, conjunction, negation, test, comparison };
+    enum Operator { equal, notEqual, less, lessEqual, greater, greaterEqual };
+    Kind kind_;
+    std::vector<size_t> operands_; // disjunction, conjunction and negation
+    Subquery query_;               // test
+    Operator operator_;            // comparison
+    Comparable left_;
+    Comparable right_;
+  };
+
+  explicit Plan(String const& text);
+
+  void select(Segments const& segments, Value const& start, Value const& root,
+              std::vector<Value const*>* results) const;
+
+  Segments segments_;
+
+private:
+  class Parser;
+
+  void selectChildren(Selector const& selector, Value const& node,
+                      Value const& root,
+                      std::vector<Value const*>* results) const;
+  void selectDescendants(Segment const& segment, Value const& node,
+                         Value const& root,
+                         std::vector<Value const*>* results) const;
+  bool test(size_t expression, Value const& current, Value const& root) const;
+  static Value const* resolve(Comparable const& comparable,
+                              Value const& current, Value const& root);
+
+  std::vector<Expression> expressions_;
+};
+
+// Recursive descent parser of the RFC 9535 grammar, into a Plan.
+class Query::Plan::Parser {
+public:
+  Parser(Plan& plan, String const& text)
+      : plan_(plan), text_(text), current_(text.data()),
+        end_(text.data() + text.size()) {}
+
+  void parse() {
+    expect('$', "'$'");
+    plan_.segments_ = parseSegments();
+    if (current_ != end_)
+      fail("a segment");
+  }
+
+private:
+  typedef Plan::Selector Selector;
+  typedef Plan::Segment Segment;
+  typedef Plan::Segments Segments;
+  typedef Plan::Subquery Subquery;
+  typedef Plan::Comparable Comparable;
+  typedef Plan::Expression Expression;
+
+  JSONCPP_NORETURN void fail(char const* expected) const {
+    throwRuntimeError(
+        "Invalid JSONPath query '" + text_ + "' at offset " +
+        valueToString(LargestUInt(current_ - text_.data())) + ": expected " +
+        expected);
+  }
+  void skipBlanks() {
+    while (current_ != end_ && (*current_ == ' ' || *current_ == '\t' ||
+                                *current_ == '\n' || *current_ == '\r'))
+      ++current_;
+  }
+  bool peek(char c) const { return current_ != end_ && *current_ == c; }
+  bool consume(char c) {
+    if (!peek(c))
+      return false;
+    ++current_;
+    return true;
+  }
+  bool consume(char const* word) {
+    size_t const length = strlen(word);
+    if (size_t(end_ - current_) < length ||
+        memcmp(current_, word, length) != 0)
+      return false;
+    current_ += length;
+    return true;
+  }
+  void expect(char c, char const* expected) {
+    if (!consume(c))
+      fail(expected);
+  }
+  static bool isDigit(char c) { return c >= '0' && c <= '9'; }
+  static bool isNameFirst(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' ||
+           static_cast<unsigned char>(c) >= 0x80;
+  }
+
+  Segments parseSegments() {
+    Segments segments;
+    for (;;) {
+      char const* const start = current_;
+      skipBlanks();
+      Segment segment{false, {}};
+      if (consume("..")) {
+        segment.descendant_ = true;
+        if (!peek('['))
+          segment.selectors_.push_back(parseShorthand());
+      } else if (consume('.')) {
+        segment.selectors_.push_back(parseShorthand());
+      } else if (!peek('[')) {
+        current_ = start;
+        return segments;
+      }
+      if (segment.selectors_.empty())
+        parseBracketed(&segment.selectors_);
+      segments.push_back(std::move(segment));
+    }
+  }
+
+  Selector parseShorthand() {
+    Selector selector{Selector::wildcard, String(), 0, 0, 1, false, false, 0};
+    if (consume('*'))
+      return selector;
+    if (current_ == end_ || !isNameFirst(*current_))
+      fail("a member name or '*'");
+    char const* const begin = current_;
+    while (current_ != end_ && (isNameFirst(*current_) || isDigit(*current_)))
+      ++current_;
+    selector.kind_ = Selector::name;
+    selector.name_.assign(begin, current_);
+    return selector;
+  }
+
+  void parseBracketed(std::vector<Selector>* selectors) {
+    expect('[', "'['");
+    do {
+      skipBlanks();
+      selectors->push_back(parseSelector());
+      skipBlanks();
+    } while (consume(','));
+    expect(']', "',' or ']'");
+  }
+
+  Selector parseSelector() {
+    Selector selector{Selector::wildcard, String(), 0, 0, 1, false, false, 0};
+    if (peek('\'') || peek('"')) {
+      selector.kind_ = Selector::name;
+      selector.name_ = parseString();
+    } else if (consume('?')) {
+      skipBlanks();
+      selector.kind_ = Selector::filter;
+      selector.filter_ = parseDisjunction();
+    } else if (!consume('*')) {
+      selector.kind_ = Selector::index;
+      selector.hasStart_ = !peek(':');
+      if (selector.hasStart_)
+        selector.start_ = parseInteger();
+      skipBlanks();
+      if (consume(':')) {
+        selector.kind_ = Selector::slice;
+        skipBlanks();
+        selector.hasEnd_ = peek('-') || atDigit();
+        if (selector.hasEnd_)
+          selector.end_ = parseInteger();
+        skipBlanks();
+        if (consume(':')) {
+          skipBlanks();
+          if (peek('-') || atDigit())
+            selector.step_ = parseInteger();
+        }
+      }
+    }
+    return selector;
+  }
+
+  bool atDigit() const { return current_ != end_ && isDigit(*current_); }
+
+  // RFC 9535 integers: no leading zero, no "-0", and at most 2^53 - 1.
+  LargestInt parseInteger() {
+    LargestInt const limit = (LargestInt(1) << 53) - 1;
+    bool const negative = consume('-');
+    if (!atDigit() || (*current_ == '0' && negative))
+      fail("an integer");
+    LargestInt value = 0;
+    if (!consume('0')) {
+      while (atDigit()) {
+        value = value * 10 + (*current_++ - '0');
+        if (value > limit)
+          fail("an integer of at most 2^53 - 1");
+      }
+    }
+    return negative ? -value : value;
+  }
+
+  String parseString() {
+    char const quote = *current_++;
+    String decoded;
+    for (;;) {
+      if (current_ == end_)
+        fail("the closing quote");
+      char c = *current_++;
+      if (c == quote)
+        return decoded;
+      if (static_cast<unsigned char>(c) < 0x20)
+        fail("an escaped control character");
+      if (c != '\\') {
+        decoded += c;
+        continue;
+      }
+      if (current_ == end_)
+        fail("an escape sequence");
+      switch (c = *current_++) {
+      case 'b':
+        decoded += '\b';
+        break;
+      case 'f':
+        decoded += '\f';
+        break;
+      case 'n':
+        decoded += '\n';
+        break;
+      case 'r':
+        decoded += '\r';
+        break;
+      case 't':
+        decoded += '\t';
+        break;
+      case '/':
+      case '\\':
+        decoded += c;
+        break;
+      case '\'':
+      case '"':
+        if (c != quote)
+          fail("an escape sequence");
+        decoded += c;
+        break;
+      case 'u': {
+        unsigned int codePoint = parseHex4();
+        if (codePoint >= 0xD800 && codePoint <= 0xDBFF) {
+          if (!consume("\\u"))
+            fail("a low surrogate");
+          unsigned int const low = parseHex4();
+          if (low < 0xDC00 || low > 0xDFFF)
+            fail("a low surrogate");
+          codePoint = 0x10000 + ((codePoint & 0x3FF) << 10) + (low & 0x3FF);
+        } else if (codePoint >= 0xDC00 && codePoint <= 0xDFFF) {
+          fail("a high surrogate");
+        }
+        decoded += codePointToUTF8(codePoint);
+        break;
+      }
+      default:
+        fail("an escape sequence");
+      }
+    }
+  }
+
+  unsigned int parseHex4() {
+    unsigned int value = 0;
+    for (int i = 0; i < 4; ++i, ++current_) {
+      if (current_ == end_)
+        fail("four hexadecimal digits");
+      char const c = *current_;
+      value *= 16;
+      if (isDigit(c))
+        value += unsigned(c - '0');
+      else if (c >= 'a' && c <= 'f')
+        value += unsigned(c - 'a' + 10);
+      else if (c >= 'A' && c <= 'F')
+        value += unsigned(c - 'A' + 10);
+      else
+        fail("four hexadecimal digits");
+    }
+    return value;
+  }
+
+  Value parseNumber() {
+    char const* const begin = current_;
+    consume('-');
+    if (!atDigit())
+      fail("a number");
+    if (!consume('0'))
+      while (atDigit())
+        ++current_;
+    bool integral = true;
+    if (consume('.')) {
+      integral = false;
+      if (!atDigit())
+        fail("a digit");
+      while (atDigit())
+        ++current_;
+    }
+    if (consume('e') || consume('E')) {
+      integral = false;
+      if (!consume('+'))
+        consume('-');
+      if (!atDigit())
+        fail("a digit");
+      while (atDigit())
+        ++current_;
+    }
+    if (integral) {
+      bool const negative = *begin == '-';
+      LargestUInt magnitude = 0;
+      char const* p = begin + (negative ? 1 : 0);
+      for (; p != current_; ++p) {
+        auto const digit = static_cast<LargestUInt>(*p - '0');
+        if (magnitude > (Value::maxLargestUInt - digit) / 10)
+          break;
+        magnitude = magnitude * 10 + digit;
+      }
+      if (p == current_ && !negative)
+        return Value(magnitude);
+      if (p == current_ && magnitude <= LargestUInt(Value::maxLargestInt))
+        return Value(-static_cast<LargestInt>(magnitude));
+    }
+    double value = 0;
+    if (!decodeRealLiteral(begin, current_, value))
+      fail("a number");
+    return Value(value);
+  }
+
+  Subquery parseQuery() {
+    Subquery query{consume('$'), {}};
+    if (!query.absolute_)
+      expect('@', "'@' or '$'");
+    query.segments_ = parseSegments();
+    return query;
+  }
+
+  size_t add(Expression expression) {
+    plan_.expressions_.push_back(std::move(expression));
+    return plan_.expressions_.size() - 1;
+  }
+
+  Expression logical(Expression::Kind kind, std::vector<size_t> operands) {
+    Expression expression{kind,
+                          std::move(operands),
+                          Subquery(),
+                          Expression::equal,
+                          Comparable(),
+                          Comparable()};
+    return expression;
+  }
+
+  size_t parseDisjunction() {
+    std::vector<size_t> operands(1, parseConjunction());
+    for (skipBlanks(); consume("||"); skipBlanks()) {
+      skipBlanks();
+      operands.push_back(parseConjunction());
+    }
+    if (operands.size() == 1)
+      return operands[0];
+    return add(logical(Expression::disjunction, std::move(operands)));
+  }
+
+  size_t parseConjunction() {
+    std::vector<size_t> operands(1, parseBasic());
+    for (skipBlanks(); consume("&&"); skipBlanks()) {
+      skipBlanks();
+      operands.push_back(parseBasic());
+    }
+    if (operands.size() == 1)
+      return operands[0];
+    return add(logical(Expression::conjunction, std::move(operands)));
+  }
+
+  size_t parseParenthesized() {
+    skipBlanks();
+    size_t const expression = parseDisjunction();
+    skipBlanks();
+    expect(')', "')'");
+    return expression;
+  }
+
+  size_t parseBasic() {
+    if (consume('!')) {
+      skipBlanks();
+      size_t operand;
+      if (consume('(')) {
+        operand = parseParenthesized();
+      } else {
+        Expression query = logical(Expression::test, {});
+        query.query_ = parseQuery();
+        operand = add(std::move(query));
+      }
+      return add(logical(Expression::negation, {operand}));
+    }
+    if (consume('('))
+      return parseParenthesized();
+    Expression expression = logical(Expression::comparison, {});
+    expression.left_ = parseComparable();
+    char const* const afterLeft = current_;
+    skipBlanks();
+    static struct {
+      char const* text;
+      Expression::Operator op;
+    } const operators[] = {
+        {"==", Expression::equal},     {"!=", Expression::notEqual},
+        {"<=", Expression::lessEqual}, {">=", Expression::greaterEqual},
+        {"<", Expression::less},       {">", Expression::greater},
+    };
+    for (auto const& candidate : operators) {
+      if (consume(candidate.text)) {
+        expression.operator_ = candidate.op;
+        skipBlanks();
+        expression.right_ = parseComparable();
+        checkSingular(expression.left_, afterLeft);
+        checkSingular(expression.right_, current_);
+        return add(std::move(expression));
+      }
+    }
+    current_ = afterLeft;
+    if (expression.left_.isLiteral_)
+      fail("a comparison operator");
+    expression.kind_ = Expression::test;
+    expression.query_ = std::move(expression.left_.query_);
+    return add(std::move(expression));
+  }
+
+  Comparable parseComparable() {
+    Comparable comparable{true, Value(), Subquery()};
+    if (peek('@') || peek('$')) {
+      comparable.isLiteral_ = false;
+      comparable.query_ = parseQuery();
+    } else if (peek('\'') || peek('"')) {
+      comparable.literal_ = parseString();
+    } else if (consume("true")) {
+      comparable.literal_ = true;
+    } else if (consume("false")) {
+      comparable.literal_ = false;
+    } else if (!consume("null")) {
+      comparable.literal_ = parseNumber();
+    }
+    return comparable;
+  }
+
+  // Comparisons only take queries selecting at most one node.
+  void checkSingular(Comparable const& comparable, char const* location) {
+    if (comparable.isLiteral_)
+      return;
+    for (auto const& segment : comparable.query_.segments_) {
+      if (segment.descendant_ || segment.selectors_.size() != 1 ||
+          (segment.selectors_[0].kind_ != Selector::name &&
+           segment.selectors_[0].kind_ != Selector::index)) {
+        current_ = location;
+        fail("a singular query before the comparison");
+      }
+    }
+  }
+
+  Plan& plan_;
+  String const& text_;
+  char const* current_;
+  char const* const end_;
+};
+
+Query::Plan::Plan(String const& text) { Parser(*this, text).parse(); }
+
+void Query::Plan::select(Segments const& segments, Value const& start,
+                         Value const& root,
+                         std::vector<Value const*>* results) const {
+  results->assign(1, &start);
+  std::vector<Value const*> next;
+  for (auto const& segment : segments) {
+    next.clear();
+    for (Value const* node : *results) {
+      if (segment.descendant_) {
+        selectDescendants(segment, *node, root, &next);
+        continue;
+      }
+      for (auto const& selector : segment.selectors_)
+        selectChildren(selector, *node, root, &next);
+    }
+    results->swap(next);
+  }
+}
+
+void Query::Plan::selectChildren(Selector const& selector, Value const& node,
+                                 Value const& root,
+                                 std::vector<Value const*>* results) const {
+  switch (selector.kind_) {
+  case Selector::name:
+    if (node.isObject()) {
+      String const& name = selector.name_;
+      Value const* child = node.find(name.data(), name.data() + name.size());
+      if (child)
+        results->push_back(child);
+    }
+    break;
+  case Selector::wildcard:
+  case Selector::filter:
+    if (node.isArray() || node.isObject()) {
+      for (auto const& child : node) {
+        if (selector.kind_ == Selector::wildcard ||
+            test(selector.filter_, child, root))
+          results->push_back(&child);
+      }
+    }
+    break;
+  case Selector::index:
+    if (node.isArray()) {
+      auto const size = static_cast<LargestInt>(node.size());
+      LargestInt const index =
+          selector.start_ < 0 ? size + selector.start_ : selector.start_;
+      if (index >= 0 && index < size)
+        results->push_back(&node[ArrayIndex(index)]);
+    }
+    break;
+  case Selector::slice:
+    if (node.isArray() && selector.step_ != 0) {
+      // RFC 9535, section 2.3.4.2.2.
+      auto const size = static_cast<LargestInt>(node.size());
+      LargestInt const step = selector.step_;
+      auto normalize = [size](LargestInt index) {
+        return index >= 0 ? index : size + index;
+      };
+      auto clamp = [](LargestInt index, LargestInt lower, LargestInt upper) {
+        return std::min(std::max(index, lower), upper);
+      };
+      LargestInt start = step > 0 ? 0 : size - 1;
+      LargestInt end = step > 0 ? size : -size - 1;
+      if (selector.hasStart_)
+        start = normalize(selector.start_);
+      if (selector.hasEnd_)
+        end = normalize(selector.end_);
+      if (step > 0) {
+        for (LargestInt i = clamp(start, 0, size), upper = clamp(end, 0, size);
+             i < upper; i += step)
+          results->push_back(&node[ArrayIndex(i)]);
+      } else {
+        for (LargestInt i = clamp(start, -1, size - 1),
+                        lower = clamp(end, -1, size - 1);
+             lower < i; i += step)
+          results->push_back(&node[ArrayIndex(i)]);
+      }
+    }
+    break;
+  }
+}
+
+void Query::Plan::selectDescendants(Segment const& segment, Value const& node,
+                                    Value const& root,
+                                    std::vector<Value const*>* results) const {
+  for (auto const& selector : segment.selectors_)
+    selectChildren(selector, node, root, results);
+  if (node.isArray() || node.isObject()) {
+    for (auto const& child : node)
+      selectDescendants(segment, child, root, results);
+  }
+}
+
+Value const* Query::Plan::resolve(Comparable const& comparable,
+                                  Value const& current, Value const& root) {
+  if (comparable.isLiteral_)
+    return &comparable.literal_;
+  Value const* node = comparable.query_.absolute_ ? &root : &current;
+  for (auto const& segment : comparable.query_.segments_) {
+    Selector const& selector = segment.selectors_[0];
+    if (selector.kind_ == Selector::name) {
+      if (!node->isObject())
+        return nullptr;
+      String const& name = selector.name_;
+      node = node->find(name.data(), name.data() + name.size());
+    } else {
+      if (!node->isArray())
+        return nullptr;
+      auto const size = static_cast<LargestInt>(node->size());
+      LargestInt const index =
+          selector.start_ < 0 ? size + selector.start_ : selector.start_;
+      if (index < 0 || index >= size)
+        return nullptr;
+      node = &(*node)[ArrayIndex(index)];
+    }
+    if (!node)
+      return nullptr;
+  }
+  return node;
+}
+
+// Three-way comparison of numbers, exact for integers of either sign.
+static int compareNumbers(Value const& a, Value const& b) {
+  if (a.type() == realValue || b.type() == realValue) {
+    double const x = a.asDouble();
+    double const y = b.asDouble();
+    return x < y ? -1 : y < x ? 1 : 0;
+  }
+  bool const aNegative = a.type() == intValue && a.asLargestInt() < 0;
+  bool const bNegative = b.type() == intValue && b.asLargestInt() < 0;
+  if (aNegative != bNegative)
+    return aNegative ? -1 : 1;
+  if (aNegative) {
+    LargestInt const x = a.asLargestInt();
+    LargestInt const y = b.asLargestInt();
+    return x < y ? -1 : y < x ? 1 : 0;
+  }
+  LargestUInt const x = a.asLargestUInt();
+  LargestUInt const y = b.asLargestUInt();
+  return x < y ? -1 : y < x ? 1 : 0;
+}
+
+// Equality as RFC 9535 defines it, where 1 and 1.0 are equal numbers.
+static bool equalValues(Value const& a, Value const& b) {
+  if (a.isNumeric() && b.isNumeric())
+    return compareNumbers(a, b) == 0;
+  if (a.type() != b.type())
+    return false;
+  switch (a.type()) {
+  case arrayValue:
+    if (a.size() != b.size())
+      return false;
+    for (ArrayIndex i = 0; i < a.size(); ++i) {
+      if (!equalValues(a[i], b[i]))
+        return false;
+    }
+    return true;
+  case objectValue:
+    if (a.size() != b.size())
+      return false;
+    for (auto it = a.begin(); it != a.end(); ++it) {
+      char const* nameEnd;
+      char const* name = it.memberName(&nameEnd);
+      Value const* other = b.find(name, nameEnd);
+      if (!other || !equalValues(*it, *other))
+        return false;
+    }
+    return true;
+  default:
+    return a == b;
+  }
+}
+
+// Ordering of numbers and of strings, by code point; others are unordered.
+static bool lessValues(Value const& a, Value const& b) {
+  if (a.isNumeric() && b.isNumeric())
+    return compareNumbers(a, b) < 0;
+  char const *aBegin, *aEnd, *bBegin, *bEnd;
+  if (!a.getString(&aBegin, &aEnd) || !b.getString(&bBegin, &bEnd))
+    return false;
+  return std::lexicographical_compare(
+      reinterpret_cast<unsigned char const*>(aBegin),
+      reinterpret_cast<unsigned char const*>(aEnd),
+      reinterpret_cast<unsigned char const*>(bBegin),
+      reinterpret_cast<unsigned char const*>(bEnd));
+}
+
+bool Query::Plan::test(size_t expression, Value const& current,
+                       Value const& root) const {
+  Expression const& e = expressions_[expression];
+  switch (e.kind_) {
+  case Expression::disjunction:
+    for (size_t operand : e.operands_) {
+      if (test(operand, current, root))
+        return true;
+    }
+    return false;
+  case Expression::conjunction:
+    for (size_t operand : e.operands_) {
+      if (!test(operand, current, root))
+        return false;
+    }
+    return true;
+  case Expression::negation:
+    return !test(e.operands_[0], current, root);
+  case Expression::test: {
+    std::vector<Value const*> selected;
+    select(e.query_.segments_, e.query_.absolute_ ? root : current, root,
+           &selected);
+    return !selected.empty();
+  }
+  case Expression::comparison:
+    break;
+  }
+  // A query selecting nothing only equals another that selects nothing.
+  Value const* left = resolve(e.left_, current, root);
+  Value const* right = resolve(e.right_, current, root);
+  bool const equal =
+      left && right ? equalValues(*left, *right) : left == right;
+  switch (e.operator_) {
+  case Expression::equal:
+    return equal;
+  case Expression::notEqual:
+    return !equal;
+  case Expression::lessEqual:
+    return equal || (left && right && lessValues(*left, *right));
+  case Expression::greaterEqual:
+    return equal || (left && right && lessValues(*right, *left));
+  case Expression::less:
+    return left && right && lessValues(*left, *right);
+  case Expression::greater:
+    return left && right && lessValues(*right, *left);
+  }
+  return false;
+}
+
+Query::Query(const String& expression)
+    : plan_(std::make_shared<Plan>(expression)) {}
+
+void Query::select(Value const& root,
+                   std::vector<Value const*>* results) const {
+  plan_->select(plan_->segments_, root, root, results);
+}
+
+// class PatchApplier
+// //////////////////////////////////////////////////////////////////
+
+// Applies the operations of a JSON Patch one by one, logging how to undo each
+// change so that a patch failing part way can be rolled back.
+class PatchApplier {
+public:
+  explicit PatchApplier(Value& target) : target_(target) {}
+
+  void apply(Value const& patch);
+
+private:
+  typedef Pointer::Token Token;
+
+  struct Operation {
+    enum Kind { add, remove, replace, move, copy, test };
+    Kind kind_;
+    Pointer path_;
+    Pointer from_;
+    Value const* value_;
+  };
+
+  // Undoing remove takes the value out, and undoing replace swaps the old
+  // value back, into the carry; restore then puts the carry back at its
+  // path, which is how a move is undone.
+  struct Undo {
+    enum Kind { add, remove, replace, restore };
+    Kind kind_;
+    Pointer path_;
+    Value value_;
+  };
+
+  static std::vector<Operation> compile(Value const& patch);
+  String perform(Operation const& operation);
+  void rollback();
+
+  Value* resolve(Pointer const& pointer, size_t count);
+  String put(Pointer* path, Value* value, bool* replaced);
+  String take(Pointer const& path, Value* removed);
+  void log(Undo::Kind kind, Pointer path, Value value = Value());
+
+  Value& target_;
+  std::vector<Undo> undo_;
+};
+
+std::vector<PatchApplier::Operation>
+PatchApplier::compile(Value const& patch) {
+  if (!patch.isArray())
+    throwRuntimeError("in Json::applyPatch(): the patch must be an array");
+  static struct {
+    char const* name;
+    Operation::Kind kind;
+  } const kinds[] = {
+      {"add", Operation::add},   {"remove", Operation::remove},
+      {"replace", Operation::replace},
+      {"move", Operation::move}, {"copy", Operation::copy},
+      {"test", Operation::test},
+  };
+  std::vector<Operation> operations;
+  operations.reserve(patch.size());
+  for (ArrayIndex i = 0; i < patch.size(); ++i) {
+    Value const& object = patch[i];
+    auto member = [&object](char const* name) -> Value const* {
+      return object.isObject() ? object.find(name, name + strlen(name))
+                               : nullptr;
+    };
+    auto fail = [i](char const* message) {
+      throwRuntimeError("in Json::applyPatch(): operation " +
+                        valueToString(LargestUInt(i)) + ": " + message);
+    };
+    Value const* op = member("op");
+    Value const* path = member("path");
+    Value const* from = member("from");
+    if (!op || !op->isString() || !path || !path->isString())
+      fail("requires string \"op\" and \"path\" members");
+    Operation operation{Operation::test, Pointer(path->asString()), Pointer(),
+                        member("value")};
+    auto kind = std::find_if(
+        std::begin(kinds), std::end(kinds),
+        [op](decltype(kinds[0]) candidate) { return *op == candidate.name; });
+    if (kind == std::end(kinds))
+      fail("unknown \"op\"");
+    operation.kind_ = kind->kind;
+    switch (operation.kind_) {
+    case Operation::add:
+    case Operation::replace:
+    case Operation::test:
+      if (!operation.value_)
+        fail("requires a \"value\" member");
+      break;
+    case Operation::move:
+    case Operation::copy: {
+      if (!from || !from->isString())
+        fail("requires a string \"from\" member");
+      operation.from_ = Pointer(from->asString());
+      auto const& fromTokens = operation.from_.tokens_;
+      auto const& pathTokens = operation.path_.tokens_;
+      if (operation.kind_ == Operation::move &&
+          fromTokens.size() < pathTokens.size() &&
+          std::equal(fromTokens.begin(), fromTokens.end(), pathTokens.begin(),
+                     [](Token const& a, Token const& b) {
+                       return a.name_ == b.name_;
+                     }))
+        fail("cannot move a value into itself");
+      break;
+    }
+    case Operation::remove:
+      break;
+    }
+    operations.push_back(std::move(operation));
+  }
+  return operations;
+}
+
+void PatchApplier::apply(Value const& patch) {
+  // Compiling checks the whole patch, so that a malformed one changes nothing.
+  std::vector<Operation> const operations = compile(patch);
+  for (size_t i = 0; i < operations.size(); ++i) {
+    String const error = perform(operations[i]);
+    if (!error.empty()) {
+      rollback();
+      throwRuntimeError("in Json::applyPatch(): operation " +
+                        valueToString(LargestUInt(i)) + ": " + error);
+    }
+  }
+}
+
+String PatchApplier::perform(Operation const& operation) {
+  switch (operation.kind_) {
+  case Operation::add:
+  case Operation::copy: {
+    Value const* source = operation.value_;
+    if (operation.kind_ == Operation::copy)
+      source = operation.from_.resolve(target_);
+    if (!source)
+      return "\"from\" not found";
+    Value value(*source);
+    Pointer path = operation.path_;
+    bool replaced;
+    String error = put(&path, &value, &replaced);
+    if (error.empty())
+      log(replaced ? Undo::replace : Undo::remove, std::move(path),
+          std::move(value));
+    return error;
+  }
+  case Operation::remove: {
+    Value removed;
+    String error = take(operation.path_, &removed);
+    if (error.empty())
+      log(Undo::add, operation.path_, std::move(removed));
+    return error;
+  }
+  case Operation::replace: {
+    Value* node = resolve(operation.path_, operation.path_.size());
+    if (!node)
+      return "\"path\" not found";
+    Value value(*operation.value_);
+    node->swap(value);
+    log(Undo::replace, operation.path_, std::move(value));
+    return String();
+  }
+  case Operation::move: {
+    if (operation.from_.toString() == operation.path_.toString())
+      return operation.from_.resolve(target_) ? String() : "\"from\" not found";
+    Value value;
+    String error = take(operation.from_, &value);
+    if (!error.empty())
+      return "\"from\" not found";
+    Pointer path = operation.path_;
+    bool replaced;
+    error = put(&path, &value, &replaced);
+    if (!error.empty()) {
+      log(Undo::add, operation.from_, std::move(value));
+      return error;
+    }
+    log(Undo::restore, operation.from_);
+    log(replaced ? Undo::replace : Undo::remove, std::move(path),
+        std::move(value));
+    return String();
+  }
+  case Operation::test: {
+    Value const* node = operation.path_.resolve(target_);
+    if (!node)
+      return "\"path\" not found";
+    return equalValues(*node, *operation.value_) ? String() : "test failed";
+  }
+  }
+  return String();
+}
+
+void PatchApplier::rollback() {
+  Value carry;
+  for (auto it = undo_.rbegin(); it != undo_.rend(); ++it) {
+    bool replaced;
+    switch (it->kind_) {
+    case Undo::add:
+      put(&it->path_, &it->value_, &replaced);
+      break;
+    case Undo::remove:
+      take(it->path_, &carry);
+      break;
+    case Undo::replace:
+      resolve(it->path_, it->path_.size())->swap(it->value_);
+      carry = std::move(it->value_);
+      break;
+    case Undo::restore:
+      put(&it->path_, &carry, &replaced);
+      break;
+    }
+  }
+  undo_.clear();
+}
+
+// Returns the value the first count tokens of pointer refer to, or nullptr.
+Value* PatchApplier::resolve(Pointer const& pointer, size_t count) {
+  Value* node = &target_;
+  for (size_t i = 0; i < count; ++i) {
+    Token const& token = pointer.tokens_[i];
+    char const* const name = token.name_.data();
+    char const* const nameEnd = name + token.name_.size();
+    if (node->isObject() && node->find(name, nameEnd))
+      node = node->demand(name, nameEnd);
+    else if (node->isArray() && token.isIndex_ && token.index_ < node->size())
+      node = &(*node)[token.index_];
+    else
+      return nullptr;
+  }
+  return node;
+}
+
+// Moves *value to path as "add" does, setting *replaced if it replaced a
+// value, which is left in *value. An appending "-" in path is replaced by the
+// index the value was added at.
+String PatchApplier::put(Pointer* path, Value* value, bool* replaced) {
+  *replaced = true;
+  if (path->tokens_.empty()) {
+    target_.swap(*value);
+    return String();
+  }
+  Value* parent = resolve(*path, path->size() - 1);
+  Token& token = path->tokens_.back();
+  if (parent && parent->isObject()) {
+    char const* const name = token.name_.data();
+    char const* const nameEnd = name + token.name_.size();
+    *replaced = parent->find(name, nameEnd) != nullptr;
+    parent->demand(name, nameEnd)->swap(*value);
+    return String();
+  }
+  if (parent && parent->isArray()) {
+    ArrayIndex const size = parent->size();
+    if (token.name_ == "-")
+      token = Token{valueToString(size), size, true};
+    if (!token.isIndex_ || token.index_ > size)
+      return "array index out of range";
+    *replaced = false;
+    parent->insert(token.index_, std::move(*value));
+    return String();
+  }
+  return "\"path\" not found";
+}
+
+// Removes the value at path, moving it to *removed.
+String PatchApplier::take(Pointer const& path, Value* removed) {
+  if (path.tokens_.empty())
+    return "cannot remove the whole document";
+  Value* parent = resolve(path, path.size() - 1);
+  String const& name = path.tokens_.back().name_;
+  ArrayIndex const index = path.tokens_.back().index_;
+  if (parent && parent->isObject() &&
+      parent->removeMember(name.data(), name.data() + name.size(), removed))
+    return String();
+  if (parent && parent->isArray() && path.tokens_.back().isIndex_ &&
+      parent->removeIndex(index, removed))
+    return String();
+  return "\"path\" not found";
+}
+
+void PatchApplier::log(Undo::Kind kind, Pointer path, Value value) {
+  undo_.push_back(Undo{kind, std::move(path), std::move(value)});
+}
+
+void applyPatch(Value& target, Value const& patch) {
+  PatchApplier(target).apply(patch);
+}
+
 } // namespace Json
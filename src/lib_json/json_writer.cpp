@@ -5,16 +5,31 @@
 
 #if !defined(JSON_IS_AMALGAMATION)
 #include "json_tool.h"
+#include <json/reader.h>
 #include <json/writer.h>
 #endif // if !defined(JSON_IS_AMALGAMATION)
+#include <algorithm>
 #include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <condition_variable>
 #include <cstring>
+#include <functional>
 #include <iomanip>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <sstream>
+#include <thread>
 #include <utility>
 
+#if !defined(_WIN32)
+#include <cerrno>
+#include <climits>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
 #if __cplusplus >= 201103L
 #include <cmath>
 #include <cstdio>
@@ -89,30 +104,34 @@ using StreamWriterPtr = std::unique_ptr<StreamWriter>;
 typedef std::auto_ptr<StreamWriter> StreamWriterPtr;
 #endif
 
-String valueToString(LargestInt value) {
-  UIntToStringBuffer buffer;
+// Writes the decimal form of value at the end of buffer, without allocating,
+// and returns its start.
+static char const* integerToChars(LargestInt value,
+                                  UIntToStringBuffer& buffer) {
   char* current = buffer + sizeof(buffer);
-  if (value == Value::minLargestInt) {
-    uintToString(LargestUInt(Value::maxLargestInt) + 1, current);
-    *--current = '-';
-  } else if (value < 0) {
-    uintToString(LargestUInt(-value), current);
-    *--current = '-';
-  } else {
-    uintToString(LargestUInt(value), current);
-  }
+  intToString(value, current);
   assert(current >= buffer);
   return current;
 }
 
-String valueToString(LargestUInt value) {
-  UIntToStringBuffer buffer;
+static char const* integerToChars(LargestUInt value,
+                                  UIntToStringBuffer& buffer) {
   char* current = buffer + sizeof(buffer);
   uintToString(value, current);
   assert(current >= buffer);
   return current;
 }
 
+String valueToString(LargestInt value) {
+  UIntToStringBuffer buffer;
+  return integerToChars(value, buffer);
+}
+
+String valueToString(LargestUInt value) {
+  UIntToStringBuffer buffer;
+  return integerToChars(value, buffer);
+}
+
 #if defined(JSON_HAS_INT64)
 
 String valueToString(Int value) { return valueToString(LargestInt(value)); }
@@ -122,6 +141,331 @@ String valueToString(UInt value) { return valueToString(LargestUInt(value)); }
 #endif // # if defined(JSON_HAS_INT64)
 
 namespace {
+// Shortest round-trip formatting of doubles, with the Grisu3 algorithm of
+// Florian Loitsch, "Printing Floating-Point Numbers Quickly and Accurately with
+// Integers" (PLDI 2010). It finds the shortest digits, or detects the rare
+// cases (about 0.5%) where its 64-bit arithmetic cannot tell, which then fall
+// back to snprintf().
+
+// A floating-point number f * 2^e.
+struct DiyFp {
+  std::uint64_t f;
+  int e;
+};
+
+// x - y, for x >= y of the same exponent.
+DiyFp diyFpSub(DiyFp x, DiyFp y) { return {x.f - y.f, x.e}; }
+
+// x * y, rounded to the upper 64 bits of the product.
+DiyFp diyFpMul(DiyFp x, DiyFp y) {
+  std::uint64_t const xLo = x.f & 0xFFFFFFFFu;
+  std::uint64_t const xHi = x.f >> 32;
+  std::uint64_t const yLo = y.f & 0xFFFFFFFFu;
+  std::uint64_t const yHi = y.f >> 32;
+  std::uint64_t const loLo = xLo * yLo;
+  std::uint64_t const loHi = xLo * yHi;
+  std::uint64_t const hiLo = xHi * yLo;
+  std::uint64_t const hiHi = xHi * yHi;
+  std::uint64_t mid = (loLo >> 32) + (loHi & 0xFFFFFFFFu) +
+                      (hiLo & 0xFFFFFFFFu) + (std::uint64_t(1) << 31);
+  return {hiHi + (loHi >> 32) + (hiLo >> 32) + (mid >> 32), x.e + y.e + 64};
+}
+
+DiyFp diyFpNormalize(DiyFp x) {
+  while ((x.f >> 63) == 0) {
+    x.f <<= 1;
+    --x.e;
+  }
+  return x;
+}
+
+// Normalized powers of ten: 10^k ~= f * 2^e, for k = -300, -292, ..., 324.
+struct CachedPower {
+  std::uint64_t f;
+  int e;
+  int k;
+};
+const CachedPower cachedPowers[] = {
+    {0xAB70FE17C79AC6CA, -1060, -300},
+    {0xFF77B1FCBEBCDC4F, -1034, -292},
+    {0xBE5691EF416BD60C, -1007, -284},
+    {0x8DD01FAD907FFC3C, -980, -276},
+    {0xD3515C2831559A83, -954, -268},
+    {0x9D71AC8FADA6C9B5, -927, -260},
+    {0xEA9C227723EE8BCB, -901, -252},
+    {0xAECC49914078536D, -874, -244},
+    {0x823C12795DB6CE57, -847, -236},
+    {0xC21094364DFB5637, -821, -228},
+    {0x9096EA6F3848984F, -794, -220},
+    {0xD77485CB25823AC7, -768, -212},
+    {0xA086CFCD97BF97F4, -741, -204},
+    {0xEF340A98172AACE5, -715, -196},
+    {0xB23867FB2A35B28E, -688, -188},
+    {0x84C8D4DFD2C63F3B, -661, -180},
+    {0xC5DD44271AD3CDBA, -635, -172},
+    {0x936B9FCEBB25C996, -608, -164},
+    {0xDBAC6C247D62A584, -582, -156},
+    {0xA3AB66580D5FDAF6, -555, -148},
+    {0xF3E2F893DEC3F126, -529, -140},
+    {0xB5B5ADA8AAFF80B8, -502, -132},
+    {0x87625F056C7C4A8B, -475, -124},
+    {0xC9BCFF6034C13053, -449, -116},
+    {0x964E858C91BA2655, -422, -108},
+    {0xDFF9772470297EBD, -396, -100},
+    {0xA6DFBD9FB8E5B88F, -369, -92},
+    {0xF8A95FCF88747D94, -343, -84},
+    {0xB94470938FA89BCF, -316, -76},
+    {0x8A08F0F8BF0F156B, -289, -68},
+    {0xCDB02555653131B6, -263, -60},
+    {0x993FE2C6D07B7FAC, -236, -52},
+    {0xE45C10C42A2B3B06, -210, -44},
+    {0xAA242499697392D3, -183, -36},
+    {0xFD87B5F28300CA0E, -157, -28},
+    {0xBCE5086492111AEB, -130, -20},
+    {0x8CBCCC096F5088CC, -103, -12},
+    {0xD1B71758E219652C, -77, -4},
+    {0x9C40000000000000, -50, 4},
+    {0xE8D4A51000000000, -24, 12},
+    {0xAD78EBC5AC620000, 3, 20},
+    {0x813F3978F8940984, 30, 28},
+    {0xC097CE7BC90715B3, 56, 36},
+    {0x8F7E32CE7BEA5C70, 83, 44},
+    {0xD5D238A4ABE98068, 109, 52},
+    {0x9F4F2726179A2245, 136, 60},
+    {0xED63A231D4C4FB27, 162, 68},
+    {0xB0DE65388CC8ADA8, 189, 76},
+    {0x83C7088E1AAB65DB, 216, 84},
+    {0xC45D1DF942711D9A, 242, 92},
+    {0x924D692CA61BE758, 269, 100},
+    {0xDA01EE641A708DEA, 295, 108},
+    {0xA26DA3999AEF774A, 322, 116},
+    {0xF209787BB47D6B85, 348, 124},
+    {0xB454E4A179DD1877, 375, 132},
+    {0x865B86925B9BC5C2, 402, 140},
+    {0xC83553C5C8965D3D, 428, 148},
+    {0x952AB45CFA97A0B3, 455, 156},
+    {0xDE469FBD99A05FE3, 481, 164},
+    {0xA59BC234DB398C25, 508, 172},
+    {0xF6C69A72A3989F5C, 534, 180},
+    {0xB7DCBF5354E9BECE, 561, 188},
+    {0x88FCF317F22241E2, 588, 196},
+    {0xCC20CE9BD35C78A5, 614, 204},
+    {0x98165AF37B2153DF, 641, 212},
+    {0xE2A0B5DC971F303A, 667, 220},
+    {0xA8D9D1535CE3B396, 694, 228},
+    {0xFB9B7CD9A4A7443C, 720, 236},
+    {0xBB764C4CA7A44410, 747, 244},
+    {0x8BAB8EEFB6409C1A, 774, 252},
+    {0xD01FEF10A657842C, 800, 260},
+    {0x9B10A4E5E9913129, 827, 268},
+    {0xE7109BFBA19C0C9D, 853, 276},
+    {0xAC2820D9623BF429, 880, 284},
+    {0x80444B5E7AA7CF85, 907, 292},
+    {0xBF21E44003ACDD2D, 933, 300},
+    {0x8E679C2F5E44FF8F, 960, 308},
+    {0xD433179D9C8CB841, 986, 316},
+    {0x9E19DB92B4E31BA9, 1013, 324},
+};
+
+// A cached power c such that alpha <= e + c.e + 64 <= gamma, with
+// alpha = -60 and gamma = -32, so that digits can be generated from the
+// upper 32 bits.
+CachedPower cachedPowerForBinaryExponent(int e) {
+  int const f = -60 - e - 1;
+  // ceil(f * log10(2))
+  int const k = (f * 78913) / (1 << 18) + (f > 0);
+  int const index = (300 + k + 7) / 8;
+  return cachedPowers[index];
+}
+
+// The number of decimal digits of n, and the largest power of 10 <= n.
+int largestPow10(std::uint32_t n, std::uint32_t& pow10) {
+  int digits = 10;
+  pow10 = 1000000000;
+  while (pow10 > n) {
+    pow10 /= 10;
+    --digits;
+  }
+  return digits;
+}
+
+// Moves the last digit down towards w, while staying within the unsafe
+// interval, then tells whether the digits are certainly the shortest and
+// closest despite the imprecision (unit) of the scaled boundaries.
+bool grisuRoundWeed(char* digits, int length, std::uint64_t distanceTooHighW,
+                    std::uint64_t unsafeInterval, std::uint64_t rest,
+                    std::uint64_t tenKappa, std::uint64_t unit) {
+  std::uint64_t const smallDistance = distanceTooHighW - unit;
+  std::uint64_t const bigDistance = distanceTooHighW + unit;
+  while (rest < smallDistance && unsafeInterval - rest >= tenKappa &&
+         (rest + tenKappa < smallDistance ||
+          smallDistance - rest >= rest + tenKappa - smallDistance)) {
+    --digits[length - 1];
+    rest += tenKappa;
+  }
+  if (rest < bigDistance && unsafeInterval - rest >= tenKappa &&
+      (rest + tenKappa < bigDistance ||
+       bigDistance - rest > rest + tenKappa - bigDistance))
+    return false;
+  return 2 * unit <= rest && rest <= unsafeInterval - 4 * unit;
+}
+
+// Generates the shortest digits of a number between low and high, which are
+// scaled with w so that their exponent is in [alpha, gamma]. Returns false
+// when they cannot be told for sure.
+bool grisuDigits(char* digits, int& length, int& kappa, DiyFp low, DiyFp w,
+                 DiyFp high) {
+  std::uint64_t unit = 1;
+  DiyFp const tooLow = {low.f - unit, low.e};
+  DiyFp const tooHigh = {high.f + unit, high.e};
+  std::uint64_t unsafeInterval = diyFpSub(tooHigh, tooLow).f;
+  DiyFp const one = {std::uint64_t(1) << -w.e, w.e};
+  auto integrals = static_cast<std::uint32_t>(tooHigh.f >> -one.e);
+  std::uint64_t fractionals = tooHigh.f & (one.f - 1);
+  std::uint32_t divisor;
+  kappa = largestPow10(integrals, divisor);
+  length = 0;
+  while (kappa > 0) {
+    digits[length++] = static_cast<char>('0' + integrals / divisor);
+    integrals %= divisor;
+    --kappa;
+    std::uint64_t const rest =
+        (std::uint64_t(integrals) << -one.e) + fractionals;
+    if (rest < unsafeInterval)
+      return grisuRoundWeed(digits, length, diyFpSub(tooHigh, w).f,
+                            unsafeInterval, rest,
+                            std::uint64_t(divisor) << -one.e, unit);
+    divisor /= 10;
+  }
+  for (;;) {
+    fractionals *= 10;
+    unit *= 10;
+    unsafeInterval *= 10;
+    digits[length++] = static_cast<char>('0' + (fractionals >> -one.e));
+    fractionals &= one.f - 1;
+    --kappa;
+    if (fractionals < unsafeInterval)
+      return grisuRoundWeed(digits, length, diyFpSub(tooHigh, w).f * unit,
+                            unsafeInterval, fractionals, one.f, unit);
+  }
+}
+
+// Writes value correctly rounded to precision significant digits, and
+// returns the exponent such that value ~= digits * 10^exponent.
+int exactDigits(double value, int precision, char* digits) {
+  char buffer[32];
+  jsoncpp_snprintf(buffer, sizeof(buffer), "%.*e", precision - 1, value);
+  // d[.ddd]e[+-]xx, with a decimal point that depends on the locale.
+  char const* p = buffer;
+  int count = 0;
+  for (; *p != 'e'; ++p)
+    if (*p >= '0' && *p <= '9')
+      digits[count++] = *p;
+  return atoi(p + 1) - (precision - 1);
+}
+
+// Writes the shortest digits that read back as value, which must be finite
+// and positive, to digits (which must hold 17), so that
+// value == digits * 10^exponent. Returns their count.
+int shortestDigits(double value, char* digits, int& exponent) {
+  std::uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  std::uint64_t const hiddenBit = std::uint64_t(1) << 52;
+  std::uint64_t const fraction = bits & (hiddenBit - 1);
+  auto const biasedExponent = static_cast<int>(bits >> 52);
+  DiyFp const v = biasedExponent == 0
+                      ? DiyFp{fraction, 1 - 1075}
+                      : DiyFp{fraction + hiddenBit, biasedExponent - 1075};
+  DiyFp const w = diyFpNormalize(v);
+  // The boundaries halfway to the neighbouring doubles. The lower one is
+  // closer when v is a power of two (other than the smallest normal).
+  DiyFp const plus = diyFpNormalize({2 * v.f + 1, v.e - 1});
+  DiyFp minus = fraction == 0 && biasedExponent > 1
+                    ? DiyFp{4 * v.f - 1, v.e - 2}
+                    : DiyFp{2 * v.f - 1, v.e - 1};
+  minus.f <<= minus.e - plus.e;
+  minus.e = plus.e;
+
+  CachedPower const cached = cachedPowerForBinaryExponent(w.e);
+  DiyFp const c = {cached.f, cached.e};
+  int length;
+  int kappa;
+  if (grisuDigits(digits, length, kappa, diyFpMul(minus, c), diyFpMul(w, c),
+                  diyFpMul(plus, c))) {
+    exponent = kappa - cached.k;
+    return length;
+  }
+
+  // Fall back to the shortest correctly rounded digits that read back as
+  // value, formatted without a (locale-dependent) decimal point.
+  char buffer[32];
+  int low = 1;
+  int high = 17;
+  while (low < high) {
+    int const precision = (low + high) / 2;
+    int const e = exactDigits(value, precision, buffer);
+    jsoncpp_snprintf(buffer + precision,
+                     sizeof(buffer) - static_cast<size_t>(precision), "e%d", e);
+    if (strtod(buffer, nullptr) == value)
+      high = precision;
+    else
+      low = precision + 1;
+  }
+  exponent = exactDigits(value, low, digits);
+  // Trailing zeros are not significant.
+  while (low > 1 && digits[low - 1] == '0') {
+    --low;
+    ++exponent;
+  }
+  return low;
+}
+
+// Formats value with the shortest digits that read back as it, laid out like
+// "%.17g" (and with ".0" for integers, as valueToString() does).
+String valueToShortestString(double value) {
+  String result;
+  if (std::signbit(value)) {
+    result += '-';
+    value = -value;
+  }
+  if (value == 0) {
+    result += "0.0";
+    return result;
+  }
+  char digits[17];
+  int exponent;
+  int const length = shortestDigits(value, digits, exponent);
+  // value == 0.digits * 10^point
+  int const point = length + exponent;
+  if (point > 17 || point < -3) {
+    result += digits[0];
+    if (length > 1) {
+      result += '.';
+      result.append(digits + 1, digits + length);
+    }
+    int const e = point - 1;
+    result += e < 0 ? "e-" : "e+";
+    unsigned int const absE = static_cast<unsigned int>(e < 0 ? -e : e);
+    if (absE >= 100)
+      result += static_cast<char>('0' + absE / 100);
+    result += static_cast<char>('0' + absE / 10 % 10);
+    result += static_cast<char>('0' + absE % 10);
+  } else if (point >= length) {
+    result.append(digits, digits + length);
+    result.append(static_cast<size_t>(point - length), '0');
+    result += ".0";
+  } else if (point > 0) {
+    result.append(digits, digits + point);
+    result += '.';
+    result.append(digits + point, digits + length);
+  } else {
+    result += "0.";
+    result.append(static_cast<size_t>(-point), '0');
+    result.append(digits, digits + length);
+  }
+  return result;
+}
+
 String valueToString(double value, bool useSpecialFloats,
                      unsigned int precision, PrecisionType precisionType) {
   // Print into the buffer. We need not request the alternative representation
@@ -133,6 +477,27 @@ String valueToString(double value, bool useSpecialFloats,
     return reps[useSpecialFloats ? 0 : 1]
                [isnan(value) ? 0 : (value < 0) ? 1 : 2];
   }
+  if (precisionType == PrecisionType::shortest)
+    return valueToShortestString(value);
+
+#if defined(JSON_HAS_INT64)
+  // Integers below 2^53 are printed exactly, as snprintf() would unless it
+  // has to round them to fewer significant digits.
+  if (value == std::floor(value) && std::fabs(value) < 9007199254740992.0 &&
+      value != 0) {
+    UIntToStringBuffer buffer;
+    char* current = buffer + sizeof(buffer);
+    uintToString(static_cast<LargestUInt>(std::fabs(value)), current);
+    if (precisionType == PrecisionType::decimalPlaces ||
+        strlen(current) <= precision) {
+      if (value < 0)
+        *--current = '-';
+      String result(current);
+      result += ".0";
+      return result;
+    }
+  }
+#endif
 
   String buffer(size_t(36), '\0');
   while (true) {
@@ -173,16 +538,40 @@ String valueToString(double value, unsigned int precision,
 
 String valueToString(bool value) { return value ? "true" : "false"; }
 
-static bool isAnyCharRequiredQuoting(char const* s, size_t n) {
-  assert(s || !n);
+// Whether any byte of the word is a quote, a backslash, a control character
+// or, unless emitUTF8, not ASCII: the bytes that valueToQuotedStringN() may
+// not copy as is. Each test is exact for the word as a whole (see "Determine
+// if a word has a zero byte" in Sean Anderson's "Bit Twiddling Hacks").
+static inline bool wordRequiresEscape(std::uint64_t word, bool emitUTF8) {
+  std::uint64_t const ones = ~std::uint64_t(0) / 0xFF;
+  std::uint64_t const highBits = ones * 0x80;
+  std::uint64_t const quotes = word ^ (ones * '"');
+  std::uint64_t const backslashes = word ^ (ones * '\\');
+  std::uint64_t found = ((quotes - ones) & ~quotes) |
+                        ((backslashes - ones) & ~backslashes) |
+                        ((word - ones * 0x20) & ~word);
+  if (!emitUTF8)
+    found |= word;
+  return (found & highBits) != 0;
+}
 
-  char const* const end = s + n;
-  for (char const* cur = s; cur < end; ++cur) {
-    if (*cur == '\\' || *cur == '\"' || *cur < ' ' ||
-        static_cast<unsigned char>(*cur) < 0x80)
-      return true;
+// The first byte of [s, end) that cannot be copied as is, or end. Clean runs
+// are skipped 8 bytes at a time.
+static char const* findCharRequiringEscape(char const* s, char const* end,
+                                           bool emitUTF8) {
+  while (end - s >= 8) {
+    std::uint64_t word;
+    memcpy(&word, s, sizeof(word));
+    if (wordRequiresEscape(word, emitUTF8))
+      break;
+    s += 8;
+  }
+  for (; s != end; ++s) {
+    auto const c = static_cast<unsigned char>(*s);
+    if (c == '"' || c == '\\' || c < 0x20 || (c >= 0x80 && !emitUTF8))
+      return s;
   }
-  return false;
+  return end;
 }
 
 static unsigned int utf8ToCodepoint(const char*& s, const char* e) {
@@ -253,66 +642,58 @@ static const char hex2[] = "000102030405060708090a0b0c0d0e0f"
                            "e0e1e2e3e4e5e6e7e8e9eaebecedeeef"
                            "f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
 
-static String toHex16Bit(unsigned int x) {
+// Appends the \u escape sequence of x, a UTF-16 code unit.
+template <typename Output> static void appendHex16Bit(Output& out, unsigned x) {
   const unsigned int hi = (x >> 8) & 0xff;
   const unsigned int lo = x & 0xff;
-  String result(4, ' ');
-  result[0] = hex2[2 * hi];
-  result[1] = hex2[2 * hi + 1];
-  result[2] = hex2[2 * lo];
-  result[3] = hex2[2 * lo + 1];
-  return result;
+  char const sequence[6] = {'\\',        'u',
+                            hex2[2 * hi], hex2[2 * hi + 1],
+                            hex2[2 * lo], hex2[2 * lo + 1]};
+  out.append(sequence, sizeof(sequence));
 }
 
-static String valueToQuotedStringN(const char* value, unsigned length,
-                                   bool emitUTF8 = false) {
-  if (value == nullptr)
-    return "";
-
-  if (!isAnyCharRequiredQuoting(value, length))
-    return String("\"") + value + "\"";
-  // We have to walk value and escape any special characters.
-  // Appending to String is not efficient, but this should be rare.
-  // (Note: forward slashes are *not* rare, but I am not escaping them.)
-  String::size_type maxsize = length * 2 + 3; // allescaped+quotes+NULL
-  String result;
-  result.reserve(maxsize); // to avoid lots of mallocs
-  result += "\"";
-  char const* end = value + length;
-  for (const char* c = value; c != end; ++c) {
+// Appends the escaped form of [value, value + length), without its quotes.
+// Output is a String or an OutputBuffer. Runs of bytes that need no escaping
+// are found a word at a time and copied in bulk.
+template <typename Output>
+static void appendEscaped(Output& out, const char* value, size_t length,
+                          bool emitUTF8) {
+  char const* const end = value + length;
+  for (char const* c = value;; ++c) {
+    char const* const special = findCharRequiringEscape(c, end, emitUTF8);
+    if (special != c)
+      out.append(c, static_cast<size_t>(special - c));
+    if (special == end)
+      return;
+    c = special;
     switch (*c) {
     case '\"':
-      result += "\\\"";
+      out.append("\\\"", 2);
       break;
     case '\\':
-      result += "\\\\";
+      out.append("\\\\", 2);
       break;
     case '\b':
-      result += "\\b";
+      out.append("\\b", 2);
       break;
     case '\f':
-      result += "\\f";
+      out.append("\\f", 2);
       break;
     case '\n':
-      result += "\\n";
+      out.append("\\n", 2);
       break;
     case '\r':
-      result += "\\r";
+      out.append("\\r", 2);
       break;
     case '\t':
-      result += "\\t";
+      out.append("\\t", 2);
       break;
-    // case '/':
     // Even though \/ is considered a legal escape in JSON, a bare
-    // slash is also legal, so I see no reason to escape it.
-    // (I hope I am not misunderstanding something.)
-    // blep notes: actually escaping \/ may be useful in javascript to avoid </
-    // sequence.
-    // Should add a flag to allow this compatibility mode and prevent this
-    // sequence from occurring.
+    // slash is also legal, so it is not escaped.
     default: {
       if (emitUTF8) {
-        result += *c;
+        // A control character, written as is.
+        out.append(c, 1);
       } else {
         unsigned int codepoint = utf8ToCodepoint(c, end);
         const unsigned int FIRST_NON_CONTROL_CODEPOINT = 0x20;
@@ -322,25 +703,39 @@ static String valueToQuotedStringN(const char* value, unsigned length,
         // (short escape sequence are applied above)
         if (FIRST_NON_CONTROL_CODEPOINT <= codepoint &&
             codepoint <= LAST_NON_CONTROL_CODEPOINT) {
-          result += static_cast<char>(codepoint);
+          char const ascii = static_cast<char>(codepoint);
+          out.append(&ascii, 1);
         } else if (codepoint <
                    FIRST_SURROGATE_PAIR_CODEPOINT) { // codepoint is in Basic
                                                      // Multilingual Plane
-          result += "\\u";
-          result += toHex16Bit(codepoint);
+          appendHex16Bit(out, codepoint);
         } else { // codepoint is not in Basic Multilingual Plane
                  // convert to surrogate pair first
           codepoint -= FIRST_SURROGATE_PAIR_CODEPOINT;
-          result += "\\u";
-          result += toHex16Bit((codepoint >> 10) + 0xD800);
-          result += "\\u";
-          result += toHex16Bit((codepoint & 0x3FF) + 0xDC00);
+          appendHex16Bit(out, (codepoint >> 10) + 0xD800);
+          appendHex16Bit(out, (codepoint & 0x3FF) + 0xDC00);
         }
       }
     } break;
     }
   }
-  result += "\"";
+}
+
+template <typename Output>
+static void appendQuotedString(Output& out, const char* value, size_t length,
+                               bool emitUTF8) {
+  out.append("\"", 1);
+  appendEscaped(out, value, length, emitUTF8);
+  out.append("\"", 1);
+}
+
+static String valueToQuotedStringN(const char* value, unsigned length,
+                                   bool emitUTF8 = false) {
+  if (value == nullptr)
+    return "";
+  String result;
+  result.reserve(length + 2);
+  appendQuotedString(result, value, length, emitUTF8);
   return result;
 }
 
@@ -348,6 +743,93 @@ String valueToQuotedString(const char* value) {
   return valueToQuotedStringN(value, static_cast<unsigned int>(strlen(value)));
 }
 
+// Reads the 4 lowercase hex digits of a unicode escape sequence.
+static bool decodeLowerHex16Bit(const char* s, const char* end,
+                                unsigned int& x) {
+  if (end - s < 4)
+    return false;
+  x = 0;
+  for (int index = 0; index < 4; ++index) {
+    char const c = s[index];
+    if (c >= '0' && c <= '9')
+      x = x * 16 + static_cast<unsigned int>(c - '0');
+    else if (c >= 'a' && c <= 'f')
+      x = x * 16 + static_cast<unsigned int>(c - 'a' + 10);
+    else
+      return false;
+  }
+  return true;
+}
+
+// Whether valueToQuotedStringN() escapes the control character c as \b, \f,
+// \n, \r or \t.
+static bool isShortEscaped(unsigned int c) {
+  return c == '\b' || c == '\f' || c == '\n' || c == '\r' || c == '\t';
+}
+
+// Whether the escaped content of a string is what valueToQuotedStringN()
+// would produce for the decoded string.
+static bool isEscapedAsWritten(const char* s, const char* end, bool emitUTF8) {
+  while (s != end) {
+    unsigned char const c = static_cast<unsigned char>(*s++);
+    if (c != '\\') {
+      if (c < 0x20 ? !emitUTF8 || isShortEscaped(c) : c >= 0x80 && !emitUTF8)
+        return false;
+      continue;
+    }
+    char const escape = *s++;
+    if (escape != 'u') {
+      if (escape == '/')
+        return false;
+      continue;
+    }
+    unsigned int codepoint;
+    if (emitUTF8 || !decodeLowerHex16Bit(s, end, codepoint))
+      return false;
+    s += 4;
+    if (codepoint < 0x20) {
+      if (isShortEscaped(codepoint))
+        return false;
+    } else if (codepoint < 0x80 ||
+               (codepoint >= 0xDC00 && codepoint <= 0xDFFF)) {
+      return false;
+    } else if (codepoint >= 0xD800 && codepoint <= 0xDBFF) {
+      if (end - s < 6 || s[0] != '\\' || s[1] != 'u' ||
+          !decodeLowerHex16Bit(s + 2, end, codepoint) || codepoint < 0xDC00 ||
+          codepoint > 0xDFFF)
+        return false;
+      s += 6;
+    }
+  }
+  return true;
+}
+
+// Appends a quoted string value, reusing its escaped form from the document
+// text when it was parsed with "lazyUnescape" and is escaped as it would be
+// written.
+template <typename Output>
+static void appendQuotedStringValue(Output& out, const Value& value,
+                                    bool emitUTF8) {
+  char const* str;
+  char const* end;
+  if (value.getEscapedString(&str, &end) &&
+      isEscapedAsWritten(str, end, emitUTF8)) {
+    out.append("\"", 1);
+    out.append(str, static_cast<size_t>(end - str));
+    out.append("\"", 1);
+    return;
+  }
+  // Is NULL possible for value.string_? No.
+  if (value.getString(&str, &end))
+    appendQuotedString(out, str, static_cast<size_t>(end - str), emitUTF8);
+}
+
+static String quotedStringValue(const Value& value, bool emitUTF8 = false) {
+  String result;
+  appendQuotedStringValue(result, value, emitUTF8);
+  return result;
+}
+
 // Class Writer
 // //////////////////////////////////////////////////////////////////
 Writer::~Writer() = default;
@@ -374,29 +856,34 @@ String FastWriter::write(const Value& root) {
 }
 
 void FastWriter::writeValue(const Value& value) {
+  // Numbers read with "lazyNumbers", and raw fragments, are written back
+  // verbatim.
+  char const* literal;
+  char const* literalEnd;
+  if (value.getNumberText(&literal, &literalEnd) ||
+      value.getRawText(&literal, &literalEnd)) {
+    document_.append(literal, literalEnd);
+    return;
+  }
   switch (value.type()) {
   case nullValue:
     if (!dropNullPlaceholders_)
       document_ += "null";
     break;
-  case intValue:
-    document_ += valueToString(value.asLargestInt());
-    break;
-  case uintValue:
-    document_ += valueToString(value.asLargestUInt());
-    break;
+  case intValue: {
+    UIntToStringBuffer buffer;
+    document_ += integerToChars(value.asLargestInt(), buffer);
+  } break;
+  case uintValue: {
+    UIntToStringBuffer buffer;
+    document_ += integerToChars(value.asLargestUInt(), buffer);
+  } break;
   case realValue:
     document_ += valueToString(value.asDouble());
     break;
-  case stringValue: {
-    // Is NULL possible for value.string_? No.
-    char const* str;
-    char const* end;
-    bool ok = value.getString(&str, &end);
-    if (ok)
-      document_ += valueToQuotedStringN(str, static_cast<unsigned>(end - str));
+  case stringValue:
+    document_ += quotedStringValue(value);
     break;
-  }
   case booleanValue:
     document_ += valueToString(value.asBool());
     break;
@@ -411,16 +898,16 @@ void FastWriter::writeValue(const Value& value) {
     document_ += ']';
   } break;
   case objectValue: {
-    Value::Members members(value.getMemberNames());
     document_ += '{';
-    for (auto it = members.begin(); it != members.end(); ++it) {
-      const String& name = *it;
-      if (it != members.begin())
+    for (auto it = value.begin(); it != value.end(); ++it) {
+      char const* nameEnd;
+      char const* name = it.memberName(&nameEnd);
+      if (it != value.begin())
         document_ += ',';
-      document_ += valueToQuotedStringN(name.data(),
-                                        static_cast<unsigned>(name.length()));
+      appendQuotedString(document_, name, static_cast<size_t>(nameEnd - name),
+                         false);
       document_ += yamlCompatibilityEnabled_ ? ": " : ":";
-      writeValue(value[name]);
+      writeValue(*it);
     }
     document_ += '}';
   } break;
@@ -444,6 +931,13 @@ String StyledWriter::write(const Value& root) {
 }
 
 void StyledWriter::writeValue(const Value& value) {
+  char const* literal;
+  char const* literalEnd;
+  if (value.getNumberText(&literal, &literalEnd) ||
+      value.getRawText(&literal, &literalEnd)) {
+    pushValue(String(literal, literalEnd));
+    return;
+  }
   switch (value.type()) {
   case nullValue:
     pushValue("null");
@@ -457,17 +951,9 @@ void StyledWriter::writeValue(const Value& value) {
   case realValue:
     pushValue(valueToString(value.asDouble()));
     break;
-  case stringValue: {
-    // Is NULL possible for value.string_? No.
-    char const* str;
-    char const* end;
-    bool ok = value.getString(&str, &end);
-    if (ok)
-      pushValue(valueToQuotedStringN(str, static_cast<unsigned>(end - str)));
-    else
-      pushValue("");
+  case stringValue:
+    pushValue(quotedStringValue(value));
     break;
-  }
   case booleanValue:
     pushValue(valueToString(value.asBool()));
     break;
@@ -475,21 +961,23 @@ void StyledWriter::writeValue(const Value& value) {
     writeArrayValue(value);
     break;
   case objectValue: {
-    Value::Members members(value.getMemberNames());
-    if (members.empty())
+    if (value.empty())
       pushValue("{}");
     else {
       writeWithIndent("{");
       indent();
-      auto it = members.begin();
+      auto it = value.begin();
       for (;;) {
-        const String& name = *it;
-        const Value& childValue = value[name];
+        char const* nameEnd;
+        char const* name = it.memberName(&nameEnd);
+        const Value& childValue = *it;
         writeCommentBeforeValue(childValue);
-        writeWithIndent(valueToQuotedString(name.c_str()));
+        writeIndent();
+        appendQuotedString(document_, name,
+                           static_cast<size_t>(nameEnd - name), false);
         document_ += " : ";
         writeValue(childValue);
-        if (++it == members.end()) {
+        if (++it == value.end()) {
           writeCommentAfterValueOnSameLine(childValue);
           break;
         }
@@ -512,12 +1000,12 @@ void StyledWriter::writeArrayValue(const Value& value) {
     if (isArrayMultiLine) {
       writeWithIndent("[");
       indent();
-      bool hasChildValue = !childValues_.empty();
+      ArrayIndex const measured = static_cast<ArrayIndex>(childValues_.size());
       unsigned index = 0;
       for (;;) {
         const Value& childValue = value[index];
         writeCommentBeforeValue(childValue);
-        if (hasChildValue)
+        if (index < measured)
           writeWithIndent(childValues_[index]);
         else {
           writeIndent();
@@ -555,20 +1043,22 @@ bool StyledWriter::isMultilineArray(const Value& value) {
     isMultiLine = ((childValue.isArray() || childValue.isObject()) &&
                    !childValue.empty());
   }
+  for (ArrayIndex index = 0; index < size && !isMultiLine; ++index)
+    isMultiLine = hasCommentForValue(value[index]);
   if (!isMultiLine) // check if line length > max line length
   {
+    // Stop as soon as the line is too long: writeArrayValue() writes the
+    // elements measured so far from childValues_ and formats the rest.
     childValues_.reserve(size);
     addChildValues_ = true;
     ArrayIndex lineLength = 4 + (size - 1) * 2; // '[ ' + ', '*n + ' ]'
-    for (ArrayIndex index = 0; index < size; ++index) {
-      if (hasCommentForValue(value[index])) {
-        isMultiLine = true;
-      }
+    for (ArrayIndex index = 0; index < size && lineLength < rightMargin_;
+         ++index) {
       writeValue(value[index]);
       lineLength += static_cast<ArrayIndex>(childValues_[index].length());
     }
     addChildValues_ = false;
-    isMultiLine = isMultiLine || lineLength >= rightMargin_;
+    isMultiLine = lineLength >= rightMargin_;
   }
   return isMultiLine;
 }
@@ -662,6 +1152,13 @@ void StyledStreamWriter::write(OStream& out, const Value& root) {
 }
 
 void StyledStreamWriter::writeValue(const Value& value) {
+  char const* literal;
+  char const* literalEnd;
+  if (value.getNumberText(&literal, &literalEnd) ||
+      value.getRawText(&literal, &literalEnd)) {
+    pushValue(String(literal, literalEnd));
+    return;
+  }
   switch (value.type()) {
   case nullValue:
     pushValue("null");
@@ -675,17 +1172,9 @@ void StyledStreamWriter::writeValue(const Value& value) {
   case realValue:
     pushValue(valueToString(value.asDouble()));
     break;
-  case stringValue: {
-    // Is NULL possible for value.string_? No.
-    char const* str;
-    char const* end;
-    bool ok = value.getString(&str, &end);
-    if (ok)
-      pushValue(valueToQuotedStringN(str, static_cast<unsigned>(end - str)));
-    else
-      pushValue("");
+  case stringValue:
+    pushValue(quotedStringValue(value));
     break;
-  }
   case booleanValue:
     pushValue(valueToString(value.asBool()));
     break;
@@ -693,21 +1182,22 @@ void StyledStreamWriter::writeValue(const Value& value) {
     writeArrayValue(value);
     break;
   case objectValue: {
-    Value::Members members(value.getMemberNames());
-    if (members.empty())
+    if (value.empty())
       pushValue("{}");
     else {
       writeWithIndent("{");
       indent();
-      auto it = members.begin();
+      auto it = value.begin();
       for (;;) {
-        const String& name = *it;
-        const Value& childValue = value[name];
+        char const* nameEnd;
+        char const* name = it.memberName(&nameEnd);
+        const Value& childValue = *it;
         writeCommentBeforeValue(childValue);
-        writeWithIndent(valueToQuotedString(name.c_str()));
+        writeWithIndent(valueToQuotedStringN(
+            name, static_cast<unsigned>(nameEnd - name)));
         *document_ << " : ";
         writeValue(childValue);
-        if (++it == members.end()) {
+        if (++it == value.end()) {
           writeCommentAfterValueOnSameLine(childValue);
           break;
         }
@@ -730,12 +1220,12 @@ void StyledStreamWriter::writeArrayValue(const Value& value) {
     if (isArrayMultiLine) {
       writeWithIndent("[");
       indent();
-      bool hasChildValue = !childValues_.empty();
+      ArrayIndex const measured = static_cast<ArrayIndex>(childValues_.size());
       unsigned index = 0;
       for (;;) {
         const Value& childValue = value[index];
         writeCommentBeforeValue(childValue);
-        if (hasChildValue)
+        if (index < measured)
           writeWithIndent(childValues_[index]);
         else {
           if (!indented_)
@@ -776,20 +1266,22 @@ bool StyledStreamWriter::isMultilineArray(const Value& value) {
     isMultiLine = ((childValue.isArray() || childValue.isObject()) &&
                    !childValue.empty());
   }
+  for (ArrayIndex index = 0; index < size && !isMultiLine; ++index)
+    isMultiLine = hasCommentForValue(value[index]);
   if (!isMultiLine) // check if line length > max line length
   {
+    // Stop as soon as the line is too long: writeArrayValue() writes the
+    // elements measured so far from childValues_ and formats the rest.
     childValues_.reserve(size);
     addChildValues_ = true;
     ArrayIndex lineLength = 4 + (size - 1) * 2; // '[ ' + ', '*n + ' ]'
-    for (ArrayIndex index = 0; index < size; ++index) {
-      if (hasCommentForValue(value[index])) {
-        isMultiLine = true;
-      }
+    for (ArrayIndex index = 0; index < size && lineLength < rightMargin_;
+         ++index) {
       writeValue(value[index]);
       lineLength += static_cast<ArrayIndex>(childValues_[index].length());
     }
     addChildValues_ = false;
-    isMultiLine = isMultiLine || lineLength >= rightMargin_;
+    isMultiLine = lineLength >= rightMargin_;
   }
   return isMultiLine;
 }
@@ -871,19 +1363,300 @@ struct CommentStyle {
   };
 };
 
+// Forwards to an OStream a chunk at a time, so that writing to a stream
+// neither goes through it token by token nor builds the whole document first.
+class OStreamOutputBuffer : public OutputBuffer {
+public:
+  explicit OStreamOutputBuffer(OStream* sout)
+      : OutputBuffer(chunk_, sizeof(chunk_)), sout_(sout) {}
+  ~OStreamOutputBuffer() override { flush(); }
+
+protected:
+  bool makeRoom(size_t /*length*/) override {
+    flush();
+    return true;
+  }
+
+private:
+  void flush() {
+    sout_->write(data(), static_cast<std::streamsize>(size()));
+    setBuffer(chunk_, chunk_, chunk_ + sizeof(chunk_));
+  }
+
+  OStream* sout_;
+  char chunk_[4096];
+};
+
+// Remembers the quoted form of recently written keys that need escaping, so
+// that a key repeated by every object of an array is escaped only once. Keys
+// that need no escaping are cheaper to copy than to look up, and bypass it.
+class EscapedKeyCache {
+public:
+  template <typename Output>
+  void appendQuoted(Output& out, char const* key, char const* end,
+                    bool emitUTF8) {
+    size_t const length = static_cast<size_t>(end - key);
+    if (findCharRequiringEscape(key, end, emitUTF8) == end) {
+      out.append("\"", 1);
+      out.append(key, length);
+      out.append("\"", 1);
+      return;
+    }
+    if (entries_.empty())
+      entries_.resize(entryCount);
+    Entry& entry = entries_[hash(key, end) % entryCount];
+    if (entry.key.size() != length ||
+        memcmp(entry.key.data(), key, length) != 0) {
+      entry.key.assign(key, length);
+      entry.quoted.clear();
+      appendQuotedString(entry.quoted, key, length, emitUTF8);
+    }
+    out.append(entry.quoted.data(), entry.quoted.size());
+  }
+
+private:
+  static const size_t entryCount = 64;
+
+  struct Entry {
+    String key;
+    String quoted;
+  };
+
+  // FNV-1a
+  static size_t hash(char const* key, char const* end) {
+    std::uint32_t h = 2166136261u;
+    for (; key != end; ++key)
+      h = (h ^ static_cast<unsigned char>(*key)) * 16777619u;
+    return h;
+  }
+
+  std::vector<Entry> entries_;
+};
+
+// Threads kept by a writer to write the runs of writeChildrenInParallel(),
+// rather than started anew for each large array or object. They are only
+// started when first needed.
+class WriterThreadPool {
+public:
+  explicit WriterThreadPool(unsigned int threads) : size_(threads) {}
+  WriterThreadPool(WriterThreadPool const&) = delete;
+  WriterThreadPool& operator=(WriterThreadPool const&) = delete;
+  ~WriterThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    wake_.notify_all();
+    for (auto& thread : threads_)
+      thread.join();
+  }
+
+  // Has each thread call job once; wait() returns when all of them have.
+  void start(std::function<void()> job) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    while (threads_.size() < size_)
+      threads_.emplace_back([this] { work(); });
+    job_ = std::move(job);
+    running_ = size_;
+    ++generation_;
+    wake_.notify_all();
+  }
+  void wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return running_ == 0; });
+    job_ = nullptr;
+  }
+
+private:
+  void work() {
+    unsigned long seen = 0;
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+      wake_.wait(lock, [&] { return stopping_ || generation_ != seen; });
+      if (stopping_)
+        return;
+      seen = generation_;
+      std::function<void()> const job = job_;
+      lock.unlock();
+      job();
+      lock.lock();
+      if (--running_ == 0)
+        done_.notify_all();
+    }
+  }
+
+  unsigned int size_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  std::function<void()> job_;
+  unsigned long generation_{0};
+  unsigned int running_{0};
+  bool stopping_{false};
+  std::vector<std::thread> threads_;
+};
+
+// How the "threads" and "parallelThreshold" settings of StreamWriterBuilder
+// split the serialization of large arrays and objects. The writing thread
+// works with the threads - 1 of the pool, which copies of the writer share.
+struct Parallelism {
+  unsigned int threads;
+  ArrayIndex threshold;
+  std::shared_ptr<WriterThreadPool> pool;
+
+  bool appliesTo(Value const& value) const {
+    return threads > 1 && value.size() >= threshold;
+  }
+};
+
+// A run of the children of an array or an object.
+struct ChildRange {
+  ArrayIndex begin;
+  ArrayIndex end;
+  Value::const_iterator first; ///< The member at begin, for objects.
+};
+
+static ChildRange allChildren(Value const& value) {
+  return ChildRange{0, value.size(), value.begin()};
+}
+
+// Splits the children of value into runs, and has writeChildren(range, out)
+// write each of them into a buffer of its own, on the writing thread and the
+// pool's. The buffers are appended to out in order as they complete, so the
+// output is the same as writing all children in sequence if each run is
+// written as it would be there. Runs are short, and at most two per thread
+// are held at once, so the memory used does not grow with the container, and
+// a flushing out (such as FdOutputBuffer) stays bounded.
+template <typename WriteChildren>
+static void writeChildrenInParallel(Value const& value,
+                                    Parallelism const& parallelism,
+                                    OutputBuffer& out,
+                                    WriteChildren writeChildren) {
+  ArrayIndex const maxRunLength = 256;
+  ArrayIndex const threads = parallelism.threads;
+  ArrayIndex const size = value.size();
+  // More runs than threads, so that threads given the cheaper ones go on with
+  // the next instead of waiting.
+  ArrayIndex const runLength = std::max<ArrayIndex>(
+      1, std::min<ArrayIndex>(size / (threads * 4), maxRunLength));
+  ArrayIndex const runCount = (size + runLength - 1) / runLength;
+  std::vector<ChildRange> runs(runCount);
+  Value::const_iterator it = value.begin();
+  for (ArrayIndex run = 0; run != runCount; ++run) {
+    runs[run].begin = run * runLength;
+    runs[run].end = std::min(size - runs[run].begin, runLength) +
+                    runs[run].begin;
+    if (value.isObject()) {
+      runs[run].first = it;
+      for (ArrayIndex i = runs[run].begin; i != runs[run].end; ++i)
+        ++it;
+    }
+  }
+
+  // Runs from appended to appended + window may be written, into
+  // outputs[run % window].
+  ArrayIndex const window = threads * 2;
+  std::vector<String> outputs(window);
+  std::vector<bool> ready(window);
+  ArrayIndex next = 0;
+  ArrayIndex appended = 0;
+  bool failed = false;
+  std::mutex mutex;
+  std::condition_variable changed;
+#if JSON_USE_EXCEPTION
+  std::exception_ptr failure;
+#endif
+  // Writes the next run, with lock held on entry and on return.
+  auto writeNext = [&](std::unique_lock<std::mutex>& lock) {
+    ArrayIndex const run = next++;
+    lock.unlock();
+    StringOutputBuffer buffer;
+#if JSON_USE_EXCEPTION
+    try {
+#endif
+      writeChildren(runs[run], buffer);
+#if JSON_USE_EXCEPTION
+    } catch (...) {
+      lock.lock();
+      if (!failed)
+        failure = std::current_exception();
+      failed = true;
+      changed.notify_all();
+      return;
+    }
+#endif
+    String output = buffer.release();
+    lock.lock();
+    outputs[run % window] = std::move(output);
+    ready[run % window] = true;
+    changed.notify_all();
+  };
+  auto canWrite = [&] { return next != runCount && next - appended < window; };
+  parallelism.pool->start([&] {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+      changed.wait(lock,
+                   [&] { return failed || next == runCount || canWrite(); });
+      if (failed || next == runCount)
+        return;
+      writeNext(lock);
+    }
+  });
+#if JSON_USE_EXCEPTION
+  try {
+#endif
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!failed && appended != runCount) {
+      if (ready[appended % window]) {
+        String const output = std::move(outputs[appended % window]);
+        ready[appended % window] = false;
+        ++appended;
+        changed.notify_all();
+        lock.unlock();
+        out.append(output);
+        lock.lock();
+      } else if (canWrite()) {
+        writeNext(lock);
+      } else {
+        changed.wait(lock);
+      }
+    }
+#if JSON_USE_EXCEPTION
+  } catch (...) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      failed = true;
+    }
+    changed.notify_all();
+    parallelism.pool->wait();
+    throw;
+  }
+#endif
+  parallelism.pool->wait();
+#if JSON_USE_EXCEPTION
+  if (failure)
+    std::rethrow_exception(failure);
+#endif
+}
+
+template <bool EmitUTF8, bool Comments>
 struct BuiltStyledStreamWriter : public StreamWriter {
-  BuiltStyledStreamWriter(String indentation, CommentStyle::Enum cs,
-                          String colonSymbol, String nullSymbol,
-                          String endingLineFeedSymbol, bool useSpecialFloats,
-                          bool emitUTF8, unsigned int precision,
-                          PrecisionType precisionType);
+  BuiltStyledStreamWriter(String indentation, String colonSymbol,
+                          String nullSymbol, String endingLineFeedSymbol,
+                          bool useSpecialFloats, unsigned int precision,
+                          PrecisionType precisionType,
+                          Parallelism parallelism);
   int write(Value const& root, OStream* sout) override;
+  int write(Value const& root, OutputBuffer* out) override;
 
 private:
   void writeValue(Value const& value);
+  void writeChildren(Value const& value, ChildRange const& range);
+  void writeChildrenInParallel(Value const& value);
   void writeArrayValue(Value const& value);
   bool isMultilineArray(Value const& value);
   void pushValue(String const& value);
+  void pushValue(char const* value);
   void writeIndent();
   void writeWithIndent(String const& value);
   void indent();
@@ -892,35 +1665,44 @@ private:
   void writeCommentAfterValueOnSameLine(Value const& root);
   static bool hasCommentForValue(const Value& value);
 
-  using ChildValues = std::vector<String>;
-
-  ChildValues childValues_;
+  String scratch_; ///< Elements of the array being measured, end to end.
+  std::vector<size_t> childEnds_; ///< Where each of them ends in scratch_.
+  EscapedKeyCache keyCache_;
+  OutputBuffer* out_{nullptr};
   String indentString_;
   unsigned int rightMargin_;
   String indentation_;
-  CommentStyle::Enum cs_;
   String colonSymbol_;
   String nullSymbol_;
   String endingLineFeedSymbol_;
   bool addChildValues_ : 1;
   bool indented_ : 1;
   bool useSpecialFloats_ : 1;
-  bool emitUTF8_ : 1;
   unsigned int precision_;
   PrecisionType precisionType_;
+  Parallelism parallelism_;
 };
-BuiltStyledStreamWriter::BuiltStyledStreamWriter(
-    String indentation, CommentStyle::Enum cs, String colonSymbol,
-    String nullSymbol, String endingLineFeedSymbol, bool useSpecialFloats,
-    bool emitUTF8, unsigned int precision, PrecisionType precisionType)
-    : rightMargin_(74), indentation_(std::move(indentation)), cs_(cs),
+template <bool EmitUTF8, bool Comments>
+BuiltStyledStreamWriter<EmitUTF8, Comments>::BuiltStyledStreamWriter(
+    String indentation, String colonSymbol, String nullSymbol,
+    String endingLineFeedSymbol, bool useSpecialFloats, unsigned int precision,
+    PrecisionType precisionType, Parallelism parallelism)
+    : rightMargin_(74), indentation_(std::move(indentation)),
       colonSymbol_(std::move(colonSymbol)), nullSymbol_(std::move(nullSymbol)),
       endingLineFeedSymbol_(std::move(endingLineFeedSymbol)),
       addChildValues_(false), indented_(false),
-      useSpecialFloats_(useSpecialFloats), emitUTF8_(emitUTF8),
-      precision_(precision), precisionType_(precisionType) {}
-int BuiltStyledStreamWriter::write(Value const& root, OStream* sout) {
-  sout_ = sout;
+      useSpecialFloats_(useSpecialFloats), precision_(precision),
+      precisionType_(precisionType), parallelism_(parallelism) {}
+template <bool EmitUTF8, bool Comments>
+int BuiltStyledStreamWriter<EmitUTF8, Comments>::write(
+    Value const& root, OStream* sout) {
+  OStreamOutputBuffer out(sout);
+  return write(root, &out);
+}
+template <bool EmitUTF8, bool Comments>
+int BuiltStyledStreamWriter<EmitUTF8, Comments>::write(
+    Value const& root, OutputBuffer* out) {
+  out_ = out;
   addChildValues_ = false;
   indented_ = true;
   indentString_.clear();
@@ -930,37 +1712,39 @@ int BuiltStyledStreamWriter::write(Value const& root, OStream* sout) {
   indented_ = true;
   writeValue(root);
   writeCommentAfterValueOnSameLine(root);
-  *sout_ << endingLineFeedSymbol_;
-  sout_ = nullptr;
+  out_->append(endingLineFeedSymbol_);
+  out_ = nullptr;
   return 0;
 }
-void BuiltStyledStreamWriter::writeValue(Value const& value) {
+template <bool EmitUTF8, bool Comments>
+void BuiltStyledStreamWriter<EmitUTF8, Comments>::writeValue(
+    Value const& value) {
+  char const* literal;
+  char const* literalEnd;
+  if (value.getNumberText(&literal, &literalEnd) ||
+      value.getRawText(&literal, &literalEnd)) {
+    pushValue(String(literal, literalEnd));
+    return;
+  }
   switch (value.type()) {
   case nullValue:
     pushValue(nullSymbol_);
     break;
-  case intValue:
-    pushValue(valueToString(value.asLargestInt()));
-    break;
-  case uintValue:
-    pushValue(valueToString(value.asLargestUInt()));
-    break;
+  case intValue: {
+    UIntToStringBuffer buffer;
+    pushValue(integerToChars(value.asLargestInt(), buffer));
+  } break;
+  case uintValue: {
+    UIntToStringBuffer buffer;
+    pushValue(integerToChars(value.asLargestUInt(), buffer));
+  } break;
   case realValue:
     pushValue(valueToString(value.asDouble(), useSpecialFloats_, precision_,
                             precisionType_));
     break;
-  case stringValue: {
-    // Is NULL is possible for value.string_? No.
-    char const* str;
-    char const* end;
-    bool ok = value.getString(&str, &end);
-    if (ok)
-      pushValue(valueToQuotedStringN(str, static_cast<unsigned>(end - str),
-                                     emitUTF8_));
-    else
-      pushValue("");
+  case stringValue:
+    pushValue(quotedStringValue(value, EmitUTF8));
     break;
-  }
   case booleanValue:
     pushValue(valueToString(value.asBool()));
     break;
@@ -968,28 +1752,15 @@ void BuiltStyledStreamWriter::writeValue(Value const& value) {
     writeArrayValue(value);
     break;
   case objectValue: {
-    Value::Members members(value.getMemberNames());
-    if (members.empty())
+    if (value.empty())
       pushValue("{}");
     else {
       writeWithIndent("{");
       indent();
-      auto it = members.begin();
-      for (;;) {
-        String const& name = *it;
-        Value const& childValue = value[name];
-        writeCommentBeforeValue(childValue);
-        writeWithIndent(valueToQuotedStringN(
-            name.data(), static_cast<unsigned>(name.length()), emitUTF8_));
-        *sout_ << colonSymbol_;
-        writeValue(childValue);
-        if (++it == members.end()) {
-          writeCommentAfterValueOnSameLine(childValue);
-          break;
-        }
-        *sout_ << ",";
-        writeCommentAfterValueOnSameLine(childValue);
-      }
+      if (parallelism_.appliesTo(value))
+        writeChildrenInParallel(value);
+      else
+        writeChildren(value, allChildren(value));
       unindent();
       writeWithIndent("}");
     }
@@ -997,118 +1768,188 @@ void BuiltStyledStreamWriter::writeValue(Value const& value) {
   }
 }
 
-void BuiltStyledStreamWriter::writeArrayValue(Value const& value) {
+// The members of an object, or the elements of a multi-line array, from the
+// state left by writing "{" or "[", or by the previous child.
+template <bool EmitUTF8, bool Comments>
+void BuiltStyledStreamWriter<EmitUTF8, Comments>::writeChildren(
+    Value const& value, ChildRange const& range) {
+  ArrayIndex const size = value.size();
+  if (value.isObject()) {
+    auto it = range.first;
+    for (ArrayIndex index = range.begin; index != range.end; ++index, ++it) {
+      char const* nameEnd;
+      char const* name = it.memberName(&nameEnd);
+      Value const& childValue = *it;
+      writeCommentBeforeValue(childValue);
+      if (!indented_)
+        writeIndent();
+      keyCache_.appendQuoted(*out_, name, nameEnd, EmitUTF8);
+      indented_ = false;
+      out_->append(colonSymbol_);
+      writeValue(childValue);
+      if (index + 1 != size)
+        out_->append(',');
+      writeCommentAfterValueOnSameLine(childValue);
+    }
+    return;
+  }
+  ArrayIndex const measured = static_cast<ArrayIndex>(childEnds_.size());
+  for (ArrayIndex index = range.begin; index != range.end; ++index) {
+    Value const& childValue = value[index];
+    writeCommentBeforeValue(childValue);
+    if (index < measured) {
+      size_t const begin = index == 0 ? 0 : childEnds_[index - 1];
+      if (!indented_)
+        writeIndent();
+      out_->append(scratch_.data() + begin, childEnds_[index] - begin);
+      indented_ = false;
+    } else {
+      if (!indented_)
+        writeIndent();
+      indented_ = true;
+      writeValue(childValue);
+      indented_ = false;
+    }
+    if (index + 1 != size)
+      out_->append(',');
+    writeCommentAfterValueOnSameLine(childValue);
+  }
+}
+
+// Every child starts with indented_ false, so a copy of this writer in that
+// state writes a run of them as this one would.
+template <bool EmitUTF8, bool Comments>
+void BuiltStyledStreamWriter<EmitUTF8, Comments>::writeChildrenInParallel(
+    Value const& value) {
+  Json::writeChildrenInParallel(
+      value, parallelism_, *out_,
+      [this, &value](ChildRange const& range, OutputBuffer& out) {
+        BuiltStyledStreamWriter writer(*this);
+        writer.out_ = &out;
+        writer.indented_ = false;
+        writer.parallelism_.threads = 1;
+        writer.writeChildren(value, range);
+      });
+}
+
+template <bool EmitUTF8, bool Comments>
+void BuiltStyledStreamWriter<EmitUTF8, Comments>::writeArrayValue(
+    Value const& value) {
   unsigned size = value.size();
   if (size == 0)
     pushValue("[]");
   else {
-    bool isMultiLine = (cs_ == CommentStyle::All) || isMultilineArray(value);
+    bool isMultiLine = Comments || isMultilineArray(value);
     if (isMultiLine) {
       writeWithIndent("[");
       indent();
-      bool hasChildValue = !childValues_.empty();
-      unsigned index = 0;
-      for (;;) {
-        Value const& childValue = value[index];
-        writeCommentBeforeValue(childValue);
-        if (hasChildValue)
-          writeWithIndent(childValues_[index]);
-        else {
-          if (!indented_)
-            writeIndent();
-          indented_ = true;
-          writeValue(childValue);
-          indented_ = false;
-        }
-        if (++index == size) {
-          writeCommentAfterValueOnSameLine(childValue);
-          break;
-        }
-        *sout_ << ",";
-        writeCommentAfterValueOnSameLine(childValue);
-      }
+      if (childEnds_.empty() && parallelism_.appliesTo(value))
+        writeChildrenInParallel(value);
+      else
+        writeChildren(value, allChildren(value));
       unindent();
       writeWithIndent("]");
     } else // output on a single line
     {
-      assert(childValues_.size() == size);
-      *sout_ << "[";
-      if (!indentation_.empty())
-        *sout_ << " ";
+      assert(childEnds_.size() == size);
+      out_->append("[ ", 2);
       for (unsigned index = 0; index < size; ++index) {
+        size_t const begin = index == 0 ? 0 : childEnds_[index - 1];
         if (index > 0)
-          *sout_ << ((!indentation_.empty()) ? ", " : ",");
-        *sout_ << childValues_[index];
+          out_->append(", ", 2);
+        out_->append(scratch_.data() + begin, childEnds_[index] - begin);
       }
-      if (!indentation_.empty())
-        *sout_ << " ";
-      *sout_ << "]";
+      out_->append(" ]", 2);
     }
   }
 }
 
-bool BuiltStyledStreamWriter::isMultilineArray(Value const& value) {
+// Short arrays of scalars are written on one line. Their elements are
+// formatted into scratch_ until the line is known to be too long, and
+// writeArrayValue() then copies those from there instead of formatting them
+// again.
+template <bool EmitUTF8, bool Comments>
+bool BuiltStyledStreamWriter<EmitUTF8, Comments>::isMultilineArray(
+    Value const& value) {
   ArrayIndex const size = value.size();
   bool isMultiLine = size * 3 >= rightMargin_;
-  childValues_.clear();
+  scratch_.clear();
+  childEnds_.clear();
   for (ArrayIndex index = 0; index < size && !isMultiLine; ++index) {
     Value const& childValue = value[index];
     isMultiLine = ((childValue.isArray() || childValue.isObject()) &&
-                   !childValue.empty());
+                   !childValue.empty()) ||
+                  hasCommentForValue(childValue);
   }
   if (!isMultiLine) // check if line length > max line length
   {
-    childValues_.reserve(size);
     addChildValues_ = true;
     ArrayIndex lineLength = 4 + (size - 1) * 2; // '[ ' + ', '*n + ' ]'
-    for (ArrayIndex index = 0; index < size; ++index) {
-      if (hasCommentForValue(value[index])) {
-        isMultiLine = true;
-      }
+    for (ArrayIndex index = 0; index < size && lineLength < rightMargin_;
+         ++index) {
+      size_t const begin = scratch_.size();
       writeValue(value[index]);
-      lineLength += static_cast<ArrayIndex>(childValues_[index].length());
+      lineLength += static_cast<ArrayIndex>(scratch_.size() - begin);
     }
     addChildValues_ = false;
-    isMultiLine = isMultiLine || lineLength >= rightMargin_;
+    isMultiLine = lineLength >= rightMargin_;
   }
   return isMultiLine;
 }
 
-void BuiltStyledStreamWriter::pushValue(String const& value) {
-  if (addChildValues_)
-    childValues_.push_back(value);
-  else
-    *sout_ << value;
+template <bool EmitUTF8, bool Comments>
+void BuiltStyledStreamWriter<EmitUTF8, Comments>::pushValue(
+    String const& value) {
+  if (addChildValues_) {
+    scratch_ += value;
+    childEnds_.push_back(scratch_.size());
+  } else
+    out_->append(value);
+}
+
+template <bool EmitUTF8, bool Comments>
+void BuiltStyledStreamWriter<EmitUTF8, Comments>::pushValue(char const* value) {
+  if (addChildValues_) {
+    scratch_ += value;
+    childEnds_.push_back(scratch_.size());
+  } else
+    out_->append(value);
 }
 
-void BuiltStyledStreamWriter::writeIndent() {
+template <bool EmitUTF8, bool Comments>
+void BuiltStyledStreamWriter<EmitUTF8, Comments>::writeIndent() {
   // blep intended this to look at the so-far-written string
   // to determine whether we are already indented, but
   // with a stream we cannot do that. So we rely on some saved state.
   // The caller checks indented_.
-
-  if (!indentation_.empty()) {
-    // In this case, drop newlines too.
-    *sout_ << '\n' << indentString_;
-  }
+  out_->append('\n');
+  out_->append(indentString_);
 }
 
-void BuiltStyledStreamWriter::writeWithIndent(String const& value) {
+template <bool EmitUTF8, bool Comments>
+void BuiltStyledStreamWriter<EmitUTF8, Comments>::writeWithIndent(
+    String const& value) {
   if (!indented_)
     writeIndent();
-  *sout_ << value;
+  out_->append(value);
   indented_ = false;
 }
 
-void BuiltStyledStreamWriter::indent() { indentString_ += indentation_; }
+template <bool EmitUTF8, bool Comments>
+void BuiltStyledStreamWriter<EmitUTF8, Comments>::indent() {
+  indentString_ += indentation_;
+}
 
-void BuiltStyledStreamWriter::unindent() {
+template <bool EmitUTF8, bool Comments>
+void BuiltStyledStreamWriter<EmitUTF8, Comments>::unindent() {
   assert(indentString_.size() >= indentation_.size());
   indentString_.resize(indentString_.size() - indentation_.size());
 }
 
-void BuiltStyledStreamWriter::writeCommentBeforeValue(Value const& root) {
-  if (cs_ == CommentStyle::None)
+template <bool EmitUTF8, bool Comments>
+void BuiltStyledStreamWriter<EmitUTF8, Comments>::writeCommentBeforeValue(
+    Value const& root) {
+  if (!Comments)
     return;
   if (!root.hasComment(commentBefore))
     return;
@@ -1118,53 +1959,615 @@ void BuiltStyledStreamWriter::writeCommentBeforeValue(Value const& root) {
   const String& comment = root.getComment(commentBefore);
   String::const_iterator iter = comment.begin();
   while (iter != comment.end()) {
-    *sout_ << *iter;
+    out_->append(*iter);
     if (*iter == '\n' && ((iter + 1) != comment.end() && *(iter + 1) == '/'))
       // writeIndent();  // would write extra newline
-      *sout_ << indentString_;
+      out_->append(indentString_);
     ++iter;
   }
   indented_ = false;
 }
 
-void BuiltStyledStreamWriter::writeCommentAfterValueOnSameLine(
-    Value const& root) {
-  if (cs_ == CommentStyle::None)
+template <bool EmitUTF8, bool Comments>
+void BuiltStyledStreamWriter<
+    EmitUTF8, Comments>::writeCommentAfterValueOnSameLine(Value const& root) {
+  if (!Comments)
     return;
-  if (root.hasComment(commentAfterOnSameLine))
-    *sout_ << " " + root.getComment(commentAfterOnSameLine);
+  if (root.hasComment(commentAfterOnSameLine)) {
+    out_->append(' ');
+    out_->append(root.getComment(commentAfterOnSameLine));
+  }
 
   if (root.hasComment(commentAfter)) {
     writeIndent();
-    *sout_ << root.getComment(commentAfter);
+    out_->append(root.getComment(commentAfter));
   }
 }
 
 // static
-bool BuiltStyledStreamWriter::hasCommentForValue(const Value& value) {
+template <bool EmitUTF8, bool Comments>
+bool BuiltStyledStreamWriter<EmitUTF8, Comments>::hasCommentForValue(
+    const Value& value) {
   return value.hasComment(commentBefore) ||
          value.hasComment(commentAfterOnSameLine) ||
          value.hasComment(commentAfter);
 }
 
+// Writes the output of StreamWriterBuilder with an empty "indentation", in a
+// single pass. This is what BuiltStyledStreamWriter would write, without its
+// line-length measurement and per-child String buffering.
+template <bool EmitUTF8, bool Comments>
+struct CompactStreamWriter : public StreamWriter {
+  // Unless null, source is the text the values written were parsed from,
+  // and the pristine ones are copied from there instead of written.
+  CompactStreamWriter(String colonSymbol, String nullSymbol,
+                      bool useSpecialFloats, unsigned int precision,
+                      PrecisionType precisionType, Parallelism parallelism,
+                      char const* source);
+  int write(Value const& root, OStream* sout) override;
+  int write(Value const& root, OutputBuffer* out) override;
+
+private:
+  void writeValue(Value const& value);
+  void writeChildren(Value const& value, ChildRange const& range);
+  void writeCommentBeforeValue(Value const& value);
+  void writeCommentAfterValue(Value const& value);
+
+  EscapedKeyCache keyCache_;
+  OutputBuffer* out_{nullptr};
+  char const* source_;
+  String colonSymbol_;
+  String nullSymbol_;
+  bool useSpecialFloats_;
+  unsigned int precision_;
+  PrecisionType precisionType_;
+  Parallelism parallelism_;
+};
+template <bool EmitUTF8, bool Comments>
+CompactStreamWriter<EmitUTF8, Comments>::CompactStreamWriter(
+    String colonSymbol, String nullSymbol, bool useSpecialFloats,
+    unsigned int precision, PrecisionType precisionType,
+    Parallelism parallelism, char const* source)
+    : source_(source), colonSymbol_(std::move(colonSymbol)),
+      nullSymbol_(std::move(nullSymbol)), useSpecialFloats_(useSpecialFloats),
+      precision_(precision), precisionType_(precisionType),
+      parallelism_(parallelism) {}
+template <bool EmitUTF8, bool Comments>
+int CompactStreamWriter<EmitUTF8, Comments>::write(
+    Value const& root, OStream* sout) {
+  OStreamOutputBuffer out(sout);
+  return write(root, &out);
+}
+template <bool EmitUTF8, bool Comments>
+int CompactStreamWriter<EmitUTF8, Comments>::write(
+    Value const& root, OutputBuffer* out) {
+  out_ = out;
+  writeCommentBeforeValue(root);
+  writeValue(root);
+  writeCommentAfterValue(root);
+  out_ = nullptr;
+  return 0;
+}
+template <bool EmitUTF8, bool Comments>
+void CompactStreamWriter<EmitUTF8, Comments>::writeValue(Value const& value) {
+  if (source_ && value.isMoved()) {
+    // It may have been parsed from another text, and so may the values under
+    // it: write them all.
+    char const* const source = source_;
+    source_ = nullptr;
+    writeValue(value);
+    source_ = source;
+    return;
+  }
+  if (source_ && value.isPristine()) {
+    out_->append(source_ + value.getOffsetStart(),
+                 static_cast<size_t>(value.getOffsetLimit() -
+                                     value.getOffsetStart()));
+    return;
+  }
+  char const* literal;
+  char const* literalEnd;
+  if (value.getNumberText(&literal, &literalEnd) ||
+      value.getRawText(&literal, &literalEnd)) {
+    out_->append(literal, static_cast<size_t>(literalEnd - literal));
+    return;
+  }
+  switch (value.type()) {
+  case nullValue:
+    out_->append(nullSymbol_);
+    break;
+  case intValue: {
+    UIntToStringBuffer buffer;
+    out_->append(integerToChars(value.asLargestInt(), buffer));
+  } break;
+  case uintValue: {
+    UIntToStringBuffer buffer;
+    out_->append(integerToChars(value.asLargestUInt(), buffer));
+  } break;
+  case realValue:
+    out_->append(valueToString(value.asDouble(), useSpecialFloats_,
+                               precision_, precisionType_));
+    break;
+  case stringValue:
+    appendQuotedStringValue(*out_, value, EmitUTF8);
+    break;
+  case booleanValue:
+    out_->append(valueToString(value.asBool()));
+    break;
+  case arrayValue:
+  case objectValue: {
+    bool const object = value.isObject();
+    out_->append(object ? '{' : '[');
+    if (parallelism_.appliesTo(value)) {
+      Json::writeChildrenInParallel(
+          value, parallelism_, *out_,
+          [this, &value](ChildRange const& range, OutputBuffer& out) {
+            CompactStreamWriter writer(*this);
+            writer.out_ = &out;
+            writer.parallelism_.threads = 1;
+            writer.writeChildren(value, range);
+          });
+    } else {
+      writeChildren(value, allChildren(value));
+    }
+    out_->append(object ? '}' : ']');
+  } break;
+  }
+}
+template <bool EmitUTF8, bool Comments>
+void CompactStreamWriter<EmitUTF8, Comments>::writeChildren(Value const& value,
+                                        ChildRange const& range) {
+  ArrayIndex const size = value.size();
+  bool const object = value.isObject();
+  auto it = range.first;
+  for (ArrayIndex index = range.begin; index != range.end; ++index) {
+    Value const& childValue = object ? *it : value[index];
+    writeCommentBeforeValue(childValue);
+    if (object) {
+      char const* nameEnd;
+      char const* name = it.memberName(&nameEnd);
+      keyCache_.appendQuoted(*out_, name, nameEnd, EmitUTF8);
+      out_->append(colonSymbol_);
+      ++it;
+    }
+    writeValue(childValue);
+    if (index + 1 != size)
+      out_->append(',');
+    writeCommentAfterValue(childValue);
+  }
+}
+template <bool EmitUTF8, bool Comments>
+void CompactStreamWriter<EmitUTF8, Comments>::writeCommentBeforeValue(
+    Value const& value) {
+  if (Comments && value.hasComment(commentBefore))
+    out_->append(value.getComment(commentBefore));
+}
+template <bool EmitUTF8, bool Comments>
+void CompactStreamWriter<EmitUTF8, Comments>::writeCommentAfterValue(
+    Value const& value) {
+  if (!Comments)
+    return;
+  if (value.hasComment(commentAfterOnSameLine)) {
+    out_->append(' ');
+    out_->append(value.getComment(commentAfterOnSameLine));
+  }
+  if (value.hasComment(commentAfter))
+    out_->append(value.getComment(commentAfter));
+}
+
+// Writes the RFC 8785 (JSON Canonicalization Scheme) form of a value: no
+// whitespace or comments, members sorted by the UTF-16 code units of their
+// names, strings with only the escapes JSON requires, and numbers as
+// ECMAScript writes doubles.
+struct CanonicalStreamWriter : public StreamWriter {
+  int write(Value const& root, OStream* sout) override;
+  int write(Value const& root, OutputBuffer* out) override;
+
+private:
+  void writeValue(Value const& value);
+  void writeObject(Value const& value);
+  void writeString(char const* str, char const* end);
+  void writeNumber(double value);
+
+  OutputBuffer* out_{nullptr};
+};
+int CanonicalStreamWriter::write(Value const& root, OStream* sout) {
+  OStreamOutputBuffer out(sout);
+  return write(root, &out);
+}
+int CanonicalStreamWriter::write(Value const& root, OutputBuffer* out) {
+  out_ = out;
+  writeValue(root);
+  out_ = nullptr;
+  return 0;
+}
+void CanonicalStreamWriter::writeValue(Value const& value) {
+  char const* str;
+  char const* end;
+  if (value.getRawText(&str, &end)) {
+    CharReaderBuilder builder;
+    CharReaderBuilder::strictMode(&builder.settings_);
+    std::unique_ptr<CharReader> const reader(builder.newCharReader());
+    Value parsed;
+    String errs;
+    if (!reader->parse(str, end, &parsed, &errs))
+      throwRuntimeError("canonical JSON requires valid raw fragments: " + errs);
+    writeValue(parsed);
+    return;
+  }
+  switch (value.type()) {
+  case nullValue:
+    out_->append("null", 4);
+    break;
+  case intValue: {
+    LargestInt const i = value.asLargestInt();
+    // Beyond 2^53, an integer is written as the double it would read back as.
+    if (i > -9007199254740992 && i < 9007199254740992) {
+      UIntToStringBuffer buffer;
+      out_->append(integerToChars(i, buffer));
+    } else {
+      writeNumber(static_cast<double>(i));
+    }
+  } break;
+  case uintValue: {
+    LargestUInt const u = value.asLargestUInt();
+    if (u < 9007199254740992u) {
+      UIntToStringBuffer buffer;
+      out_->append(integerToChars(u, buffer));
+    } else {
+      writeNumber(static_cast<double>(u));
+    }
+  } break;
+  case realValue:
+    writeNumber(value.asDouble());
+    break;
+  case stringValue:
+    if (value.getString(&str, &end))
+      writeString(str, end);
+    break;
+  case booleanValue:
+    if (value.asBool())
+      out_->append("true", 4);
+    else
+      out_->append("false", 5);
+    break;
+  case arrayValue: {
+    out_->append('[');
+    ArrayIndex const size = value.size();
+    for (ArrayIndex index = 0; index < size; ++index) {
+      if (index != 0)
+        out_->append(',');
+      writeValue(value[index]);
+    }
+    out_->append(']');
+  } break;
+  case objectValue:
+    writeObject(value);
+    break;
+  }
+}
+// The first UTF-16 code unit of codepoint.
+static unsigned int leadingCodeUnit(unsigned int codepoint) {
+  return codepoint < 0x10000 ? codepoint
+                             : 0xD800 + ((codepoint - 0x10000) >> 10);
+}
+// Whether the UTF-8 string [a, aEnd) sorts before [b, bEnd) by UTF-16 code
+// units. This only differs from byte order when a character beyond U+FFFF,
+// whose surrogates sort before U+E000 to U+FFFF, is compared.
+static bool lessByCodeUnits(char const* a, char const* aEnd, char const* b,
+                            char const* bEnd) {
+  for (; a != aEnd && b != bEnd; ++a, ++b) {
+    unsigned int const x = utf8ToCodepoint(a, aEnd);
+    unsigned int const y = utf8ToCodepoint(b, bEnd);
+    if (x == y)
+      continue;
+    unsigned int const xUnit = leadingCodeUnit(x);
+    unsigned int const yUnit = leadingCodeUnit(y);
+    return xUnit != yUnit ? xUnit < yUnit : x < y;
+  }
+  return a == aEnd && b != bEnd;
+}
+void CanonicalStreamWriter::writeObject(Value const& value) {
+  // Members are held in byte order, which is code unit order unless a name
+  // has a 4-byte UTF-8 sequence.
+  std::vector<Value::const_iterator> members;
+  bool reorder = false;
+  for (auto it = value.begin(); it != value.end(); ++it) {
+    char const* nameEnd;
+    char const* name = it.memberName(&nameEnd);
+    for (; name != nameEnd && !reorder; ++name)
+      reorder = static_cast<unsigned char>(*name) >= 0xF0;
+    members.push_back(it);
+  }
+  if (reorder) {
+    std::stable_sort(members.begin(), members.end(),
+                     [](Value::const_iterator const& a,
+                        Value::const_iterator const& b) {
+                       char const* aEnd;
+                       char const* bEnd;
+                       char const* aName = a.memberName(&aEnd);
+                       char const* bName = b.memberName(&bEnd);
+                       return lessByCodeUnits(aName, aEnd, bName, bEnd);
+                     });
+  }
+  out_->append('{');
+  for (size_t index = 0; index < members.size(); ++index) {
+    if (index != 0)
+      out_->append(',');
+    char const* nameEnd;
+    char const* name = members[index].memberName(&nameEnd);
+    writeString(name, nameEnd);
+    out_->append(':');
+    writeValue(*members[index]);
+  }
+  out_->append('}');
+}
+void CanonicalStreamWriter::writeString(char const* str, char const* end) {
+  out_->append('"');
+  for (char const* c = str;; ++c) {
+    char const* const special = findCharRequiringEscape(c, end, true);
+    if (special != c)
+      out_->append(c, static_cast<size_t>(special - c));
+    if (special == end)
+      break;
+    c = special;
+    switch (*c) {
+    case '\"':
+      out_->append("\\\"", 2);
+      break;
+    case '\\':
+      out_->append("\\\\", 2);
+      break;
+    case '\b':
+      out_->append("\\b", 2);
+      break;
+    case '\f':
+      out_->append("\\f", 2);
+      break;
+    case '\n':
+      out_->append("\\n", 2);
+      break;
+    case '\r':
+      out_->append("\\r", 2);
+      break;
+    case '\t':
+      out_->append("\\t", 2);
+      break;
+    default:
+      appendHex16Bit(*out_, static_cast<unsigned char>(*c));
+      break;
+    }
+  }
+  out_->append('"');
+}
+// Writes value as ECMAScript's Number.prototype.toString() does.
+void CanonicalStreamWriter::writeNumber(double value) {
+  if (!isfinite(value))
+    throwRuntimeError("canonical JSON cannot represent NaN or Infinity");
+  if (value == 0) {
+    out_->append('0'); // Also for -0.
+    return;
+  }
+  if (value < 0) {
+    out_->append('-');
+    value = -value;
+  }
+  char digits[17];
+  int exponent;
+  int const length = shortestDigits(value, digits, exponent);
+  // value == 0.digits * 10^point
+  int const point = length + exponent;
+  if (point >= length && point <= 21) {
+    out_->append(digits, static_cast<size_t>(length));
+    for (int i = length; i < point; ++i)
+      out_->append('0');
+  } else if (point > 0 && point <= 21) {
+    out_->append(digits, static_cast<size_t>(point));
+    out_->append('.');
+    out_->append(digits + point, static_cast<size_t>(length - point));
+  } else if (point > -6 && point <= 0) {
+    out_->append("0.", 2);
+    for (int i = point; i < 0; ++i)
+      out_->append('0');
+    out_->append(digits, static_cast<size_t>(length));
+  } else {
+    out_->append(digits[0]);
+    if (length > 1) {
+      out_->append('.');
+      out_->append(digits + 1, static_cast<size_t>(length - 1));
+    }
+    int const e = point - 1;
+    out_->append(e < 0 ? "e-" : "e+", 2);
+    UIntToStringBuffer buffer;
+    out_->append(integerToChars(LargestUInt(e < 0 ? -e : e), buffer));
+  }
+}
+
+///////////////
+// OutputBuffer
+
+OutputBuffer::OutputBuffer() = default;
+OutputBuffer::OutputBuffer(char* buffer, size_t capacity)
+    : begin_(buffer), current_(buffer), end_(buffer + capacity) {}
+OutputBuffer::~OutputBuffer() = default;
+
+void OutputBuffer::setBuffer(char* begin, char* current, char* end) {
+  begin_ = begin;
+  current_ = current;
+  end_ = end;
+}
+
+bool OutputBuffer::makeRoom(size_t /*length*/) { return false; }
+
+void OutputBuffer::appendSlow(char const* data, size_t length) {
+  for (;;) {
+    size_t const room = static_cast<size_t>(end_ - current_);
+    if (length <= room) {
+      memcpy(current_, data, length);
+      current_ += length;
+      return;
+    }
+    if (room != 0) {
+      memcpy(current_, data, room);
+      current_ += room;
+      data += room;
+      length -= room;
+    }
+    if (!makeRoom(length) || current_ == end_) {
+      overflowed_ = true;
+      return;
+    }
+  }
+}
+
+StringOutputBuffer::StringOutputBuffer(size_t capacity)
+    : storage_(capacity, 0) {
+  if (capacity != 0)
+    setBuffer(&storage_[0], &storage_[0], &storage_[0] + capacity);
+}
+StringOutputBuffer::~StringOutputBuffer() = default;
+
+String StringOutputBuffer::release() {
+  storage_.resize(size());
+  String written(std::move(storage_));
+  storage_.clear();
+  setBuffer(nullptr, nullptr, nullptr);
+  return written;
+}
+
+bool StringOutputBuffer::makeRoom(size_t length) {
+  size_t const used = size();
+  size_t capacity = storage_.size() * 2;
+  if (capacity < used + length)
+    capacity = used + length;
+  if (capacity < 256)
+    capacity = 256;
+  storage_.resize(capacity);
+  setBuffer(&storage_[0], &storage_[0] + used, &storage_[0] + capacity);
+  return true;
+}
+
+#if !defined(_WIN32)
+FdOutputBuffer::FdOutputBuffer(int fd, size_t blockSize, size_t blockCount)
+    : fd_(fd), error_(0), blockSize_(blockSize != 0 ? blockSize : 1),
+      blockCount_(blockCount != 0 ? blockCount : 1) {
+  // The first block is allocated by the first append.
+}
+FdOutputBuffer::~FdOutputBuffer() { flush(); }
+
+bool FdOutputBuffer::flush() {
+  if (error_ != 0)
+    return false;
+  std::vector<iovec> iov(filled_.size() + 1);
+  for (size_t i = 0; i != filled_.size(); ++i) {
+    iov[i].iov_base = blocks_[i].get();
+    iov[i].iov_len = filled_[i];
+  }
+  iov.back().iov_base = const_cast<char*>(data());
+  iov.back().iov_len = size();
+#if defined(IOV_MAX)
+  size_t const maxCount = IOV_MAX;
+#else
+  size_t const maxCount = 16;
+#endif
+  iovec* current = &iov[0];
+  iovec* const end = current + iov.size();
+  while (current != end) {
+    if (current->iov_len == 0) {
+      ++current;
+      continue;
+    }
+    size_t const count = std::min(static_cast<size_t>(end - current), maxCount);
+    ssize_t written = ::writev(fd_, current, static_cast<int>(count));
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      error_ = errno;
+      setBuffer(nullptr, nullptr, nullptr);
+      return false;
+    }
+    // Skip what was written, which may end in the middle of a block.
+    while (written > 0) {
+      size_t const part =
+          std::min(current->iov_len, static_cast<size_t>(written));
+      current->iov_base = static_cast<char*>(current->iov_base) + part;
+      current->iov_len -= part;
+      written -= static_cast<ssize_t>(part);
+      if (current->iov_len == 0)
+        ++current;
+    }
+  }
+  filled_.clear();
+  if (!blocks_.empty())
+    setBuffer(blocks_[0].get(), blocks_[0].get(),
+              blocks_[0].get() + blockSize_);
+  return true;
+}
+
+bool FdOutputBuffer::makeRoom(size_t /*length*/) {
+  if (error_ != 0)
+    return false;
+  if (!blocks_.empty()) {
+    // The current block is full.
+    if (filled_.size() + 1 == blockCount_)
+      return flush();
+    filled_.push_back(size());
+  }
+  size_t const index = filled_.size();
+  if (index == blocks_.size())
+    blocks_.emplace_back(new char[blockSize_]);
+  char* const block = blocks_[index].get();
+  setBuffer(block, block, block + blockSize_);
+  return true;
+}
+#endif // if !defined(_WIN32)
+
 ///////////////
 // StreamWriter
 
 StreamWriter::StreamWriter() : sout_(nullptr) {}
 StreamWriter::~StreamWriter() = default;
+int StreamWriter::write(Value const& root, OutputBuffer* out) {
+  OStringStream sout;
+  int const result = write(root, &sout);
+  out->append(sout.str());
+  return result;
+}
 StreamWriter::Factory::~Factory() = default;
 StreamWriterBuilder::StreamWriterBuilder() { setDefaults(&settings_); }
 StreamWriterBuilder::~StreamWriterBuilder() = default;
-StreamWriter* StreamWriterBuilder::newStreamWriter() const {
-  const String indentation = settings_["indentation"].asString();
-  const String cs_str = settings_["commentStyle"].asString();
-  const String pt_str = settings_["precisionType"].asString();
-  const bool eyc = settings_["enableYAMLCompatibility"].asBool();
-  const bool dnp = settings_["dropNullPlaceholders"].asBool();
-  const bool usf = settings_["useSpecialFloats"].asBool();
-  const bool emitUTF8 = settings_["emitUTF8"].asBool();
-  unsigned int pre = settings_["precision"].asUInt();
-  CommentStyle::Enum cs = CommentStyle::All;
+namespace {
+// The settings of a StreamWriterBuilder, checked and turned into the
+// symbols that the writers output.
+struct WriterSettings {
+  explicit WriterSettings(Value const& settings);
+
+  String indentation;
+  CommentStyle::Enum cs;
+  String colonSymbol;
+  String nullSymbol;
+  bool useSpecialFloats;
+  bool emitUTF8;
+  unsigned int precision;
+  PrecisionType precisionType;
+  Parallelism parallelism;
+  bool canonical;
+};
+
+WriterSettings::WriterSettings(Value const& settings)
+    : indentation(settings["indentation"].asString()),
+      cs(CommentStyle::All), colonSymbol(" : "), nullSymbol("null"),
+      useSpecialFloats(settings["useSpecialFloats"].asBool()),
+      emitUTF8(settings["emitUTF8"].asBool()),
+      precision(settings["precision"].asUInt()),
+      precisionType(significantDigits),
+      parallelism{settings["threads"].asUInt(),
+                  settings["parallelThreshold"].asUInt(), nullptr},
+      canonical(settings["canonical"].asBool()) {
+  const String cs_str = settings["commentStyle"].asString();
+  const String pt_str = settings["precisionType"].asString();
+  const bool eyc = settings["enableYAMLCompatibility"].asBool();
+  const bool dnp = settings["dropNullPlaceholders"].asBool();
   if (cs_str == "All") {
     cs = CommentStyle::All;
   } else if (cs_str == "None") {
@@ -1172,30 +2575,70 @@ StreamWriter* StreamWriterBuilder::newStreamWriter() const {
   } else {
     throwRuntimeError("commentStyle must be 'All' or 'None'");
   }
-  PrecisionType precisionType(significantDigits);
   if (pt_str == "significant") {
     precisionType = PrecisionType::significantDigits;
   } else if (pt_str == "decimal") {
     precisionType = PrecisionType::decimalPlaces;
+  } else if (pt_str == "shortest") {
+    precisionType = PrecisionType::shortest;
   } else {
-    throwRuntimeError("precisionType must be 'significant' or 'decimal'");
+    throwRuntimeError(
+        "precisionType must be 'significant', 'decimal' or 'shortest'");
   }
-  String colonSymbol = " : ";
   if (eyc) {
     colonSymbol = ": ";
   } else if (indentation.empty()) {
     colonSymbol = ":";
   }
-  String nullSymbol = "null";
   if (dnp) {
     nullSymbol.clear();
   }
-  if (pre > 17)
-    pre = 17;
+  if (precision > 17)
+    precision = 17;
+  if (parallelism.threads == 0)
+    parallelism.threads = std::max(std::thread::hardware_concurrency(), 1u);
+  if (parallelism.threads > 1)
+    parallelism.pool =
+        std::make_shared<WriterThreadPool>(parallelism.threads - 1);
+}
+
+// Instantiates Writer for the "emitUTF8" and "commentStyle" settings, so that
+// its inner loops test them at compile time.
+template <template <bool, bool> class Writer, typename... Args>
+StreamWriter* newSpecializedWriter(WriterSettings const& s, Args&&... args) {
+  bool const comments = s.cs == CommentStyle::All;
+  if (s.emitUTF8 && comments)
+    return new Writer<true, true>(std::forward<Args>(args)...);
+  if (s.emitUTF8)
+    return new Writer<true, false>(std::forward<Args>(args)...);
+  if (comments)
+    return new Writer<false, true>(std::forward<Args>(args)...);
+  return new Writer<false, false>(std::forward<Args>(args)...);
+}
+} // namespace
+
+StreamWriter* StreamWriterBuilder::newStreamWriter() const {
+  WriterSettings const s(settings_);
+  if (s.canonical)
+    return new CanonicalStreamWriter();
+  if (s.indentation.empty())
+    return newSpecializedWriter<CompactStreamWriter>(
+        s, s.colonSymbol, s.nullSymbol, s.useSpecialFloats, s.precision,
+        s.precisionType, s.parallelism, nullptr);
   String endingLineFeedSymbol;
-  return new BuiltStyledStreamWriter(indentation, cs, colonSymbol, nullSymbol,
-                                     endingLineFeedSymbol, usf, emitUTF8, pre,
-                                     precisionType);
+  return newSpecializedWriter<BuiltStyledStreamWriter>(
+      s, s.indentation, s.colonSymbol, s.nullSymbol, endingLineFeedSymbol,
+      s.useSpecialFloats, s.precision, s.precisionType, s.parallelism);
+}
+int Document::write(StreamWriterBuilder const& builder,
+                    OutputBuffer* out) const {
+  WriterSettings const s(builder.settings_);
+  if (!sourceKept_ || !s.indentation.empty() || s.canonical)
+    return StreamWriterPtr(builder.newStreamWriter())->write(root_, out);
+  StreamWriterPtr const writer(newSpecializedWriter<CompactStreamWriter>(
+      s, s.colonSymbol, s.nullSymbol, s.useSpecialFloats, s.precision,
+      s.precisionType, s.parallelism, text_->data()));
+  return writer->write(root_, out);
 }
 static void getValidWriterKeys(std::set<String>* valid_keys) {
   valid_keys->clear();
@@ -1207,6 +2650,9 @@ static void getValidWriterKeys(std::set<String>* valid_keys) {
   valid_keys->insert("emitUTF8");
   valid_keys->insert("precision");
   valid_keys->insert("precisionType");
+  valid_keys->insert("threads");
+  valid_keys->insert("parallelThreshold");
+  valid_keys->insert("canonical");
 }
 bool StreamWriterBuilder::validate(Json::Value* invalid) const {
   Json::Value my_invalid;
@@ -1239,14 +2685,269 @@ void StreamWriterBuilder::setDefaults(Json::Value* settings) {
   (*settings)["emitUTF8"] = false;
   (*settings)["precision"] = 17;
   (*settings)["precisionType"] = "significant";
+  (*settings)["threads"] = 1;
+  (*settings)["parallelThreshold"] = 4096;
+  (*settings)["canonical"] = false;
   //! [StreamWriterBuilderDefaults]
 }
 
+void StreamWriterBuilder::canonicalMode(Json::Value* settings) {
+  //! [StreamWriterBuilderCanonicalMode]
+  setDefaults(settings);
+  (*settings)["canonical"] = true;
+  //! [StreamWriterBuilderCanonicalMode]
+}
+
+///////////////
+// Emitter
+
+Emitter::Emitter(StreamWriterBuilder const& builder, OutputBuffer* out)
+    : out_(out), afterKey_(false), done_(false) {
+  WriterSettings const s(builder.settings_);
+  indentation_ = s.indentation;
+  colonSymbol_ = s.colonSymbol;
+  nullSymbol_ = s.nullSymbol;
+  precision_ = s.precision;
+  precisionType_ = s.precisionType;
+  useSpecialFloats_ = s.useSpecialFloats;
+  emitUTF8_ = s.emitUTF8;
+}
+Emitter::Emitter(StreamWriterBuilder const& builder, OStream* sout)
+    : Emitter(builder, static_cast<OutputBuffer*>(nullptr)) {
+  streamOut_.reset(new OStreamOutputBuffer(sout));
+  out_ = streamOut_.get();
+}
+Emitter::~Emitter() = default;
+
+void Emitter::beginObject() { beginContainer(true); }
+void Emitter::endObject() { endContainer(true); }
+void Emitter::beginArray() { beginContainer(false); }
+void Emitter::endArray() { endContainer(false); }
+
+void Emitter::key(const char* begin, const char* end) {
+  assert(!scopes_.empty() && scopes_.back().object &&
+         "Json::Emitter: key() outside of an object");
+  assert(!afterKey_ && "Json::Emitter: key() without a value for the last");
+  separate();
+  appendQuotedString(*out_, begin, static_cast<size_t>(end - begin),
+                     emitUTF8_);
+  out_->append(colonSymbol_);
+  afterKey_ = true;
+}
+void Emitter::key(const char* name) { key(name, name + strlen(name)); }
+void Emitter::key(const String& name) {
+  key(name.data(), name.data() + name.length());
+}
+
+void Emitter::null() {
+  beginValue();
+  out_->append(nullSymbol_);
+  endValue();
+}
+void Emitter::value(bool b) {
+  beginValue();
+  out_->append(b ? "true" : "false");
+  endValue();
+}
+void Emitter::value(Int i) {
+  UIntToStringBuffer buffer;
+  beginValue();
+  out_->append(integerToChars(LargestInt(i), buffer));
+  endValue();
+}
+void Emitter::value(UInt u) {
+  UIntToStringBuffer buffer;
+  beginValue();
+  out_->append(integerToChars(LargestUInt(u), buffer));
+  endValue();
+}
+#if defined(JSON_HAS_INT64)
+void Emitter::value(Int64 i) {
+  UIntToStringBuffer buffer;
+  beginValue();
+  out_->append(integerToChars(LargestInt(i), buffer));
+  endValue();
+}
+void Emitter::value(UInt64 u) {
+  UIntToStringBuffer buffer;
+  beginValue();
+  out_->append(integerToChars(LargestUInt(u), buffer));
+  endValue();
+}
+#endif // if defined(JSON_HAS_INT64)
+void Emitter::value(double d) {
+  beginValue();
+  out_->append(valueToString(d, useSpecialFloats_, precision_, precisionType_));
+  endValue();
+}
+void Emitter::value(const char* begin, const char* end) {
+  beginValue();
+  appendQuotedString(*out_, begin, static_cast<size_t>(end - begin),
+                     emitUTF8_);
+  endValue();
+}
+void Emitter::value(const char* str) { value(str, str + strlen(str)); }
+void Emitter::value(const String& str) {
+  value(str.data(), str.data() + str.length());
+}
+
+void Emitter::raw(const char* begin, const char* end) {
+  beginValue();
+  out_->append(begin, static_cast<size_t>(end - begin));
+  endValue();
+}
+void Emitter::raw(const String& json) {
+  raw(json.data(), json.data() + json.length());
+}
+
+void Emitter::finish() {
+  assert(scopes_.empty() && done_ && "Json::Emitter: incomplete document");
+  streamOut_.reset(); // flushes
+  out_ = nullptr;
+}
+
+// Checks that a value is expected here, and separates it from the previous
+// element of an array.
+void Emitter::beginValue() {
+  assert(!done_ && "Json::Emitter: more than one root value");
+  if (scopes_.empty())
+    return;
+  if (scopes_.back().object) {
+    assert(afterKey_ && "Json::Emitter: value in an object without a key");
+    afterKey_ = false;
+    return;
+  }
+  separate();
+}
+
+void Emitter::endValue() {
+  if (scopes_.empty())
+    done_ = true;
+}
+
+// The bracket is written along with the first element, so that an empty
+// container is written as "[]" or "{}" and a non-empty one that is the value
+// of a key starts on its own line, as with BuiltStyledStreamWriter.
+void Emitter::beginContainer(bool object) {
+  bool const member = afterKey_;
+  beginValue();
+  Scope scope;
+  scope.object = object;
+  scope.open = false;
+  scope.member = member;
+  scopes_.push_back(scope);
+}
+
+void Emitter::endContainer(bool object) {
+  assert(!scopes_.empty() && scopes_.back().object == object &&
+         "Json::Emitter: end does not match begin");
+  assert(!afterKey_ && "Json::Emitter: key without a value");
+  Scope const scope = scopes_.back();
+  scopes_.pop_back();
+  if (!scope.open) {
+    out_->append(object ? "{}" : "[]", 2);
+  } else {
+    indentString_.resize(indentString_.size() - indentation_.size());
+    newLine();
+    out_->append(object ? '}' : ']');
+  }
+  endValue();
+}
+
+// Opens the current container or ends its previous element, then starts a
+// new line for the next one.
+void Emitter::separate() {
+  Scope& scope = scopes_.back();
+  if (scope.open) {
+    out_->append(',');
+  } else {
+    if (scope.member)
+      newLine();
+    out_->append(scope.object ? '{' : '[');
+    indentString_ += indentation_;
+    scope.open = true;
+  }
+  newLine();
+}
+
+void Emitter::newLine() {
+  if (!indentation_.empty()) {
+    out_->append('\n');
+    out_->append(indentString_);
+  }
+}
+
 String writeString(StreamWriter::Factory const& factory, Value const& root) {
-  OStringStream sout;
+  StringOutputBuffer out;
   StreamWriterPtr const writer(factory.newStreamWriter());
-  writer->write(root, &sout);
-  return sout.str();
+  writer->write(root, &out);
+  return out.release();
+}
+
+namespace {
+// Counts the bytes appended, keeping the first capacity of them in buffer and
+// overwriting a scratch block with the rest.
+class CountingOutputBuffer : public OutputBuffer {
+public:
+  CountingOutputBuffer(char* buffer, size_t capacity)
+      : OutputBuffer(buffer, capacity) {}
+  size_t count() const { return counted_ + size(); }
+
+protected:
+  bool makeRoom(size_t /*length*/) override {
+    counted_ += size();
+    setBuffer(scratch_, scratch_, scratch_ + sizeof(scratch_));
+    return true;
+  }
+
+private:
+  size_t counted_{0};
+  char scratch_[1024];
+};
+
+// Hashes the bytes appended with 64-bit FNV-1a, a scratch block at a time.
+class HashingOutputBuffer : public OutputBuffer {
+public:
+  HashingOutputBuffer() : OutputBuffer(scratch_, sizeof(scratch_)) {}
+  std::uint64_t hash() {
+    update();
+    return hash_;
+  }
+
+protected:
+  bool makeRoom(size_t /*length*/) override {
+    update();
+    return true;
+  }
+
+private:
+  void update() {
+    for (char const* c = data(); c != data() + size(); ++c)
+      hash_ = (hash_ ^ static_cast<unsigned char>(*c)) * 0x100000001b3;
+    setBuffer(scratch_, scratch_, scratch_ + sizeof(scratch_));
+  }
+
+  std::uint64_t hash_{0xcbf29ce484222325};
+  char scratch_[1024];
+};
+} // namespace
+
+std::uint64_t canonicalHash(Value const& root) {
+  HashingOutputBuffer out;
+  CanonicalStreamWriter().write(root, &out);
+  return out.hash();
+}
+
+size_t serializedSize(Value const& root, StreamWriter::Factory const& factory) {
+  return writeTo(root, factory, nullptr, 0);
+}
+
+size_t writeTo(Value const& root, StreamWriter::Factory const& factory,
+               char* buffer, size_t capacity) {
+  CountingOutputBuffer out(buffer, capacity);
+  StreamWriterPtr const writer(factory.newStreamWriter());
+  writer->write(root, &out);
+  return out.count();
 }
 
 OStream& operator<<(OStream& sout, Value const& root) {
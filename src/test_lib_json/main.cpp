@@ -12,7 +12,9 @@
 
 #include "fuzz.h"
 #include "jsontest.h"
+#include <cerrno>
 #include <cmath>
+#include <cstdio>
 #include <cstring>
 #include <iomanip>
 #include <iostream>
@@ -21,6 +23,9 @@
 #include <limits>
 #include <sstream>
 #include <string>
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
 
 // Make numeric limits more convenient to talk about.
 // Assumes int type in 32 bits.
@@ -384,6 +389,32 @@ JSONTEST_FIXTURE_LOCAL(ValueTest, arrayInsertAtRandomIndex) {
   JSONTEST_ASSERT(!array.insert(10, "index10"));
 }
 
+JSONTEST_FIXTURE_LOCAL(ValueTest, sparseArrayInsertAndRemove) {
+  Json::StreamWriterBuilder writer;
+  writer["indentation"] = "";
+  Json::Value array;
+  array[5] = "b";
+  JSONTEST_ASSERT(array.insert(0, "x"));
+  JSONTEST_ASSERT_EQUAL(7u, array.size());
+  JSONTEST_ASSERT_STRING_EQUAL("[\"x\",null,null,null,null,null,\"b\"]",
+                               Json::writeString(writer, array));
+
+  Json::Value sparse;
+  sparse[0] = "a";
+  sparse[5] = "b";
+  Json::Value got;
+  JSONTEST_ASSERT(sparse.removeIndex(0, &got));
+  JSONTEST_ASSERT_EQUAL(Json::Value("a"), got);
+  JSONTEST_ASSERT_EQUAL(5u, sparse.size());
+  JSONTEST_ASSERT_STRING_EQUAL("[null,null,null,null,\"b\"]",
+                               Json::writeString(writer, sparse));
+  sparse[7] = "c";
+  JSONTEST_ASSERT(sparse.removeIndex(4, &got));
+  JSONTEST_ASSERT_EQUAL(Json::Value("b"), got);
+  JSONTEST_ASSERT_STRING_EQUAL("[null,null,null,null,null,null,\"c\"]",
+                               Json::writeString(writer, sparse));
+}
+
 JSONTEST_FIXTURE_LOCAL(ValueTest, null) {
   JSONTEST_ASSERT_EQUAL(Json::nullValue, null_.type());
 
@@ -1963,6 +1994,60 @@ JSONTEST_FIXTURE_LOCAL(ValueTest, precision) {
   expected = "0.233";
   result = Json::writeString(b, v);
   JSONTEST_ASSERT_STRING_EQUAL(expected, result);
+
+  // Without decimal places, only the integer's digits are left, and its
+  // zeros are kept at any magnitude.
+  b.settings_["precision"] = 0;
+  b.settings_["precisionType"] = "decimal";
+  v = 100.0;
+  expected = "100.0";
+  result = Json::writeString(b, v);
+  JSONTEST_ASSERT_STRING_EQUAL(expected, result);
+
+  v = 65760.4;
+  expected = "65760.0";
+  result = Json::writeString(b, v);
+  JSONTEST_ASSERT_STRING_EQUAL(expected, result);
+
+  v = 1e20;
+  expected = "100000000000000000000.0";
+  result = Json::writeString(b, v);
+  JSONTEST_ASSERT_STRING_EQUAL(expected, result);
+
+  b.settings_["precision"] = 3;
+  v = 1e20;
+  expected = "100000000000000000000.0";
+  result = Json::writeString(b, v);
+  JSONTEST_ASSERT_STRING_EQUAL(expected, result);
+}
+
+JSONTEST_FIXTURE_LOCAL(ValueTest, shortestPrecision) {
+  Json::StreamWriterBuilder b;
+  b.settings_["precisionType"] = "shortest";
+  struct {
+    double value;
+    char const* expected;
+  } const cases[] = {
+      {0.1, "0.1"},
+      {-0.3, "-0.3"},
+      {100.0 / 3, "33.333333333333336"},
+      {1e23, "1e+23"},
+      {1e21, "1e+21"},
+      {123456789012345680.0, "1.2345678901234568e+17"},
+      {4096.0, "4096.0"},
+      {0.0001, "0.0001"},
+      {0.00001, "1e-05"},
+      {5e-324, "5e-324"},
+      {1.7976931348623157e308, "1.7976931348623157e+308"},
+      {-0.0, "-0.0"},
+  };
+  for (auto const& c : cases)
+    JSONTEST_ASSERT_STRING_EQUAL(c.expected,
+                                 Json::writeString(b, Json::Value(c.value)));
+  // "precision" does not apply.
+  b.settings_["precision"] = 3;
+  JSONTEST_ASSERT_STRING_EQUAL("0.2563456",
+                               Json::writeString(b, Json::Value(0.2563456)));
 }
 
 struct FastWriterTest : JsonTest::TestCase {};
@@ -2422,6 +2507,35 @@ JSONTEST_FIXTURE_LOCAL(StreamWriterTest, multiLineArray) {
   }
 }
 
+JSONTEST_FIXTURE_LOCAL(StreamWriterTest, longLineArray) {
+  Json::StreamWriterBuilder wb;
+  wb.settings_["commentStyle"] = "None";
+  Json::Value root;
+  // Too long for one line, which shows after measuring three of them.
+  for (char c = 'a'; c != 'f'; ++c)
+    root["a"].append(Json::String(20, c));
+  root["b"].append(1);
+  root["b"].append(2);
+  const Json::String expected("{\n\t\"a\" : \n\t[\n"
+                              "\t\t\"aaaaaaaaaaaaaaaaaaaa\",\n"
+                              "\t\t\"bbbbbbbbbbbbbbbbbbbb\",\n"
+                              "\t\t\"cccccccccccccccccccc\",\n"
+                              "\t\t\"dddddddddddddddddddd\",\n"
+                              "\t\t\"eeeeeeeeeeeeeeeeeeee\"\n"
+                              "\t],\n\t\"b\" : [ 1, 2 ]\n}");
+  JSONTEST_ASSERT_STRING_EQUAL(expected, Json::writeString(wb, root));
+  Json::StyledWriter styledWriter;
+  JSONTEST_ASSERT_STRING_EQUAL(
+      "{\n   \"a\" : [\n"
+      "      \"aaaaaaaaaaaaaaaaaaaa\",\n"
+      "      \"bbbbbbbbbbbbbbbbbbbb\",\n"
+      "      \"cccccccccccccccccccc\",\n"
+      "      \"dddddddddddddddddddd\",\n"
+      "      \"eeeeeeeeeeeeeeeeeeee\"\n"
+      "   ],\n   \"b\" : [ 1, 2 ]\n}\n",
+      styledWriter.write(root));
+}
+
 JSONTEST_FIXTURE_LOCAL(StreamWriterTest, dropNullPlaceholders) {
   Json::StreamWriterBuilder b;
   Json::Value nullValue;
@@ -2510,6 +2624,437 @@ JSONTEST_FIXTURE_LOCAL(StreamWriterTest, unicode) {
                   "\"\\t\\n\\ud806\\udca1=\\u0133\\ud82c\\udd1b\\uff67\"\n}");
 }
 
+JSONTEST_FIXTURE_LOCAL(StreamWriterTest, compact) {
+  Json::Value root;
+  Json::String expected = "{\"long\":[";
+  for (int i = 0; i < 30; ++i) {
+    root["long"].append(i);
+    expected += (i ? "," : "") + Json::valueToString(i);
+  }
+  expected += "],\"nested\":[[],{},[null,\"x\"]]}";
+  root["nested"].append(Json::arrayValue);
+  root["nested"].append(Json::objectValue);
+  root["nested"][2].append(Json::nullValue);
+  root["nested"][2].append("x");
+  root["nested"][2].setComment("// comment", Json::commentAfterOnSameLine);
+
+  Json::StreamWriterBuilder b;
+  b["indentation"] = "";
+  b["commentStyle"] = "None";
+  JSONTEST_ASSERT_STRING_EQUAL(expected, Json::writeString(b, root));
+  std::unique_ptr<Json::StreamWriter> const writer(b.newStreamWriter());
+  Json::OStringStream sout;
+  writer->write(root, &sout);
+  JSONTEST_ASSERT_STRING_EQUAL(expected, sout.str());
+}
+
+JSONTEST_FIXTURE_LOCAL(StreamWriterTest, integers) {
+  Json::Value root(Json::arrayValue);
+  root.append(0);
+  root.append(7);
+  root.append(10);
+  root.append(99);
+  root.append(100);
+  root.append(-1);
+  root.append(-12345);
+  root.append(Json::Value::minLargestInt);
+  root.append(Json::Value::maxLargestUInt);
+  Json::String const expected = "[0,7,10,99,100,-1,-12345,"
+                                "-9223372036854775808,18446744073709551615]";
+  Json::StreamWriterBuilder b;
+  b["indentation"] = "";
+  JSONTEST_ASSERT_STRING_EQUAL(expected, Json::writeString(b, root));
+  Json::FastWriter fastWriter;
+  JSONTEST_ASSERT_STRING_EQUAL(expected + "\n", fastWriter.write(root));
+  b["commentStyle"] = "None";
+  b["indentation"] = " ";
+  root.resize(7);
+  JSONTEST_ASSERT_STRING_EQUAL("[ 0, 7, 10, 99, 100, -1, -12345 ]",
+                               Json::writeString(b, root));
+  JSONTEST_ASSERT_STRING_EQUAL("-9223372036854775808",
+                               Json::valueToString(Json::Value::minLargestInt));
+}
+
+JSONTEST_FIXTURE_LOCAL(StreamWriterTest, escapedStrings) {
+  // Clean runs longer than a word, between characters that need escaping.
+  Json::String const text("plain ascii text \"quoted\" back\\slash\n\t"
+                          "\x01\x1f and a nul \0 then \xc3\xa9t\xc3\xa9 "
+                          "\xf0\x9f\x98\x80 and slashes / at the end",
+                          93);
+  Json::Value const root(text);
+  Json::StreamWriterBuilder b;
+  b["indentation"] = "";
+  JSONTEST_ASSERT_STRING_EQUAL(
+      "\"plain ascii text \\\"quoted\\\" back\\\\slash\\n\\t\\u0001"
+      "\\u001f and a nul \\u0000 then \\u00e9t\\u00e9 \\ud83d\\ude00 "
+      "and slashes / at the end\"",
+      Json::writeString(b, root));
+  b["emitUTF8"] = true;
+  JSONTEST_ASSERT_STRING_EQUAL(
+      Json::String("\"plain ascii text \\\"quoted\\\" back\\\\slash\\n"
+                   "\\t\x01\x1f and a nul \0 then \xc3\xa9t\xc3\xa9 "
+                   "\xf0\x9f\x98\x80 and slashes / at the end\"",
+                   100),
+      Json::writeString(b, root));
+  // Strings made of non-ASCII characters only are escaped too.
+  JSONTEST_ASSERT_STRING_EQUAL("\"\\u00e9\\u00e9\"",
+                               Json::valueToQuotedString("\xc3\xa9\xc3\xa9"));
+}
+
+JSONTEST_FIXTURE_LOCAL(StreamWriterTest, escapedKeys) {
+  Json::Value root(Json::arrayValue);
+  Json::String expected = "[";
+  for (int i = 0; i < 3; ++i) {
+    Json::Value& object = root.append(Json::Value());
+    object["\xc3\xa9"] = i;
+    object[Json::String("a\0b", 3)] = i;
+    object["quote\""] = i;
+    Json::String const n = Json::valueToString(i);
+    expected += (i == 0 ? "" : ",");
+    expected += "{\"a\\u0000b\":" + n + ",\"quote\\\"\":" + n +
+                ",\"\\u00e9\":" + n + "}";
+  }
+  expected += "]";
+  Json::StreamWriterBuilder b;
+  b["indentation"] = "";
+  JSONTEST_ASSERT_STRING_EQUAL(expected, Json::writeString(b, root));
+  // More keys needing escapes than the writer keeps quoted.
+  Json::Value& wide = root.append(Json::Value());
+  for (int i = 0; i < 200; ++i)
+    wide["\t" + Json::valueToString(i)] = i;
+  root.append(wide);
+  Json::FastWriter fastWriter;
+  JSONTEST_ASSERT_STRING_EQUAL(fastWriter.write(root),
+                               Json::writeString(b, root) + "\n");
+}
+
+#if !defined(_WIN32)
+JSONTEST_FIXTURE_LOCAL(StreamWriterTest, fdOutputBuffer) {
+  Json::Value root;
+  for (int i = 0; i < 100; ++i)
+    root["list"].append("item " + Json::valueToString(i));
+  Json::StreamWriterBuilder b;
+  Json::String const expected = Json::writeString(b, root);
+  std::unique_ptr<Json::StreamWriter> const writer(b.newStreamWriter());
+  std::FILE* const file = std::tmpfile();
+  JSONTEST_ASSERT(file != nullptr);
+  int const fd = fileno(file);
+  {
+    // Small blocks, so that the document goes through several writev().
+    Json::FdOutputBuffer out(fd, 16, 4);
+    writer->write(root, &out);
+    JSONTEST_ASSERT(out.flush());
+    JSONTEST_ASSERT(!out.overflowed());
+    JSONTEST_ASSERT_EQUAL(0, out.error());
+    out.append("\n");
+  }
+  Json::String written(expected.size() + 2, '\0');
+  JSONTEST_ASSERT_EQUAL(0, lseek(fd, 0, SEEK_SET));
+  written.resize(static_cast<size_t>(read(fd, &written[0], written.size())));
+  JSONTEST_ASSERT_STRING_EQUAL(expected + "\n", written);
+  std::fclose(file);
+
+  Json::FdOutputBuffer closed(-1, 16, 1);
+  writer->write(root, &closed);
+  JSONTEST_ASSERT(closed.overflowed());
+  JSONTEST_ASSERT_EQUAL(EBADF, closed.error());
+}
+#endif // if !defined(_WIN32)
+
+JSONTEST_FIXTURE_LOCAL(StreamWriterTest, threads) {
+  Json::Value root;
+  Json::Value& list = root["list"];
+  for (int i = 0; i < 1000; ++i) {
+    Json::Value& item = list[i];
+    item["id"] = i;
+    item["name"] = "item \xc3\xa9 " + Json::valueToString(i);
+    item["tags"].append(i % 7);
+    if (i % 10 == 0)
+      item["id"].setComment("// tenth", Json::commentAfterOnSameLine);
+  }
+  Json::Value& map = root["map"];
+  for (int i = 0; i < 1000; ++i)
+    map["key" + Json::valueToString(i)] = list[i];
+  root["sparse"][500] = true;
+  for (char const* indentation : {"", "\t"}) {
+    for (char const* commentStyle : {"None", "All"}) {
+      Json::StreamWriterBuilder b;
+      b["indentation"] = indentation;
+      b["commentStyle"] = commentStyle;
+      Json::String const expected = Json::writeString(b, root);
+      b["threads"] = 4;
+      b["parallelThreshold"] = 16;
+      JSONTEST_ASSERT_STRING_EQUAL(expected, Json::writeString(b, root));
+      b["threads"] = 0;
+      JSONTEST_ASSERT_STRING_EQUAL(expected, Json::writeString(b, root));
+    }
+  }
+  // A writer keeps its threads for every container and document it writes.
+  Json::StreamWriterBuilder b;
+  Json::String const expected = Json::writeString(b, root);
+  b["threads"] = 3;
+  b["parallelThreshold"] = 16;
+  std::unique_ptr<Json::StreamWriter> const writer(b.newStreamWriter());
+  for (int i = 0; i < 3; ++i) {
+    Json::StringOutputBuffer out;
+    JSONTEST_ASSERT_EQUAL(0, writer->write(root, &out));
+    JSONTEST_ASSERT_STRING_EQUAL(expected, out.release());
+  }
+}
+
+JSONTEST_FIXTURE_LOCAL(StreamWriterTest, rawFragments) {
+  Json::Value root;
+  root["card"] = Json::Value::raw("{\"id\":7,\"tags\":[\"a\",\"b\"]}");
+  root["list"].append(Json::Value::raw(Json::String("1e999")));
+  root["list"].append("\"quoted\"");
+  JSONTEST_ASSERT(root["card"].isString());
+  char const* begin;
+  char const* end;
+  JSONTEST_ASSERT(root["card"].getRawText(&begin, &end));
+  JSONTEST_ASSERT(!root["list"][1].getRawText(&begin, &end));
+  // Copies are raw too.
+  Json::Value const copy(root);
+  Json::StreamWriterBuilder b;
+  b["indentation"] = "";
+  JSONTEST_ASSERT_STRING_EQUAL(
+      "{\"card\":{\"id\":7,\"tags\":[\"a\",\"b\"]},"
+      "\"list\":[1e999,\"\\\"quoted\\\"\"]}",
+      Json::writeString(b, copy));
+  b["indentation"] = " ";
+  b["commentStyle"] = "None";
+  JSONTEST_ASSERT_STRING_EQUAL(
+      "{\n \"card\" : {\"id\":7,\"tags\":[\"a\",\"b\"]},\n"
+      " \"list\" : [ 1e999, \"\\\"quoted\\\"\" ]\n}",
+      Json::writeString(b, copy));
+  Json::FastWriter fastWriter;
+  JSONTEST_ASSERT_STRING_EQUAL(
+      "{\"card\":{\"id\":7,\"tags\":[\"a\",\"b\"]},"
+      "\"list\":[1e999,\"\\\"quoted\\\"\"]}\n",
+      fastWriter.write(copy));
+}
+
+struct EmitterTest : JsonTest::TestCase {
+  // The document emitted by emit(), as a Value.
+  static Json::Value expectedValue() {
+    Json::Value root;
+    root["name"] = "caf\xc3\xa9";
+    root["empty"] = Json::Value(Json::arrayValue);
+    root["none"] = Json::Value(Json::objectValue);
+    root["rows"].append(Json::Value());
+    root["rows"][0]["id"] = Json::Value::minLargestInt;
+    root["rows"][0]["ratio"] = 0.5;
+    root["rows"][0]["ok"] = true;
+    root["rows"].append(Json::Value());
+    root["rows"][1]["id"] = Json::Value::maxLargestUInt;
+    root["rows"][1]["missing"] = Json::Value();
+    return root;
+  }
+  // Members in the order Value would write them.
+  static void emit(Json::Emitter& emitter) {
+    emitter.beginObject();
+    emitter.key("empty");
+    emitter.beginArray();
+    emitter.endArray();
+    emitter.key("name");
+    emitter.value("caf\xc3\xa9");
+    emitter.key(Json::String("none"));
+    emitter.beginObject();
+    emitter.endObject();
+    emitter.key("rows");
+    emitter.beginArray();
+    emitter.beginObject();
+    emitter.key("id");
+    emitter.value(Json::Value::minLargestInt);
+    emitter.key("ok");
+    emitter.value(true);
+    emitter.key("ratio");
+    emitter.value(0.5);
+    emitter.endObject();
+    emitter.beginObject();
+    emitter.key("id");
+    emitter.value(Json::Value::maxLargestUInt);
+    emitter.key("missing");
+    emitter.null();
+    emitter.endObject();
+    emitter.endArray();
+    emitter.endObject();
+    emitter.finish();
+  }
+};
+
+JSONTEST_FIXTURE_LOCAL(EmitterTest, matchesStreamWriter) {
+  Json::StreamWriterBuilder b;
+  for (char const* indentation : {"", "  "}) {
+    b["indentation"] = indentation;
+    Json::StringOutputBuffer out;
+    Json::Emitter emitter(b, &out);
+    emit(emitter);
+    JSONTEST_ASSERT_STRING_EQUAL(Json::writeString(b, expectedValue()),
+                                 out.release());
+  }
+  b["emitUTF8"] = true;
+  b["dropNullPlaceholders"] = true;
+  Json::OStringStream sout;
+  {
+    Json::Emitter emitter(b, &sout);
+    emit(emitter);
+  }
+  JSONTEST_ASSERT_STRING_EQUAL(Json::writeString(b, expectedValue()),
+                               sout.str());
+}
+
+JSONTEST_FIXTURE_LOCAL(EmitterTest, scalarRoot) {
+  Json::StreamWriterBuilder b;
+  Json::StringOutputBuffer out;
+  Json::Emitter emitter(b, &out);
+  emitter.value(1.5);
+  emitter.finish();
+  JSONTEST_ASSERT_STRING_EQUAL("1.5", out.release());
+}
+
+JSONTEST_FIXTURE_LOCAL(StreamWriterTest, everyConfiguration) {
+  // Each combination of these settings has its own writer instantiation.
+  Json::Value root;
+  root["k"].append("\xc3\xa9");
+  root["k"].setComment(Json::String("// note"), Json::commentBefore);
+  char const* const expected[2][2][2] = {
+      {{"{\n  \"k\" : [ \"\\u00e9\" ]\n}",
+        "{\n  // note\n  \"k\" : \n  [\n    \"\\u00e9\"\n  ]\n}"},
+       {"{\n  \"k\" : [ \"\xc3\xa9\" ]\n}",
+        "{\n  // note\n  \"k\" : \n  [\n    \"\xc3\xa9\"\n  ]\n}"}},
+      {{"{\"k\":[\"\\u00e9\"]}", "{// note\"k\":[\"\\u00e9\"]}"},
+       {"{\"k\":[\"\xc3\xa9\"]}", "{// note\"k\":[\"\xc3\xa9\"]}"}}};
+  Json::StreamWriterBuilder b;
+  for (int compact = 0; compact < 2; ++compact)
+    for (int utf8 = 0; utf8 < 2; ++utf8)
+      for (int comments = 0; comments < 2; ++comments) {
+        b["indentation"] = compact ? "" : "  ";
+        b["emitUTF8"] = utf8 == 1;
+        b["commentStyle"] = comments ? "All" : "None";
+        JSONTEST_ASSERT_STRING_EQUAL(expected[compact][utf8][comments],
+                                     Json::writeString(b, root));
+      }
+}
+
+JSONTEST_FIXTURE_LOCAL(StreamWriterTest, canonical) {
+  // The examples of RFC 8785, sections 3.2.2 and 3.2.3.
+  Json::StreamWriterBuilder b;
+  Json::StreamWriterBuilder::canonicalMode(&b.settings_);
+  Json::CharReaderBuilder rb;
+  std::unique_ptr<Json::CharReader> const reader(rb.newCharReader());
+  Json::String errs;
+  Json::Value root;
+  Json::String const text =
+      "{\"numbers\": [333333333.33333329, 1E30, 4.50, 2e-3, 1e-27],\n"
+      " \"string\": \"\\u20ac$\\u000F\\u000aA'\\u0042\\u0022\\u005c"
+      "\\\\\\\"\\/\","
+      " \"literals\": [null, true, false]}";
+  JSONTEST_ASSERT(reader->parse(text.data(), text.data() + text.size(), &root,
+                                &errs));
+  Json::String const canonical =
+      "{\"literals\":[null,true,false],"
+      "\"numbers\":[333333333.3333333,1e+30,4.5,0.002,1e-27],"
+      "\"string\":\"\xe2\x82\xac$\\u000f\\nA'B\\\"\\\\\\\\\\\"/\"}";
+  JSONTEST_ASSERT_STRING_EQUAL(canonical, Json::writeString(b, root));
+  std::uint64_t hash = 0xcbf29ce484222325;
+  for (char c : canonical)
+    hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3;
+  JSONTEST_ASSERT(hash == Json::canonicalHash(root));
+
+  // U+1F600 sorts before U+FB33 by UTF-16 code units.
+  root = Json::Value();
+  root["\xe2\x82\xac"] = "Euro Sign";
+  root["\r"] = "Carriage Return";
+  root["\xef\xac\xb3"] = "Hebrew Letter Dalet With Dagesh";
+  root["1"] = "One";
+  root["\xf0\x9f\x98\x80"] = "Emoji: Grinning Face";
+  root["\xc2\x80"] = "Control";
+  root["\xc3\xb6"] = "Latin Small Letter O With Diaeresis";
+  JSONTEST_ASSERT_STRING_EQUAL(
+      "{\"\\r\":\"Carriage Return\",\"1\":\"One\",\"\xc2\x80\":\"Control\","
+      "\"\xc3\xb6\":\"Latin Small Letter O With Diaeresis\","
+      "\"\xe2\x82\xac\":\"Euro Sign\","
+      "\"\xf0\x9f\x98\x80\":\"Emoji: Grinning Face\","
+      "\"\xef\xac\xb3\":\"Hebrew Letter Dalet With Dagesh\"}",
+      Json::writeString(b, root));
+
+  // Numbers are doubles, as in ECMAScript.
+  root = Json::Value(Json::arrayValue);
+  root.append(Json::UInt64(9007199254740993U));
+  root.append(-0.0);
+  root.append(1e21);
+  root.append(1e20);
+  root.append(5e-324);
+  root.append(9.999999999999997e-7);
+  JSONTEST_ASSERT_STRING_EQUAL(
+      "[9007199254740992,0,1e+21,100000000000000000000,5e-324,"
+      "9.999999999999997e-7]",
+      Json::writeString(b, root));
+}
+
+JSONTEST_FIXTURE_LOCAL(StreamWriterTest, serializedSize) {
+  Json::Value root;
+  root["text"] = Json::String(3000, 'x');
+  for (int i = 0; i < 500; ++i)
+    root["list"].append(i * 0.25);
+  Json::StreamWriterBuilder b;
+  for (char const* indentation : {"", "\t"}) {
+    b["indentation"] = indentation;
+    Json::String const expected = Json::writeString(b, root);
+    JSONTEST_ASSERT_EQUAL(expected.size(), Json::serializedSize(root, b));
+
+    std::vector<char> buffer(expected.size());
+    JSONTEST_ASSERT_EQUAL(expected.size(), Json::writeTo(root, b, buffer.data(),
+                                                         buffer.size()));
+    JSONTEST_ASSERT_STRING_EQUAL(expected,
+                                 Json::String(buffer.data(), buffer.size()));
+    // Too small a buffer holds a prefix, and the size is still returned.
+    JSONTEST_ASSERT_EQUAL(expected.size(),
+                          Json::writeTo(root, b, buffer.data(), 10));
+    JSONTEST_ASSERT_STRING_EQUAL(expected.substr(0, 10),
+                                 Json::String(buffer.data(), 10));
+  }
+}
+
+JSONTEST_FIXTURE_LOCAL(StreamWriterTest, outputBuffer) {
+  Json::Value root;
+  root["name"] = "a long enough string to outgrow the initial capacity";
+  root["list"].append(1);
+  root["list"].append(2.5);
+  Json::StreamWriterBuilder b;
+  b["commentStyle"] = "None";
+  b["indentation"] = "  ";
+  Json::String const expected =
+      "{\n  \"list\" : [ 1, 2.5 ],\n  \"name\" : \"a long enough string to "
+      "outgrow the initial capacity\"\n}";
+  JSONTEST_ASSERT_STRING_EQUAL(expected, Json::writeString(b, root));
+  std::unique_ptr<Json::StreamWriter> const writer(b.newStreamWriter());
+  {
+    Json::StringOutputBuffer out(8);
+    writer->write(root, &out);
+    JSONTEST_ASSERT(!out.overflowed());
+    JSONTEST_ASSERT_STRING_EQUAL(expected, Json::String(out.data(),
+                                                        out.size()));
+    JSONTEST_ASSERT_STRING_EQUAL(expected, out.release());
+    JSONTEST_ASSERT_EQUAL(0U, out.size());
+  }
+  {
+    // A caller-supplied buffer does not grow.
+    char buffer[16];
+    Json::OutputBuffer out(buffer, sizeof(buffer));
+    writer->write(root, &out);
+    JSONTEST_ASSERT(out.overflowed());
+    JSONTEST_ASSERT_EQUAL(sizeof(buffer), out.size());
+    JSONTEST_ASSERT_STRING_EQUAL(expected.substr(0, sizeof(buffer)),
+                                 Json::String(buffer, sizeof(buffer)));
+    char large[128];
+    Json::OutputBuffer fits(large, sizeof(large));
+    writer->write(root, &fits);
+    JSONTEST_ASSERT(!fits.overflowed());
+    JSONTEST_ASSERT_STRING_EQUAL(expected, Json::String(large, fits.size()));
+  }
+}
+
 struct ReaderTest : JsonTest::TestCase {};
 
 JSONTEST_FIXTURE_LOCAL(ReaderTest, parseWithNoErrors) {
@@ -2795,6 +3340,73 @@ JSONTEST_FIXTURE_LOCAL(CharReaderStrictModeTest, dupKeys) {
     delete reader;
   }
 }
+
+JSONTEST_FIXTURE_LOCAL(CharReaderStrictModeTest, syntaxExtensions) {
+  // Strict readers skip the extension checks; each extension must still be
+  // accepted when its own setting is on, and rejected otherwise.
+  struct Case {
+    char const* setting;
+    Json::String doc;
+  };
+  Case const cases[] = {
+      {"allowComments", "{ \"a\" : 1 } // comment"},
+      {"allowSingleQuotes", "{ 'a' : 1 }"},
+      {"allowNumericKeys", "{ 1 : 1 }"},
+      {"allowSpecialFloats", "[ NaN ]"},
+      {"allowDroppedNullPlaceholders", "[ 1, , 2 ]"},
+  };
+  for (auto const& c : cases) {
+    Json::CharReaderBuilder b;
+    Json::CharReaderBuilder::strictMode(&b.settings_);
+    Json::Value root;
+    Json::String errs;
+    std::istringstream strict(c.doc);
+    JSONTEST_ASSERT(!Json::parseFromStream(b, strict, &root, &errs))
+        << c.setting;
+    b[c.setting] = true;
+    std::istringstream extended(c.doc);
+    JSONTEST_ASSERT(Json::parseFromStream(b, extended, &root, &errs))
+        << c.setting << errs;
+  }
+  {
+    Json::Reader strict(Json::Features::strictMode());
+    Json::Reader all(Json::Features::all());
+    Json::Value root;
+    Json::String const doc = "// comment\n{ \"a\" : 1e+2 }";
+    JSONTEST_ASSERT(!strict.parse(doc, root));
+    JSONTEST_ASSERT(!strict.getFormattedErrorMessages().empty());
+    JSONTEST_ASSERT(all.parse(doc, root));
+    JSONTEST_ASSERT_EQUAL(100.0, root["a"].asDouble());
+    JSONTEST_ASSERT_STRING_EQUAL("// comment",
+                                 root.getComment(Json::commentBefore));
+    JSONTEST_ASSERT(!all.parse("[ 1e+ ]", root));
+    // Reader keeps its own number syntax on the shared engine.
+    JSONTEST_ASSERT(!strict.parse("[ +1 ]", root));
+    JSONTEST_ASSERT(!strict.parse("[ 1.7976931348623157e309 ]", root));
+    std::vector<Json::Reader::StructuredError> const errors =
+        strict.getStructuredErrors();
+    JSONTEST_ASSERT_EQUAL(1u, errors.size());
+    JSONTEST_ASSERT_EQUAL(2, errors[0].offset_start);
+    JSONTEST_ASSERT_EQUAL(24, errors[0].offset_limit);
+    JSONTEST_ASSERT(all.parse("[ - ]", root));
+    JSONTEST_ASSERT_EQUAL(0, root[0].asInt());
+  }
+  {
+    // A quote where single quotes are off is an error, not a comment.
+    Json::Reader all(Json::Features::all());
+    Json::Value root;
+    JSONTEST_ASSERT(!all.parse("'/", root));
+    std::vector<Json::Reader::StructuredError> const errors =
+        all.getStructuredErrors();
+    JSONTEST_ASSERT_EQUAL(1u, errors.size());
+    JSONTEST_ASSERT_EQUAL(1, errors[0].offset_limit);
+    Json::CharReaderBuilder b;
+    Json::String errs;
+    std::istringstream quoted("[ '/ ]");
+    JSONTEST_ASSERT(!Json::parseFromStream(b, quoted, &root, &errs));
+  }
+}
+
 struct CharReaderFailIfExtraTest : JsonTest::TestCase {};
 
 JSONTEST_FIXTURE_LOCAL(CharReaderFailIfExtraTest, issue164) {
@@ -3181,6 +3793,376 @@ JSONTEST_FIXTURE_LOCAL(CharReaderAllowSpecialFloatsTest, issue209) {
   delete reader;
 }
 
+struct CharReaderInSituTest : JsonTest::TestCase {};
+
+JSONTEST_FIXTURE_LOCAL(CharReaderInSituTest, parseInSitu) {
+  Json::CharReaderBuilder b;
+  Json::CharReader* reader(b.newCharReader());
+  Json::Value root;
+  Json::String errs;
+  char doc[] = "{\"k\\u00e9y\": [\"plain\", \"tab\\there\"], \"n\": 12}";
+  bool ok = reader->parseInSitu(doc, doc + std::strlen(doc), &root, &errs);
+  JSONTEST_ASSERT(ok);
+  JSONTEST_ASSERT_STRING_EQUAL("", errs);
+  JSONTEST_ASSERT_EQUAL(2u, root.size());
+  JSONTEST_ASSERT_EQUAL(12, root["n"].asInt());
+  Json::Value const& arr = root["k\xc3\xa9y"];
+  JSONTEST_ASSERT_STRING_EQUAL("plain", arr[0].asString());
+  JSONTEST_ASSERT_STRING_EQUAL("tab\there", arr[1].asString());
+  // Strings reference the decoded bytes inside the buffer.
+  char const* begin;
+  char const* end;
+  JSONTEST_ASSERT(arr[1].getString(&begin, &end));
+  JSONTEST_ASSERT(begin > doc && end < doc + sizeof(doc));
+  JSONTEST_ASSERT_EQUAL(0, *end);
+  // They are null-terminated in place.
+  JSONTEST_ASSERT(arr[1].asCString() == begin);
+  JSONTEST_ASSERT_STRING_EQUAL("tab\there", arr[1].asCString());
+  JSONTEST_ASSERT_STRING_EQUAL("k\xc3\xa9y", root.begin().name());
+
+  // Copies own their strings.
+  Json::Value copy = root;
+  std::memset(doc, 'x', sizeof(doc) - 1);
+  JSONTEST_ASSERT_STRING_EQUAL("tab\there", copy["k\xc3\xa9y"][1].asString());
+  JSONTEST_ASSERT_STRING_EQUAL("k\xc3\xa9y", copy.begin().name());
+  delete reader;
+}
+
+JSONTEST_FIXTURE_LOCAL(CharReaderInSituTest, document) {
+  Json::CharReaderBuilder b;
+  b["rejectDupKeys"] = true;
+  Json::String errs;
+  Json::Document doc;
+  bool ok = doc.parse(b, "{\"a\": \"\\\"quoted\\\"\", \"b\": {}}", &errs);
+  JSONTEST_ASSERT(ok);
+  JSONTEST_ASSERT_STRING_EQUAL("", errs);
+  Json::Document moved(std::move(doc));
+  JSONTEST_ASSERT_STRING_EQUAL("\"quoted\"", moved.root()["a"].asString());
+  JSONTEST_ASSERT(moved.root()["b"].isObject());
+
+  ok = moved.parse(b, "{\"a\": 1, \"a\": 2}", &errs);
+  JSONTEST_ASSERT(!ok);
+  JSONTEST_ASSERT_STRING_EQUAL("* Line 1, Column 10\n"
+                               "  Duplicate key: 'a'\n",
+                               errs);
+}
+
+struct DocumentTest : JsonTest::TestCase {};
+
+JSONTEST_FIXTURE_LOCAL(DocumentTest, writeKeepingSource) {
+  Json::String const text = "{\"id\": 7, \"tags\": [ \"a\", \"\\u00e9\" ], "
+                            "\"big\": 1.50, \"nan\": NaN, \"meta\": {}}";
+  Json::CharReaderBuilder rb;
+  rb["allowSpecialFloats"] = true;
+  Json::StreamWriterBuilder wb;
+  wb["indentation"] = "";
+  Json::String errs;
+  Json::Document doc;
+  JSONTEST_ASSERT(doc.parseKeepingSource(rb, text, &errs));
+  Json::Value const& root = doc.root();
+  JSONTEST_ASSERT(root["tags"].isPristine());
+  JSONTEST_ASSERT(root["big"].isPristine());
+  JSONTEST_ASSERT(!root["nan"].isPristine());
+  JSONTEST_ASSERT(!root.isPristine());
+  Json::StringOutputBuffer out;
+  JSONTEST_ASSERT_EQUAL(0, doc.write(wb, &out));
+  JSONTEST_ASSERT_STRING_EQUAL("{\"big\":1.50,\"id\":7,\"meta\":{},"
+                               "\"nan\":null,\"tags\":[ \"a\", \"\\u00e9\" ]}",
+                               out.release());
+
+  // Non-const access marks what it reaches as modified; copies are never
+  // pristine.
+  doc.root()["meta"]["n"] = 2;
+  Json::Value copy = doc.root()["tags"];
+  JSONTEST_ASSERT(!copy.isPristine());
+  JSONTEST_ASSERT(root["tags"].isPristine());
+  doc.write(wb, &out);
+  JSONTEST_ASSERT_STRING_EQUAL("{\"big\":1.50,\"id\":7,\"meta\":{\"n\":2},"
+                               "\"nan\":null,\"tags\":[ \"a\", \"\\u00e9\" ]}",
+                               out.release());
+
+  // Without the source, every value is written.
+  JSONTEST_ASSERT(doc.parse(rb, text, &errs));
+  doc.write(wb, &out);
+  JSONTEST_ASSERT_STRING_EQUAL("{\"big\":1.5,\"id\":7,\"meta\":{},"
+                               "\"nan\":null,\"tags\":[\"a\",\"\\u00e9\"]}",
+                               out.release());
+}
+
+JSONTEST_FIXTURE_LOCAL(DocumentTest, foreignValuesAreWritten) {
+  Json::CharReaderBuilder rb;
+  Json::StreamWriterBuilder wb;
+  wb["indentation"] = "";
+  Json::String errs;
+  Json::Document doc;
+  JSONTEST_ASSERT(doc.parseKeepingSource(rb, "{\"x\": 1}", &errs));
+  Json::Document other;
+  JSONTEST_ASSERT(other.parseKeepingSource(
+      rb, "{\"padding\": \"......................\", \"y\": [ 2, { } ]}",
+      &errs));
+  Json::Value plain;
+  Json::String const text = "[ \"far into the text\", [ 3 ] ]";
+  std::unique_ptr<Json::CharReader> const reader(rb.newCharReader());
+  JSONTEST_ASSERT(
+      reader->parse(text.data(), text.data() + text.size(), &plain, &errs));
+  // Only a Document's own parse marks values pristine.
+  JSONTEST_ASSERT(!plain[1].isPristine());
+
+  // The values under a moved one stay marked, but are not trusted.
+  doc.root()["x"] = std::move(other.root()["y"]);
+  doc.root()["z"] = std::move(plain);
+  JSONTEST_ASSERT(!doc.root()["x"].isPristine());
+  JSONTEST_ASSERT(doc.root()["x"][1].isPristine());
+  Json::StringOutputBuffer out;
+  JSONTEST_ASSERT_EQUAL(0, doc.write(wb, &out));
+  JSONTEST_ASSERT_STRING_EQUAL(
+      "{\"x\":[2,{}],\"z\":[\"far into the text\",[3]]}", out.release());
+
+  // Nor is a value another reader parses into the root.
+  JSONTEST_ASSERT(doc.parseKeepingSource(
+      rb, "{\"name\":\"a fairly long original string\"}", &errs));
+  char const shorter[] = "[1, 2]";
+  JSONTEST_ASSERT(reader->parse(shorter, shorter + std::strlen(shorter),
+                                &doc.root(), &errs));
+  JSONTEST_ASSERT(!doc.root().isPristine());
+  doc.write(wb, &out);
+  JSONTEST_ASSERT_STRING_EQUAL("[1,2]", out.release());
+
+  // Values moved within the Document are written in full too.
+  JSONTEST_ASSERT(
+      doc.parseKeepingSource(rb, "{\"a\": [ 1 ], \"b\": { }}", &errs));
+  doc.root()["c"] = std::move(doc.root()["a"]);
+  doc.write(wb, &out);
+  JSONTEST_ASSERT_STRING_EQUAL("{\"a\":null,\"b\":{ },\"c\":[1]}",
+                               out.release());
+
+  // Moving the Document keeps its values pristine.
+  JSONTEST_ASSERT(doc.parseKeepingSource(rb, "{\"x\": [ 1 ]}", &errs));
+  Json::Document moved(std::move(doc));
+  JSONTEST_ASSERT(moved.root()["x"].isPristine());
+  moved.write(wb, &out);
+  JSONTEST_ASSERT_STRING_EQUAL("{\"x\":[ 1 ]}", out.release());
+}
+
+struct CharReaderBorrowStringsTest : JsonTest::TestCase {};
+
+JSONTEST_FIXTURE_LOCAL(CharReaderBorrowStringsTest, borrowStrings) {
+  Json::CharReaderBuilder b;
+  b["borrowStrings"] = true;
+  Json::CharReader* reader(b.newCharReader());
+  Json::Value root;
+  Json::String errs;
+  char doc[] = "{\"plain\": \"text\", \"esc\": \"a\\nb\"}";
+  bool ok = reader->parse(doc, doc + std::strlen(doc), &root, &errs);
+  JSONTEST_ASSERT(ok);
+  JSONTEST_ASSERT_STRING_EQUAL("", errs);
+  char const* begin;
+  char const* end;
+  // Strings without escapes reference the document, others are decoded.
+  JSONTEST_ASSERT(root["plain"].getString(&begin, &end));
+  JSONTEST_ASSERT(begin == doc + 11 && end == doc + 15);
+  JSONTEST_ASSERT(root["esc"].getString(&begin, &end));
+  JSONTEST_ASSERT(begin < doc || begin >= doc + sizeof(doc));
+  JSONTEST_ASSERT_STRING_EQUAL("a\nb", root["esc"].asString());
+#ifdef JSONCPP_HAS_STRING_VIEW
+  JSONTEST_ASSERT(root["plain"].getStringView() == "text");
+#endif
+
+  // A borrowed string is not null-terminated, so asCString() refuses it.
+  Json::Value const& plain = root["plain"];
+  JSONTEST_ASSERT_THROWS(plain.asCString());
+  JSONTEST_ASSERT_STRING_EQUAL("a\nb", root["esc"].asCString());
+
+  Json::Value copy = root;
+  std::memset(doc, 'x', sizeof(doc) - 1);
+  JSONTEST_ASSERT_STRING_EQUAL("text", copy["plain"].asCString());
+  JSONTEST_ASSERT_STRING_EQUAL("plain", copy.getMemberNames()[1]);
+  delete reader;
+}
+
+JSONTEST_FIXTURE_LOCAL(CharReaderBorrowStringsTest, parseFromStream) {
+  Json::CharReaderBuilder b;
+  b["borrowStrings"] = true;
+  b["lazyNumbers"] = true;
+  b["lazyUnescape"] = true;
+  std::istringstream in("{\"plain\": \"text\", \"esc\": \"a\\nb\", "
+                        "\"real\": 0.5}");
+  Json::Value root;
+  Json::String errs;
+  JSONTEST_ASSERT(Json::parseFromStream(b, in, &root, &errs));
+  // Nothing references the text read from the stream, which is gone.
+  char const* begin;
+  char const* end;
+  JSONTEST_ASSERT(!root["real"].getNumberText(&begin, &end));
+  JSONTEST_ASSERT(!root["esc"].getEscapedString(&begin, &end));
+  JSONTEST_ASSERT_STRING_EQUAL("a\nb", root["esc"].asString());
+  JSONTEST_ASSERT_STRING_EQUAL("text", root["plain"].asString());
+  JSONTEST_ASSERT(b["borrowStrings"].asBool());
+}
+
+struct CharReaderLazyNumbersTest : JsonTest::TestCase {};
+
+JSONTEST_FIXTURE_LOCAL(CharReaderLazyNumbersTest, lazyNumbers) {
+  Json::CharReaderBuilder b;
+  b["lazyNumbers"] = true;
+  Json::CharReader* reader(b.newCharReader());
+  Json::Value root;
+  Json::String errs;
+  char const doc[] = "[-12, 18446744073709551615, 123456789012345678901234, "
+                     "0.10000000000000000001, -0, 1E+2, 01]";
+  bool ok = reader->parse(doc, doc + std::strlen(doc), &root, &errs);
+  JSONTEST_ASSERT(ok);
+  JSONTEST_ASSERT_STRING_EQUAL("", errs);
+  JSONTEST_ASSERT_EQUAL(Json::intValue, root[0].type());
+  JSONTEST_ASSERT_EQUAL(-12, root[0].asInt());
+  JSONTEST_ASSERT(root[0] == Json::Value(-12));
+  JSONTEST_ASSERT_EQUAL(Json::uintValue, root[1].type());
+  JSONTEST_ASSERT_EQUAL(Json::Value::maxUInt64, root[1].asUInt64());
+  JSONTEST_ASSERT_EQUAL(Json::realValue, root[2].type());
+  JSONTEST_ASSERT_EQUAL(1.2345678901234568e23, root[2].asDouble());
+  JSONTEST_ASSERT_EQUAL(100.0, root[5].asDouble());
+  char const* begin;
+  char const* end;
+  JSONTEST_ASSERT(root[3].getNumberText(&begin, &end));
+  JSONTEST_ASSERT_STRING_EQUAL("0.10000000000000000001",
+                               Json::String(begin, end));
+  // Non-strict literals are converted as usual.
+  JSONTEST_ASSERT(!root[6].getNumberText(&begin, &end));
+  // So are integers, which print back as they were written, but for -0.
+  JSONTEST_ASSERT(!root[0].getNumberText(&begin, &end));
+  JSONTEST_ASSERT(!root[1].getNumberText(&begin, &end));
+  JSONTEST_ASSERT(root[4].getNumberText(&begin, &end));
+  JSONTEST_ASSERT_EQUAL(Json::intValue, root[4].type());
+
+  Json::StreamWriterBuilder w;
+  w["indentation"] = "";
+  Json::Value const copy = root;
+  JSONTEST_ASSERT_STRING_EQUAL("[-12,18446744073709551615,"
+                               "123456789012345678901234,"
+                               "0.10000000000000000001,-0,1E+2,1]",
+                               Json::writeString(w, copy));
+  Json::FastWriter fastWriter;
+  JSONTEST_ASSERT_STRING_EQUAL("[-12,18446744073709551615,"
+                               "123456789012345678901234,"
+                               "0.10000000000000000001,-0,1E+2,1]\n",
+                               fastWriter.write(root));
+  delete reader;
+}
+
+struct CharReaderLazyUnescapeTest : JsonTest::TestCase {};
+
+JSONTEST_FIXTURE_LOCAL(CharReaderLazyUnescapeTest, lazyUnescape) {
+  Json::CharReaderBuilder b;
+  b["lazyUnescape"] = true;
+  Json::CharReader* reader(b.newCharReader());
+  Json::Value root;
+  Json::String errs;
+  char const doc[] = "[\"a\\\"b\\n\", \"\\u00e9\\ud852\\udf62\", "
+                     "\"\\/\\u0041\", \"\\u001f\", \"plain\"]";
+  bool ok = reader->parse(doc, doc + std::strlen(doc), &root, &errs);
+  JSONTEST_ASSERT(ok);
+  JSONTEST_ASSERT_STRING_EQUAL("", errs);
+  char const* begin;
+  char const* end;
+  JSONTEST_ASSERT(root[0].getEscapedString(&begin, &end));
+  JSONTEST_ASSERT_STRING_EQUAL("a\\\"b\\n", Json::String(begin, end));
+
+  // Escapes written as the writer would are emitted as is, others are
+  // normalized.
+  Json::StreamWriterBuilder w;
+  w["indentation"] = "";
+  JSONTEST_ASSERT_STRING_EQUAL("[\"a\\\"b\\n\",\"\\u00e9\\ud852\\udf62\","
+                               "\"/A\",\"\\u001f\",\"plain\"]",
+                               Json::writeString(w, root));
+  JSONTEST_ASSERT(root[1].getEscapedString(&begin, &end));
+  w["emitUTF8"] = true;
+  JSONTEST_ASSERT_STRING_EQUAL("[\"a\\\"b\\n\",\"\xc3\xa9\xf0\xa4\xad\xa2\","
+                               "\"/A\",\"\x1f\",\"plain\"]",
+                               Json::writeString(w, root));
+
+  // Strings are decoded once, into a copy kept along with the escaped form;
+  // copies keep strings escaped.
+  Json::Value const& first = root[0];
+  Json::Value const copy = first;
+  JSONTEST_ASSERT(copy.getEscapedString(&begin, &end));
+  JSONTEST_ASSERT_STRING_EQUAL("a\"b\n", first.asString());
+  JSONTEST_ASSERT(first.getString(&begin, &end));
+  JSONTEST_ASSERT_STRING_EQUAL("a\"b\n", Json::String(begin, end));
+  JSONTEST_ASSERT(first.asCString() == begin);
+  char const* escapedBegin;
+  JSONTEST_ASSERT(first.getEscapedString(&escapedBegin, &end));
+  JSONTEST_ASSERT_STRING_EQUAL("a\\\"b\\n", Json::String(escapedBegin, end));
+  JSONTEST_ASSERT(copy == first);
+  JSONTEST_ASSERT(!(copy < first));
+  JSONTEST_ASSERT(copy.getString(&escapedBegin, &end));
+  JSONTEST_ASSERT(escapedBegin != begin);
+  // Even a const object is only read: the decoded copy is kept aside.
+  Json::Value const second = root[1];
+  JSONTEST_ASSERT_STRING_EQUAL("\xc3\xa9\xf0\xa4\xad\xa2", second.asCString());
+  JSONTEST_ASSERT(second.getEscapedString(&begin, &end));
+
+  char const bad[] = "[\"\\x\"]";
+  ok = reader->parse(bad, bad + std::strlen(bad), &root, &errs);
+  JSONTEST_ASSERT(!ok);
+  JSONTEST_ASSERT_STRING_EQUAL("* Line 1, Column 2\n"
+                               "  Bad escape sequence in string\n"
+                               "See Line 1, Column 5 for detail.\n",
+                               errs);
+  delete reader;
+}
+
+struct CharReaderValidateUTF8Test : JsonTest::TestCase {};
+
+JSONTEST_FIXTURE_LOCAL(CharReaderValidateUTF8Test, validateUTF8) {
+  Json::CharReaderBuilder b;
+  b["validateUTF8"] = true;
+  Json::CharReader* reader(b.newCharReader());
+  Json::Value root;
+  Json::String errs;
+  {
+    char const doc[] = "{\"\xc3\xa9\": [\"plain ascii text\", "
+                       "\"\xe2\x82\xac\xf0\x9f\x98\x80\", \"\\ud83d\\ude00\"]}";
+    bool ok = reader->parse(doc, doc + std::strlen(doc), &root, &errs);
+    JSONTEST_ASSERT(ok);
+    JSONTEST_ASSERT_STRING_EQUAL("", errs);
+    JSONTEST_ASSERT(reader->getStructuredErrors().empty());
+  }
+  struct Case {
+    char const* doc;
+    ptrdiff_t offsetStart;
+    ptrdiff_t offsetLimit;
+  };
+  Case const cases[] = {
+      {"[\"abcdefghij\xc3(\"]", 12, 13},  // missing continuation byte
+      {"[\"\xc0\xaf\"]", 2, 3},           // overlong
+      {"[\"ok\", \"\xed\xa0\x80\"]", 8, 9}, // encoded surrogate
+      {"[\"\xf4\x90\x80\x80\"]", 2, 3},   // above U+10FFFF
+      {"[\"\xf0\x9f\x98\"]", 2, 5},       // truncated
+      {"{\"\x80\": 1}", 2, 3},            // in a member name
+  };
+  for (Case const& c : cases) {
+    bool ok = reader->parse(c.doc, c.doc + std::strlen(c.doc), &root, &errs);
+    JSONTEST_ASSERT(!ok);
+    std::vector<Json::CharReader::StructuredError> errors =
+        reader->getStructuredErrors();
+    JSONTEST_ASSERT(!errors.empty());
+    JSONTEST_ASSERT_EQUAL(c.offsetStart, errors[0].offset_start);
+    JSONTEST_ASSERT_EQUAL(c.offsetLimit, errors[0].offset_limit);
+    JSONTEST_ASSERT_STRING_EQUAL("Invalid UTF-8 sequence in string",
+                                 errors[0].message);
+  }
+  {
+    char const doc[] = "[\"\\udc00\"]";
+    bool ok = reader->parse(doc, doc + std::strlen(doc), &root, &errs);
+    JSONTEST_ASSERT(!ok);
+    JSONTEST_ASSERT_STRING_EQUAL("* Line 1, Column 2\n"
+                                 "  Unpaired low surrogate in string\n"
+                                 "See Line 1, Column 9 for detail.\n",
+                                 errs);
+  }
+  delete reader;
+}
+
 struct EscapeSequenceTest : JsonTest::TestCase {};
 
 JSONTEST_FIXTURE_LOCAL(EscapeSequenceTest, readerParseEscapeSequence) {
@@ -3339,6 +4321,293 @@ JSONTEST_FIXTURE_LOCAL(RValueTest, moveConstruction) {
   JSONTEST_ASSERT_EQUAL(Json::stringValue, moved["key"].type());
 }
 
+struct PointerTest : JsonTest::TestCase {};
+
+JSONTEST_FIXTURE_LOCAL(PointerTest, resolve) {
+  // The examples of RFC 6901, section 5.
+  std::istringstream doc(R"({"foo": ["bar", "baz"], "": 0, "a/b": 1,
+                             "c%d": 2, "e^f": 3, "g|h": 4, "i\\j": 5,
+                             "k\"l": 6, " ": 7, "m~n": 8})");
+  Json::Value root;
+  JSONTEST_ASSERT(
+      Json::parseFromStream(Json::CharReaderBuilder(), doc, &root, nullptr));
+  struct Case {
+    char const* pointer;
+    Json::Value const* expected;
+  };
+  Case const cases[] = {
+      {"", &root},
+      {"/foo", &root["foo"]},
+      {"/foo/0", &root["foo"][0]},
+      {"/", &root[""]},
+      {"/a~1b", &root["a/b"]},
+      {"/c%d", &root["c%d"]},
+      {"/e^f", &root["e^f"]},
+      {"/g|h", &root["g|h"]},
+      {"/i\\j", &root["i\\j"]},
+      {"/k\"l", &root["k\"l"]},
+      {"/ ", &root[" "]},
+      {"/m~0n", &root["m~n"]},
+      {"/foo/2", nullptr},
+      {"/foo/01", nullptr},
+      {"/foo/-", nullptr},
+      {"/foo/0/x", nullptr},
+      {"/bar", nullptr},
+  };
+  std::vector<Json::Pointer> pointers;
+  for (auto const& c : cases) {
+    Json::Pointer const pointer(c.pointer);
+    JSONTEST_ASSERT(pointer.resolve(root) == c.expected) << c.pointer;
+    JSONTEST_ASSERT_STRING_EQUAL(c.pointer, pointer.toString());
+    pointers.push_back(pointer);
+  }
+  std::vector<Json::Value const*> results;
+  Json::Pointer::resolveAll(pointers, root, &results);
+  JSONTEST_ASSERT_EQUAL(pointers.size(), results.size());
+  for (size_t i = 0; i < results.size(); ++i)
+    JSONTEST_ASSERT(results[i] == cases[i].expected) << cases[i].pointer;
+
+  JSONTEST_ASSERT_THROWS(Json::Pointer("foo"));
+  JSONTEST_ASSERT_THROWS(Json::Pointer("/m~2n"));
+  JSONTEST_ASSERT_THROWS(Json::Pointer("/m~"));
+}
+
+JSONTEST_FIXTURE_LOCAL(PointerTest, make) {
+  Json::Value root;
+  Json::Pointer("/a/0/b").make(root) = 1;
+  Json::Pointer("/a/-").make(root, Json::Value("moved"));
+  Json::Pointer("/a/-/c~1d").make(root) = true;
+  std::istringstream doc(R"({"a": [{"b": 1}, "moved", {"c/d": true}]})");
+  Json::Value expected;
+  JSONTEST_ASSERT(Json::parseFromStream(Json::CharReaderBuilder(), doc,
+                                        &expected, nullptr));
+  JSONTEST_ASSERT_EQUAL(expected, root);
+  JSONTEST_ASSERT(&Json::Pointer("").make(root) == &root);
+  JSONTEST_ASSERT_THROWS(Json::Pointer("/a/x").make(root));
+  JSONTEST_ASSERT_THROWS(Json::Pointer("/a/1/x").make(root));
+}
+
+JSONTEST_FIXTURE_LOCAL(PointerTest, pointerSet) {
+  std::istringstream doc(R"({"event": {"id": 7, "tags": ["a", "b"],
+                                       "user": {"name": "n", "age": 3}}})");
+  Json::Value root;
+  JSONTEST_ASSERT(
+      Json::parseFromStream(Json::CharReaderBuilder(), doc, &root, nullptr));
+  char const* const texts[] = {"/event/user/name", "/event/id",
+                               "",                 "/event/tags/1",
+                               "/event/user/name", "/event/missing/x",
+                               "/event/tags/2",    "/event/user/age"};
+  Json::PointerSet set;
+  for (char const* text : texts)
+    set.add(Json::Pointer(text));
+  JSONTEST_ASSERT_EQUAL(8, set.size());
+  std::vector<Json::Value const*> results(1, &root);
+  set.resolve(root, &results);
+  JSONTEST_ASSERT_EQUAL(8, results.size());
+  for (size_t i = 0; i < results.size(); ++i)
+    JSONTEST_ASSERT(results[i] == Json::Pointer(texts[i]).resolve(root))
+        << texts[i];
+  JSONTEST_ASSERT(results[0] == results[4]);
+  JSONTEST_ASSERT_EQUAL(3, *results[7]);
+}
+
+struct QueryTest : JsonTest::TestCase {
+  // The bookstore of RFC 9535, figure 1.
+  static Json::Value bookstore() {
+    std::istringstream doc(R"({"store": {
+      "book": [
+        {"category": "reference", "author": "Nigel Rees",
+         "title": "Sayings of the Century", "price": 8.95},
+        {"category": "fiction", "author": "Evelyn Waugh",
+         "title": "Sword of Honour", "price": 12.99},
+        {"category": "fiction", "author": "Herman Melville",
+         "title": "Moby Dick", "isbn": "0-553-21311-3", "price": 8.99},
+        {"category": "fiction", "author": "J. R. R. Tolkien",
+         "title": "The Lord of the Rings", "isbn": "0-395-19395-8",
+         "price": 22.99}
+      ],
+      "bicycle": {"color": "red", "price": 399}}})");
+    Json::Value root;
+    Json::parseFromStream(Json::CharReaderBuilder(), doc, &root, nullptr);
+    return root;
+  }
+  // The values the query selects, written compactly and space separated.
+  static Json::String select(Json::Value const& root, char const* query) {
+    std::vector<Json::Value const*> results;
+    Json::Query(query).select(root, &results);
+    Json::StreamWriterBuilder b;
+    b["indentation"] = "";
+    b["precisionType"] = "shortest";
+    Json::String text;
+    for (Json::Value const* value : results)
+      text += (text.empty() ? "" : " ") + Json::writeString(b, *value);
+    return text;
+  }
+};
+
+JSONTEST_FIXTURE_LOCAL(QueryTest, bookstore) {
+  Json::Value const root = bookstore();
+  Json::String const authors =
+      R"("Nigel Rees" "Evelyn Waugh" "Herman Melville" "J. R. R. Tolkien")";
+  JSONTEST_ASSERT_STRING_EQUAL(authors,
+                               select(root, "$.store.book[*].author"));
+  JSONTEST_ASSERT_STRING_EQUAL(authors, select(root, "$..author"));
+  JSONTEST_ASSERT_STRING_EQUAL("399 8.95 12.99 8.99 22.99",
+                               select(root, "$.store..price"));
+  JSONTEST_ASSERT_STRING_EQUAL(R"("Moby Dick")",
+                               select(root, "$..book[2].title"));
+  JSONTEST_ASSERT_STRING_EQUAL(R"("The Lord of the Rings")",
+                               select(root, "$..book[-1]['title']"));
+  JSONTEST_ASSERT_STRING_EQUAL(R"("Sayings of the Century" "Sword of Honour")",
+                               select(root, "$..book[0, 1].title"));
+  JSONTEST_ASSERT_STRING_EQUAL(R"("Sayings of the Century" "Sword of Honour")",
+                               select(root, "$..book[:2].title"));
+  JSONTEST_ASSERT_STRING_EQUAL(R"("Moby Dick" "The Lord of the Rings")",
+                               select(root, "$..book[?@.isbn].title"));
+  JSONTEST_ASSERT_STRING_EQUAL(R"("Sayings of the Century" "Moby Dick")",
+                               select(root, "$..book[?@.price<10].title"));
+  JSONTEST_ASSERT_STRING_EQUAL(
+      R"("Sword of Honour" "Moby Dick")",
+      select(root, "$.store.book[?@.category == \"fiction\" && "
+                   "!(@.price > 20)].title"));
+  JSONTEST_ASSERT_STRING_EQUAL(
+      R"("Sayings of the Century")",
+      select(root, "$..book[?@.price == $.store.book[0].price].title"));
+  std::vector<Json::Value const*> all;
+  Json::Query("$..*").select(root, &all);
+  JSONTEST_ASSERT_EQUAL(27, all.size());
+  JSONTEST_ASSERT(all[0] == &root["store"]);
+  JSONTEST_ASSERT(all[1] == &root["store"]["bicycle"]);
+}
+
+JSONTEST_FIXTURE_LOCAL(QueryTest, slicesAndComparisons) {
+  Json::Value root(Json::arrayValue);
+  for (int i = 0; i < 7; ++i)
+    root.append(i);
+  JSONTEST_ASSERT_STRING_EQUAL("1 3", select(root, "$[1:5:2]"));
+  JSONTEST_ASSERT_STRING_EQUAL("5 3", select(root, "$[5:1:-2]"));
+  JSONTEST_ASSERT_STRING_EQUAL("6 5 4 3 2 1 0", select(root, "$[::-1]"));
+  JSONTEST_ASSERT_STRING_EQUAL("4 5 6", select(root, "$[-3:]"));
+  JSONTEST_ASSERT_STRING_EQUAL("", select(root, "$[0:7:0]"));
+  JSONTEST_ASSERT_STRING_EQUAL("2", select(root, "$[?@ == 2.0]"));
+  JSONTEST_ASSERT_STRING_EQUAL("0 1 6",
+                               select(root, "$[?@ < 2 || @ >= 6]"));
+  JSONTEST_ASSERT_STRING_EQUAL("", select(root, "$[?@ < 'a']"));
+  JSONTEST_ASSERT_STRING_EQUAL("0 1 2 3 4 5 6",
+                               select(root, "$[?$[0] == null || @.x == @.y]"));
+
+  char const* const invalid[] = {"store", "$.",         "$[1",
+                                 "$[01]", "$[?1]",      "$[?@..a == 1]",
+                                 "$ ",    "$['a\\q']", "$.1a"};
+  for (char const* query : invalid)
+    JSONTEST_ASSERT_THROWS(Json::Query{query});
+}
+
+struct PatchTest : JsonTest::TestCase {
+  static Json::Value parse(char const* text) {
+    std::istringstream doc(text);
+    Json::Value root;
+    Json::parseFromStream(Json::CharReaderBuilder(), doc, &root, nullptr);
+    return root;
+  }
+};
+
+JSONTEST_FIXTURE_LOCAL(PatchTest, applyPatch) {
+  // The examples of RFC 6902, appendix A, applied one after the other.
+  Json::Value target = parse(R"({"foo": "bar", "baz": "qux",
+                                 "list": ["a", "b", "c", "d"]})");
+  Json::applyPatch(target, parse(R"([
+      {"op": "add", "path": "/list/1", "value": "x"},
+      {"op": "remove", "path": "/baz"},
+      {"op": "replace", "path": "/foo", "value": {"bar": [1, 2]}},
+      {"op": "move", "from": "/list/4", "path": "/list/0"},
+      {"op": "move", "from": "/list", "path": "/foo/list"},
+      {"op": "copy", "from": "/foo/bar", "path": "/copy"},
+      {"op": "add", "path": "/copy/-", "value": 3},
+      {"op": "test", "path": "/foo/list/1", "value": "a"},
+      {"op": "test", "path": "/copy", "value": [1.0, 2, 3]},
+      {"op": "add", "path": "", "value": {"root": "replaced"}},
+      {"op": "move", "from": "/root", "path": "/old"},
+      {"op": "add", "path": "/old", "value": "x"},
+      {"op": "copy", "from": "", "path": "/old"}
+  ])"));
+  JSONTEST_ASSERT_EQUAL(parse(R"({"old": {"old": "x"}})"), target);
+
+  target = parse(R"({"a": {"x": [1]}, "b": [0, 1, 2]})");
+  Json::Value const* moved = &target["a"]["x"];
+  Json::applyPatch(target, parse(R"([{"op": "move", "from": "/a",
+                                      "path": "/b/1"}])"));
+  JSONTEST_ASSERT_EQUAL(parse(R"({"b": [0, {"x": [1]}, 1, 2]})"), target);
+  // The moved value was not copied: its members are where they were.
+  JSONTEST_ASSERT(moved == &target["b"][1]["x"]);
+}
+
+JSONTEST_FIXTURE_LOCAL(PatchTest, moveDoesNotVisitMovedValues) {
+  // A Document marks the values it parses as pristine, and anything walking
+  // the moved subtree to update them would unmark them all: that they keep
+  // their marks shows the move cost nothing per moved value.
+  Json::String text = "{\"big\": [";
+  Json::String written = "{\"list\":[1,[";
+  for (int i = 0; i < 100000; ++i) {
+    text += i ? ", [0]" : "[0]";
+    written += i ? ",[0]" : "[0]";
+  }
+  text += "], \"list\": [1, 2]}";
+  written += "],2]}";
+  Json::Document doc;
+  Json::String errs;
+  JSONTEST_ASSERT(
+      doc.parseKeepingSource(Json::CharReaderBuilder(), text, &errs));
+  Json::Value const& root = doc.root();
+  Json::Value const* first = &root["big"][0];
+  Json::applyPatch(doc.root(), parse(R"([{"op": "move", "from": "/big",
+                                          "path": "/list/1"}])"));
+  Json::Value const& big = root["list"][1];
+  JSONTEST_ASSERT_EQUAL(100000u, big.size());
+  JSONTEST_ASSERT(first == &big[0]);
+  bool pristine = true;
+  for (Json::Value const& element : big)
+    pristine = pristine && element.isPristine();
+  JSONTEST_ASSERT(pristine);
+
+  // Being moved, they are written in full.
+  Json::StreamWriterBuilder wb;
+  wb["indentation"] = "";
+  Json::StringOutputBuffer out;
+  doc.write(wb, &out);
+  JSONTEST_ASSERT(written == out.release());
+}
+
+JSONTEST_FIXTURE_LOCAL(PatchTest, rollback) {
+  Json::Value const original =
+      parse(R"({"foo": {"bar": [1, 2, 3]}, "baz": "qux"})");
+  char const* const failing[] = {
+      // A failed test undoes everything before it.
+      R"([{"op": "add", "path": "/foo/bar/1", "value": 9},
+          {"op": "remove", "path": "/baz"},
+          {"op": "move", "from": "/foo/bar/0", "path": "/foo/first"},
+          {"op": "move", "from": "/foo", "path": "/baz"},
+          {"op": "replace", "path": "", "value": []},
+          {"op": "add", "path": "/-", "value": 1},
+          {"op": "test", "path": "/0", "value": 2}])",
+      R"([{"op": "copy", "from": "/foo", "path": "/baz"},
+          {"op": "remove", "path": "/missing"}])",
+      R"([{"op": "move", "from": "/foo/bar/2", "path": "/foo/bar/-"},
+          {"op": "add", "path": "/foo/bar/5", "value": 0}])",
+      // Malformed patches are rejected before anything is applied.
+      R"([{"op": "remove", "path": "/baz"}, {"op": "bad", "path": ""}])",
+      R"([{"op": "remove", "path": "/baz"}, {"op": "add", "path": "/x"}])",
+      R"([{"op": "move", "from": "/foo", "path": "/foo/bar/x"}])",
+      R"([{"op": "remove", "path": "baz"}])",
+      R"({"op": "remove", "path": "/baz"})",
+  };
+  for (char const* patch : failing) {
+    Json::Value target = original;
+    JSONTEST_ASSERT_THROWS(Json::applyPatch(target, parse(patch)));
+    JSONTEST_ASSERT_EQUAL(original, target) << patch;
+  }
+}
+
 struct FuzzTest : JsonTest::TestCase {};
 
 // Build and run the fuzz test without any fuzzer, so that it's guaranteed not